@@ -1,7 +1,15 @@
 #pragma once
 #include <assert.h>
 
+#include "dataframe/graph.h"
+#include "dataframe/groupby.h"
+#include "dataframe/join.h"
+#include "dataframe/query.h"
+#include "dataframe/sketches.h"
+#include "dataframe/sort.h"
+#include "mapreduce.h"
 #include "network/network_ifc.h"
+#include "store/bitmaps.h"
 #include "store/kdstore.h"
 #include "store/kvstore.h"
 #include "util/thread.h"
@@ -58,6 +66,71 @@ class Application : public Thread {
         return net_.this_node();
     }
 
+    /**
+     * Runs a map reduce job over the given rows and stores the reduced rows
+     * at a key, see MapReduce. Every node must call it with the same
+     * arguments.
+     * @arg k  the key to store the result at
+     * @arg in  the input rows, external
+     * @arg types  the types of the emitted and reduced rows
+     * @arg num_keys  how many of the leading fields of those rows make the key
+     * @arg mapper  the map function
+     * @arg reducer  the reduce function
+     * @arg combiner  the combine function, or nullptr
+     * @return the result frame, owned by the caller
+     */
+    DataFrame* map_reduce(Key* k, RowSource* in, const char* types, size_t num_keys,
+                          MapFunction* mapper, ReduceFunction* reducer, ReduceFunction* combiner) {
+        MapReduce job(&kd_, types, num_keys, mapper, reducer, combiner);
+        return job.run(k, in);
+    }
+
+    /**
+     * Sketches a column of the given rows on every node and merges the
+     * sketches, see ColumnSketch. Every node must call it with the same
+     * arguments.
+     * @arg name  the name of the exchange, which must not be reused
+     * @arg in  the rows, external
+     * @arg col  the column to sketch
+     * @arg k  how many of the most frequent values to keep
+     * @return the merged sketches, owned by the caller
+     */
+    ColumnSketch* sketch(const char* name, RowSource* in, size_t col, size_t k) {
+        ColumnSketch* result = new ColumnSketch(col, in->get_schema().col_type(col), k);
+        result->run(&kv_, name, in);
+        return result;
+    }
+
+    /**
+     * Sketches several columns of the given rows in a single pass over them,
+     * see ColumnSketch::run_all. Every node must call it with the same
+     * arguments.
+     * @arg name  the name of the exchange, which must not be reused
+     * @arg in  the rows, external
+     * @arg cols  the columns to sketch
+     * @arg k  how many of the most frequent values to keep
+     * @return the merged sketches, one per column, owned by the caller
+     */
+    std::vector<ColumnSketch*> sketch_all(const char* name, RowSource* in,
+                                          std::vector<size_t> cols, size_t k) {
+        std::vector<ColumnSketch*> result;
+        for (size_t col : cols) {
+            result.push_back(new ColumnSketch(col, in->get_schema().col_type(col), k));
+        }
+        ColumnSketch::run_all(&kv_, name, in, result);
+        return result;
+    }
+
+    /**
+     * Replaces the bitmap of every node by the union of all of them, see
+     * ::union_all. Every node must call it.
+     * @arg name  the name of the exchange, which must not be reused
+     * @arg b  the bitmap of this node
+     */
+    void union_all(const char* name, Bitmap& b) {
+        ::union_all(&kv_, name, b);
+    }
+
     /**
      * Returns the number of nodes in this application
      * @return the number of nodes
@@ -0,0 +1,288 @@
+#pragma once
+#include <assert.h>
+
+#include <vector>
+
+#include "dataframe/dataframe.h"
+#include "dataframe/row.h"
+#include "dataframe/rowbatch.h"
+#include "dataframe/rowsource.h"
+#include "dataframe/schema.h"
+#include "dataframe/visitor.h"
+#include "store/exchange.h"
+#include "store/kdstore.h"
+#include "util/hashtable.h"
+
+/**
+ * Passes the rows a MapFunction fills in on to the next step of a job.
+ * Author: gomes.chri, modi.an
+ */
+class Emitter : public Object {
+   public:
+    Row row_;
+    Reader& next_;
+
+    Emitter(Schema& s, Reader& next) : Object(), row_(s), next_(next) {}
+
+    /** The row to fill in before calling emit(). */
+    Row& row() {
+        return row_;
+    }
+
+    /** Emits the current row. */
+    void emit() {
+        next_.visit(row_);
+    }
+};
+
+/**
+ * The map function of a MapReduce job.
+ * Author: gomes.chri, modi.an
+ */
+class MapFunction : public Object {
+   public:
+    MapFunction() : Object() {}
+
+    virtual ~MapFunction() {}
+
+    /**
+     * Emits any number of rows for an input row, by filling in out.row()
+     * and calling out.emit() for each.
+     * @arg in  the input row
+     * @arg out  the emitter
+     */
+    virtual void map(Row& in, Emitter& out) {}
+};
+
+/**
+ * The combine or reduce function of a MapReduce job.
+ * Author: gomes.chri, modi.an
+ */
+class ReduceFunction : public Object {
+   public:
+    ReduceFunction() : Object() {}
+
+    virtual ~ReduceFunction() {}
+
+    /**
+     * Folds a row into the accumulated row with the same key. The key
+     * fields of acc must not change.
+     * @arg acc  the accumulated row, starts as the first row with its key
+     * @arg in  the row to fold in
+     */
+    virtual void reduce(Row& acc, Row& in) {}
+};
+
+/**
+ * Rows folded into one accumulated row per key. The key is made of the
+ * leading fields of a row.
+ * Author: gomes.chri, modi.an
+ */
+class ReduceTable : public Object {
+   public:
+    HashTable keys_;
+    std::vector<Row*> accs_;  // owned, one per key
+    Schema& schema_;
+    std::vector<size_t> key_cols_;
+    std::vector<size_t> all_;
+    ReduceFunction* fn_;  // external
+    std::vector<char> buf_;
+
+    ReduceTable(Schema& schema, size_t num_keys, ReduceFunction* fn)
+        : Object(), keys_(), schema_(schema) {
+        for (size_t i = 0; i < schema.width(); i++) {
+            if (i < num_keys) key_cols_.push_back(i);
+            all_.push_back(i);
+        }
+        fn_ = fn;
+    }
+
+    virtual ~ReduceTable() {
+        for (Row* acc : accs_) {
+            delete acc;
+        }
+    }
+
+    /** The number of keys. */
+    size_t size() {
+        return accs_.size();
+    }
+
+    /** Folds a row into the row accumulated for its key. */
+    void add(Row& r) {
+        buf_.clear();
+        r.encode(key_cols_, buf_);
+        size_t g = keys_.insert(buf_.data(), buf_.size());
+        if (g < accs_.size()) {
+            fn_->reduce(*accs_[g], r);
+            return;
+        }
+        buf_.clear();
+        r.encode(all_, buf_);
+        Row* acc = new Row(schema_);
+        acc->decode(buf_.data(), 0, schema_.width());
+        accs_.push_back(acc);
+    }
+};
+
+/**
+ * Reader that folds every visited row into a ReduceTable.
+ */
+class ReduceAdder : public Reader {
+   public:
+    ReduceTable& table_;
+
+    ReduceAdder(ReduceTable& table) : Reader(), table_(table) {}
+
+    void visit(Row& r) override {
+        table_.add(r);
+    }
+};
+
+/**
+ * Reader that runs a map function over every visited row.
+ */
+class MapRunner : public Reader {
+   public:
+    MapFunction* fn_;
+    Emitter& out_;
+
+    MapRunner(MapFunction* fn, Emitter& out) : Reader(), fn_(fn), out_(out) {}
+
+    void visit(Row& r) override {
+        fn_->map(r, out_);
+    }
+};
+
+/**
+ * A map reduce job. Every node maps the input rows it holds, optionally
+ * combines the emitted rows with equal keys, and shuffles them straight to
+ * the node owning their key hash. Each node then reduces the keys it owns,
+ * in parallel with the others. Running a job is a collective operation:
+ * every node must run it with the same arguments. The blobs exchanged are
+ * removed from the store as they are received.
+ * Author: gomes.chri, modi.an
+ */
+class MapReduce : public Object {
+   public:
+    KDStore* kd_;
+    String* types_;  // the types of the emitted rows
+    size_t num_keys_;
+    MapFunction* mapper_;       // external
+    ReduceFunction* reducer_;   // external
+    ReduceFunction* combiner_;  // external, may be nullptr
+
+    /**
+     * @arg kd  the store
+     * @arg types  the types of the emitted and reduced rows
+     * @arg num_keys  how many of the leading fields of those rows make the key
+     * @arg mapper  the map function
+     * @arg reducer  the reduce function
+     * @arg combiner  the function folding emitted rows before they are
+     *   shuffled, or nullptr to ship every emitted row
+     */
+    MapReduce(KDStore* kd, const char* types, size_t num_keys, MapFunction* mapper,
+              ReduceFunction* reducer, ReduceFunction* combiner)
+        : Object() {
+        assert(kd != nullptr && mapper != nullptr && reducer != nullptr);
+        assert(num_keys > 0 && num_keys <= strlen(types));
+        kd_ = kd;
+        types_ = new String(types);
+        num_keys_ = num_keys;
+        mapper_ = mapper;
+        reducer_ = reducer;
+        combiner_ = combiner;
+    }
+
+    MapReduce(const MapReduce& other)
+        : MapReduce(other.kd_, other.types_->c_str(), other.num_keys_, other.mapper_,
+                    other.reducer_, other.combiner_) {}
+
+    virtual ~MapReduce() {
+        delete types_;
+    }
+
+    /**
+     * Runs the job and visits the reduced rows of the keys this node owns.
+     * @arg name  the name of the exchange, which must not be reused
+     * @arg in  the input rows, external
+     * @arg v  the reader to visit the reduced rows with
+     */
+    void run(const char* name, RowSource* in, Reader& v) {
+        KVStore* kv = kd_->get_kvstore();
+        size_t nodes = kv->num_nodes();
+        Schema schema(types_->c_str());
+        std::vector<size_t> keys;
+        for (size_t i = 0; i < num_keys_; i++) {
+            keys.push_back(i);
+        }
+
+        // map the local rows, combining them if there is a combiner
+        std::vector<RowBatch> batches(nodes);
+        KeyedRowCollector shuffle(batches, keys, schema.width(), true);
+        if (combiner_ != nullptr) {
+            ReduceTable combined(schema, num_keys_, combiner_);
+            ReduceAdder adder(combined);
+            Emitter out(schema, adder);
+            MapRunner runner(mapper_, out);
+            in->local_map(runner);
+            for (Row* acc : combined.accs_) {
+                shuffle.visit(*acc);
+            }
+        } else {
+            Emitter out(schema, shuffle);
+            MapRunner runner(mapper_, out);
+            in->local_map(runner);
+        }
+
+        // shuffle the rows to the owners of their keys
+        Exchange ex(kv, name);
+        for (size_t n = 0; n < nodes; n++) {
+            Serializer s;
+            batches[n].serialize(&s);
+            ex.send(n, s);
+        }
+
+        // reduce the keys this node owns
+        ReduceTable reduced(schema, num_keys_, reducer_);
+        Row r(schema);
+        for (size_t n = 0; n < nodes; n++) {
+            Value* val = ex.receive(n);
+            BatchCursor cur(val);
+            while (!cur.done()) {
+                size_t len;
+                const char* rec = cur.next(&len);
+                size_t klen = 0;
+                for (size_t i = 0; i < num_keys_; i++) {
+                    klen += encoded_size(schema.col_type(i), rec + klen);
+                }
+                r.decode(rec + klen, 0, schema.width());
+                reduced.add(r);
+            }
+            delete val;
+        }
+        for (Row* acc : reduced.accs_) {
+            v.visit(*acc);
+        }
+    }
+
+    /**
+     * Runs the job and stores the reduced rows as a frame at the output key,
+     * each node storing the rows it reduces with store_rows. The name of the
+     * key must not be reused by another collective operation.
+     * @arg k  the key to store the result at
+     * @arg in  the input rows, external
+     * @return the result frame, owned by the caller
+     */
+    DataFrame* run(Key* k, RowSource* in) {
+        RowBatch rows;
+        RowCollector collector(rows, types_->size());
+        String* name = StrBuff().c(k->k_.c_str()).c("~mr").get();
+        run(name->c_str(), in, collector);
+        String* gname = StrBuff().c(*name).c("~all").get();
+        DataFrame* result = store_rows(k, kd_, gname->c_str(), types_->c_str(), rows);
+        delete gname;
+        delete name;
+        return result;
+    }
+};
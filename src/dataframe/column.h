@@ -2,7 +2,9 @@
 #include <assert.h>
 #include <stdarg.h>
 
+#include <algorithm>
 #include <array>
+#include <memory>
 #include <random>
 #include <vector>
 
@@ -15,6 +17,21 @@
  */
 enum class ColumnType { STRING, INTEGER, DOUBLE, BOOL, UNKNOWN };
 
+/**
+ * Where the rows of a column are: the key of every segment, the row each
+ * segment starts at, counting from the first row of the first segment, and
+ * the item of the segment that row is. Copies of a column share one table
+ * until one of them changes it, so copying a column costs the same however
+ * many segments it has.
+ * Author: gomes.chri, modi.an
+ */
+class SegmentTable : public Object {
+   public:
+    std::vector<Key> keys_;
+    std::vector<size_t> starts_;
+    std::vector<size_t> bases_;
+};
+
 class IntColumn;
 class DoubleColumn;
 class BoolColumn;
@@ -33,36 +50,30 @@ static const size_t ALPHA_SIZE = strlen(ALPHA);
  */
 class Column : public Object {
    public:
-    std::vector<Key> segments_;
+    std::shared_ptr<SegmentTable> table_;  // shared by copies until one of them changes it
     KVStore* store_;
     bool finalized_;
     size_t size_;
+    size_t offset_;  // where the rows start in the first segment
     String* col_id_;
+    std::vector<std::string> owners_;  // the ids of the segments this column wrote
     Array* cache_;
     Key cache_key_;
     size_t curr_node_;
+    bool local_;  // new segments are stored on this node rather than spread out
     const size_t segment_capacity_;
 
     Column(KVStore* store, size_t segment_capacity)
         : Object(), segment_capacity_(segment_capacity) {
         size_ = 0;
-        segments_ = std::vector<Key>();
+        offset_ = 0;
+        table_ = std::make_shared<SegmentTable>();
         store_ = store;
         finalized_ = false;
-        StrBuff buff;
-        char c[2];
-        c[1] = '\0';
-        // Brought in from cppreference.com
-        std::random_device rd;   // Will be used to obtain a seed for the random number engine
-        std::mt19937 gen(rd());  // Standard mersenne_twister_engine seeded with rd()
-        std::uniform_int_distribution<> dis(0, ALPHA_SIZE);
-
-        for (size_t i = 0; i < 10; i++) {
-            c[0] = ALPHA[dis(gen)];
-            buff.c(c);
-        }
-        col_id_ = buff.get();
+        col_id_ = random_id_();
+        owners_.push_back(col_id_->c_str());
         curr_node_ = 0;
+        local_ = false;
         expand_();
     }
 
@@ -72,25 +83,67 @@ class Column : public Object {
      * Not providing this constructor with the same KVStore as
      * the serialized column is undefined behavior.
      */
-    Column(KVStore* store, Deserializer* d)
-        : Object(), segment_capacity_(DEFAULT_SEGMENT_CAPACITY) {
+    Column(KVStore* store, Deserializer* d) : Object(), segment_capacity_(d->get_size_t()) {
         store_ = store;
         finalized_ = true;
         size_ = d->get_size_t();
+        offset_ = d->get_size_t();
         col_id_ = d->get_string();
+        owners_.resize(d->get_size_t());
+        for (std::string& owner : owners_) {
+            d->get_string(owner);
+        }
         size_t num_segments = d->get_size_t();
-        segments_ = std::vector<Key>();
+        table_ = std::make_shared<SegmentTable>();
         curr_node_ = 0;
+        local_ = false;
         for (size_t i = 0; i < num_segments; i++) {
-            segments_.push_back(Key(d));
+            table_->keys_.push_back(Key(d));
+            table_->starts_.push_back(d->get_size_t());
+            table_->bases_.push_back(d->get_size_t());
         }
     }
 
+    /**
+     * Copying constructor for the metadata of a finalized column. The copy
+     * reads the same stored segments, and shares the table of them until
+     * either column changes it.
+     */
+    Column(Column& from) : Object(), segment_capacity_(from.segment_capacity_) {
+        assert(from.finalized_);
+        table_ = from.table_;
+        store_ = from.store_;
+        finalized_ = true;
+        size_ = from.size_;
+        offset_ = from.offset_;
+        col_id_ = from.col_id_->clone();
+        owners_ = from.owners_;
+        curr_node_ = 0;
+        local_ = false;
+    }
+
     virtual ~Column() {
         delete col_id_;
         delete cache_;
     }
 
+    /** Makes a random name for the segments of a column. */
+    static String* random_id_() {
+        StrBuff buff;
+        char c[2];
+        c[1] = '\0';
+        // Brought in from cppreference.com
+        std::random_device rd;   // Will be used to obtain a seed for the random number engine
+        std::mt19937 gen(rd());  // Standard mersenne_twister_engine seeded with rd()
+        std::uniform_int_distribution<> dis(0, ALPHA_SIZE - 1);
+
+        for (size_t i = 0; i < 10; i++) {
+            c[0] = ALPHA[dis(gen)];
+            buff.c(c);
+        }
+        return buff.get();
+    }
+
     /** Type converters: Return same column under its actual type, or
      *  nullptr if of the wrong type.  */
     virtual IntColumn* as_int() {
@@ -143,17 +196,12 @@ class Column : public Object {
     std::vector<size_t> local_indices() {
         assert(finalized_);
         std::vector<size_t> indices = std::vector<size_t>();
-        for (size_t i = 0; i < segments_.size(); i++) {
-            if (segments_[i].get_node() == store_->this_node()) {
-                size_t start = i * segment_capacity_;
-                size_t end;
-                if (i < segments_.size() - 1 || size_ % segment_capacity_ == 0) {
-                    end = start + segment_capacity_;
-                } else {
-                    end = start + (size_ % segment_capacity_);
-                }
+        for (size_t i = 0; i < table_->keys_.size(); i++) {
+            if (table_->keys_[i].get_node() == store_->this_node()) {
+                size_t start = std::max(table_->starts_[i], offset_);
+                size_t end = std::min(segment_end_(i), offset_ + size_);
                 for (size_t j = start; j < end; j++) {
-                    indices.push_back(j);
+                    indices.push_back(j - offset_);
                 }
             }
         }
@@ -172,6 +220,137 @@ class Column : public Object {
         put_in_store_();
     }
 
+    /**
+     * Lets values be pushed onto a finalized column again, until it is
+     * finalized once more. Stored segments are never changed, since frames
+     * read before may still use them: a tail segment that is not full is
+     * sealed and the values it holds for this column are copied into a new
+     * tail segment. New segments get a new name, so that copies of a column
+     * can grow apart, and the column only owns those: the segments it keeps
+     * are owned by the columns read before.
+     */
+    void reopen() {
+        assert(finalized_);
+        finalized_ = false;
+        delete col_id_;
+        col_id_ = random_id_();
+        owners_.assign(1, col_id_->c_str());
+        curr_node_ = table_->keys_.size() % store_->num_nodes();
+        if (tail_full_()) {
+            expand_();
+            return;
+        }
+        size_t tail = table_->keys_.size() - 1;
+        cache_segment_(tail);
+        cache_->truncate(item_of_(tail, offset_ + size_));
+        cache_->reserve(segment_capacity_);
+        String* name = StrBuff().c(*col_id_).c("_").c(tail).get();
+        SegmentTable& t = own_table_();
+        t.keys_[tail] = Key(name->c_str(), t.keys_[tail].get_node());
+        cache_key_ = Key();
+        delete name;
+    }
+
+    /**
+     * Narrows a finalized column to the rows from begin to end. Only the
+     * metadata changes: segments holding none of the rows are dropped, and
+     * the rows start at an offset into the first segment kept.
+     * @arg begin  the first row kept
+     * @arg end  the row after the last one kept
+     */
+    void narrow(size_t begin, size_t end) {
+        assert(finalized_ && begin <= end && end <= size_);
+        size_t first = segment_of_(offset_ + begin);
+        size_t last = begin == end ? first + 1 : segment_of_(offset_ + end - 1) + 1;
+        size_t base = table_->starts_[first];
+        std::shared_ptr<SegmentTable> t = std::make_shared<SegmentTable>();
+        t->keys_.assign(table_->keys_.begin() + first, table_->keys_.begin() + last);
+        t->starts_.assign(table_->starts_.begin() + first, table_->starts_.begin() + last);
+        t->bases_.assign(table_->bases_.begin() + first, table_->bases_.begin() + last);
+        for (size_t i = 0; i < t->starts_.size(); i++) {
+            t->starts_[i] -= base;
+        }
+        table_ = t;
+        offset_ = offset_ + begin - base;
+        size_ = end - begin;
+    }
+
+    /**
+     * Makes new segments of the column be stored on this node. Must be
+     * called before anything is pushed.
+     */
+    void place_locally() {
+        assert(!finalized_ && size_ == 0 && table_->keys_.size() == 1);
+        curr_node_ = store_->this_node();
+        own_table_().keys_[0].set_node(curr_node_);
+        local_ = true;
+    }
+
+    /**
+     * Appends the rows of another finalized column of the same type, which
+     * may be a view, by appending the segments holding them. Only the
+     * metadata changes. Segments without rows are left out. The column owns
+     * the segments of both.
+     * @arg other  the column whose rows to append
+     */
+    void concat(Column& other) {
+        assert(finalized_ && other.finalized_ && other.get_type() == get_type());
+        for (std::string& owner : other.owners_) {
+            if (std::find(owners_.begin(), owners_.end(), owner) == owners_.end()) {
+                owners_.push_back(owner);
+            }
+        }
+        size_t end = offset_ + size_;
+        SegmentTable& t = own_table_();
+        while (t.keys_.size() > 1 && t.starts_.back() == end) {
+            t.keys_.pop_back();
+            t.starts_.pop_back();
+            t.bases_.pop_back();
+        }
+        for (size_t i = 0; i < other.table_->keys_.size(); i++) {
+            size_t begin = std::max(other.table_->starts_[i], other.offset_);
+            size_t stop = std::min(other.segment_end_(i), other.offset_ + other.size_);
+            if (stop <= begin) {
+                continue;
+            }
+            if (size_ == 0) {
+                // nothing to keep of this column
+                t.keys_.clear();
+                t.starts_.clear();
+                t.bases_.clear();
+                offset_ = end = 0;
+            }
+            t.keys_.push_back(other.table_->keys_[i]);
+            t.starts_.push_back(end);
+            t.bases_.push_back(other.item_of_(i, begin));
+            end += stop - begin;
+            size_ += stop - begin;
+        }
+    }
+
+    /**
+     * Gives up the segments of a column that is a view of others, so that
+     * removing the view leaves the segments to the columns it reads.
+     */
+    void disown() {
+        owners_.clear();
+    }
+
+    /**
+     * Checks whether the column wrote a segment, rather than reading it from
+     * a column it was copied from.
+     * @arg k  the key of the segment
+     */
+    bool owns(Key& k) {
+        for (std::string& owner : owners_) {
+            if (k.k_.size() > owner.size() && k.k_.compare(0, owner.size(), owner) == 0 &&
+                k.k_[owner.size()] == '_') {
+                return true;
+            }
+        }
+        return false;
+    }
+
     /**
      * Makes a copy of the column.
      */
@@ -186,27 +365,116 @@ class Column : public Object {
      */
     virtual void serialize(Serializer* s) {
         assert(finalized_);
+        s->add_size_t(segment_capacity_);
         s->add_size_t(size_);
+        s->add_size_t(offset_);
         s->add_string(col_id_);
-        s->add_size_t(segments_.size());
-        for (size_t i = 0; i < segments_.size(); i++) {
-            segments_[i].serialize(s);
+        s->add_size_t(owners_.size());
+        for (std::string& owner : owners_) {
+            s->add_string(owner);
+        }
+        s->add_size_t(table_->keys_.size());
+        for (size_t i = 0; i < table_->keys_.size(); i++) {
+            table_->keys_[i].serialize(s);
+            s->add_size_t(table_->starts_[i]);
+            s->add_size_t(table_->bases_[i]);
+        }
+    }
+
+    /**
+     * Gets the table of segments to change, after copying it if another
+     * column shares it.
+     */
+    SegmentTable& own_table_() {
+        if (table_.use_count() > 1) {
+            table_ = std::make_shared<SegmentTable>(*table_);
         }
+        return *table_;
+    }
+
+    /**
+     * Finds the segment holding the given row, counted from the first row of
+     * the first segment. Segments are mostly full, so the first guesses
+     * interpolate between the starts; a binary search takes over if they
+     * miss.
+     */
+    size_t segment_of_(size_t row) {
+        std::vector<size_t>& starts = table_->starts_;
+        size_t lo = 0;
+        size_t hi = starts.size();  // the segment is one of lo to hi - 1
+        for (size_t probes = 0; probes < 2 && hi - lo > 1; probes++) {
+            size_t last = starts[hi - 1];
+            if (row >= last) {
+                return hi - 1;
+            }
+            size_t guess = lo + (row - starts[lo]) * (hi - 1 - lo) / (last - starts[lo]);
+            if (starts[guess] > row) {
+                hi = guess;
+            } else if (starts[guess + 1] > row) {
+                return guess;
+            } else {
+                lo = guess + 1;
+            }
+        }
+        return std::upper_bound(starts.begin() + lo, starts.begin() + hi, row) - starts.begin() - 1;
+    }
+
+    /** Finds the item of the given segment holding the given row. */
+    size_t item_of_(size_t segment, size_t row) {
+        return row - table_->starts_[segment] + table_->bases_[segment];
+    }
+
+    /** Where the rows of the column held by the given segment end. */
+    size_t segment_end_(size_t i) {
+        return i + 1 < table_->starts_.size() ? table_->starts_[i + 1] : offset_ + size_;
+    }
+
+    /** Checks whether the last segment can take no more values. */
+    bool tail_full_() {
+        return item_of_(table_->starts_.size() - 1, offset_ + size_) == segment_capacity_;
     }
 
     virtual void expand_() {
-        char buffer[15];
-        snprintf(buffer, 15, "%s_%zu", col_id_->c_str(), segments_.size());
-        Key new_k(buffer, curr_node_);
-        segments_.push_back(new_k);
-        curr_node_ = (curr_node_ + 1) % store_->num_nodes();
+        SegmentTable& t = own_table_();
+        String* name = StrBuff().c(*col_id_).c("_").c(t.keys_.size()).get();
+        t.keys_.push_back(Key(name->c_str(), curr_node_));
+        t.starts_.push_back(offset_ + size_);
+        t.bases_.push_back(0);
+        if (!local_) {
+            curr_node_ = (curr_node_ + 1) % store_->num_nodes();
+        }
+        delete name;
     }
 
     virtual void put_in_store_() {
         Serializer s;
         cache_->serialize(&s);
         Value* v = new Value(s.get_bytes(), s.size());
-        store_->put(segments_.back(), v);
+        store_->put(table_->keys_.back(), v);
+    }
+
+    /** Reads a serialized segment of the column's type. */
+    virtual Array* read_array_(Deserializer* d) {
+        assert(false);
+        return nullptr;
+    }
+
+    /**
+     * Loads the segment at the given index into the cache, unless it is there
+     * already. Waits for segments still on their way to their node.
+     */
+    void cache_segment_(size_t segment_index) {
+        Key& k = table_->keys_[segment_index];
+        if (k != cache_key_) {
+            Value* v = store_->waitAndGet(k);
+            // the frame was removed while it was read, see KDStore::remove
+            assert(v != nullptr);
+            Deserializer d(v->get_bytes(), v->size());
+            delete cache_;
+            cache_ = read_array_(&d);
+            cache_key_ = k;
+            delete v;
+        }
     }
 };
 
@@ -227,6 +495,10 @@ class IntColumn : public Column {
         cache_ = new IntArray(segment_capacity_);
     }
 
+    IntColumn(IntColumn& from) : Column(from) {
+        cache_ = new IntArray((size_t)0);
+    }
+
     virtual ~IntColumn() {}
 
     void expand_() {
@@ -242,7 +514,7 @@ class IntColumn : public Column {
      */
     void push_back(int val) {
         assert(!finalized_);
-        if (size_ == segments_.size() * segment_capacity_) {
+        if (tail_full_()) {
             put_in_store_();
             expand_();
         }
@@ -259,20 +531,16 @@ class IntColumn : public Column {
     int get(size_t idx) {
         assert(idx < size());
         assert(finalized_);
-        size_t segment_index = idx / segment_capacity_;
-        size_t index_in_seg = idx % segment_capacity_;
-        Key& k = segments_[segment_index];
-        if (!k.equals(&cache_key_)) {
-            delete cache_;
-            Value* v = store_->get(k);
-            Deserializer d(v->get_bytes(), v->size());
-            cache_ = new IntArray(&d);
-            cache_key_ = k;
-            delete v;
-        }
+        size_t segment_index = segment_of_(offset_ + idx);
+        size_t index_in_seg = item_of_(segment_index, offset_ + idx);
+        cache_segment_(segment_index);
         return cache_->get_int(index_in_seg);
     }
 
+    Array* read_array_(Deserializer* d) {
+        return new IntArray(d);
+    }
+
     IntColumn* as_int() {
         return this;
     }
@@ -307,6 +575,10 @@ class BoolColumn : public Column {
         cache_ = new BoolArray(segment_capacity_);
     }
 
+    BoolColumn(BoolColumn& from) : Column(from) {
+        cache_ = new BoolArray((size_t)0);
+    }
+
     virtual ~BoolColumn() {}
 
     void expand_() {
@@ -322,7 +594,7 @@ class BoolColumn : public Column {
      */
     void push_back(bool val) {
         assert(!finalized_);
-        if (size_ == segments_.size() * segment_capacity_) {
+        if (tail_full_()) {
             put_in_store_();
             expand_();
         }
@@ -339,20 +611,16 @@ class BoolColumn : public Column {
     bool get(size_t idx) {
         assert(idx < size());
         assert(finalized_);
-        size_t segment_index = idx / segment_capacity_;
-        int index_in_seg = idx % segment_capacity_;
-        Key& k = segments_[segment_index];
-        if (!k.equals(&cache_key_)) {
-            delete cache_;
-            Value* v = store_->get(k);
-            Deserializer d(v->get_bytes(), v->size());
-            cache_ = new BoolArray(&d);
-            cache_key_ = k;
-            delete v;
-        }
+        size_t segment_index = segment_of_(offset_ + idx);
+        size_t index_in_seg = item_of_(segment_index, offset_ + idx);
+        cache_segment_(segment_index);
         return cache_->get_bool(index_in_seg);
     }
 
+    Array* read_array_(Deserializer* d) {
+        return new BoolArray(d);
+    }
+
     BoolColumn* as_bool() {
         return this;
     }
@@ -387,6 +655,10 @@ class DoubleColumn : public Column {
         cache_ = new DoubleArray(segment_capacity_);
     }
 
+    DoubleColumn(DoubleColumn& from) : Column(from) {
+        cache_ = new DoubleArray((size_t)0);
+    }
+
     virtual ~DoubleColumn() {}
 
     void expand_() {
@@ -402,7 +674,7 @@ class DoubleColumn : public Column {
      */
     void push_back(double val) {
         assert(!finalized_);
-        if (size_ == segments_.size() * segment_capacity_) {
+        if (tail_full_()) {
             put_in_store_();
             expand_();
         }
@@ -419,20 +691,16 @@ class DoubleColumn : public Column {
     double get(size_t idx) {
         assert(idx < size());
         assert(finalized_);
-        size_t segment_index = idx / segment_capacity_;
-        int index_in_seg = idx % segment_capacity_;
-        Key& k = segments_[segment_index];
-        if (!k.equals(&cache_key_)) {
-            delete cache_;
-            Value* v = store_->get(k);
-            Deserializer d(v->get_bytes(), v->size());
-            cache_ = new DoubleArray(&d);
-            cache_key_ = k;
-            delete v;
-        }
+        size_t segment_index = segment_of_(offset_ + idx);
+        size_t index_in_seg = item_of_(segment_index, offset_ + idx);
+        cache_segment_(segment_index);
         return cache_->get_double(index_in_seg);
     }
 
+    Array* read_array_(Deserializer* d) {
+        return new DoubleArray(d);
+    }
+
     DoubleColumn* as_double() {
         return this;
     }
@@ -474,6 +742,10 @@ class StringColumn : public Column {
         cache_ = new StringArray(segment_capacity_);
     }
 
+    StringColumn(StringColumn& from) : Column(from) {
+        cache_ = new StringArray((size_t)0);
+    }
+
     virtual ~StringColumn() {}
 
     void expand_() {
@@ -489,7 +761,7 @@ class StringColumn : public Column {
      */
     void push_back(String* val) {
         assert(!finalized_);
-        if (size_ == segments_.size() * segment_capacity_) {
+        if (tail_full_()) {
             put_in_store_();
             expand_();
         }
@@ -506,20 +778,16 @@ class StringColumn : public Column {
     String* get(size_t idx) {
         assert(idx < size());
         assert(finalized_);
-        size_t segment_index = idx / segment_capacity_;
-        int index_in_seg = idx % segment_capacity_;
-        Key& k = segments_[segment_index];
-        if (!k.equals(&cache_key_)) {
-            delete cache_;
-            Value* v = store_->get(k);
-            Deserializer d(v->get_bytes(), v->size());
-            cache_ = new StringArray(&d);
-            cache_key_ = k;
-            delete v;
-        }
+        size_t segment_index = segment_of_(offset_ + idx);
+        size_t index_in_seg = item_of_(segment_index, offset_ + idx);
+        cache_segment_(segment_index);
         return cache_->get_string(index_in_seg)->clone();
     }
 
+    Array* read_array_(Deserializer* d) {
+        return new StringArray(d);
+    }
+
     StringColumn* as_string() {
         return this;
     }
@@ -2,12 +2,15 @@
 #include <assert.h>
 #include <vector>
 #include "column.h"
+#include "partitions.h"
+#include "rowsource.h"
 #include "schema.h"
 #include "store/key.h"
 #include "visitor.h"
 #include "row.h"
 
 class KDStore;
+class GroupBy;
 
 /****************************************************************************
  * DataFrame::
@@ -17,22 +20,24 @@ class KDStore;
  * describes it.
  * Author: gomes.chri, modi.an
  */
-class DataFrame : public Object {
+class DataFrame : public RowSource {
    public:
     std::vector<Column*> columns_;
     Schema* df_schema_;
     KVStore* store_;
+    RangePartitions* partitions_;  // owned; set if the rows are range partitioned
 
     /**
      * Creates a data frame from a given set of columns.
      * Data frame takes ownership of the given columns.
      */
-    DataFrame(std::vector<Column*> columns, KVStore* store) : Object() {
+    DataFrame(std::vector<Column*> columns, KVStore* store) : RowSource() {
         size_t length = columns[0]->size();
         for (size_t i = 1; i < columns.size(); i++) {
             assert(columns[i]->size() == length);
         }
         store_ = store;
+        partitions_ = nullptr;
         df_schema_ = new Schema();
         df_schema_->add_rows(length);
         columns_ = std::vector<Column*>();
@@ -45,9 +50,10 @@ class DataFrame : public Object {
      * Creates a data frame from a column.
      * Data frame takes ownership of the column.
      */
-    DataFrame(Column* c, KVStore* store) : Object() {
+    DataFrame(Column* c, KVStore* store) : RowSource() {
         assert(c != nullptr && store != nullptr);
         store_ = store;
+        partitions_ = nullptr;
         df_schema_ = new Schema();
         df_schema_->add_rows(c->size());
         add_column_(c);
@@ -56,7 +62,7 @@ class DataFrame : public Object {
     /**
      * Creates a data frame from the given deserializer.
      */
-    DataFrame(Deserializer* d, KVStore* store) : Object() {
+    DataFrame(Deserializer* d, KVStore* store) : RowSource() {
         df_schema_ = new Schema(d);
         store_ = store;
         for (size_t i = 0; i < df_schema_->width(); i++) {
@@ -77,6 +83,38 @@ class DataFrame : public Object {
                     assert(false);
             }
         }
+        partitions_ = d->get_bool() ? new RangePartitions(d) : nullptr;
+    }
+
+    /**
+     * Creates a data frame that reads the same stored segments as another.
+     * Only the metadata is copied.
+     */
+    DataFrame(DataFrame& from) : RowSource() {
+        df_schema_ = new Schema(*from.df_schema_);
+        store_ = from.store_;
+        for (size_t i = 0; i < from.columns_.size(); i++) {
+            columns_.push_back(copy_column_(from.columns_[i]));
+        }
+        RangePartitions* parts = from.partitions_;
+        partitions_ = parts == nullptr ? nullptr : new RangePartitions(*parts);
+    }
+
+    /** Copies the metadata of a finalized column, see Column(Column&). */
+    static Column* copy_column_(Column* c) {
+        switch (c->get_type()) {
+            case 'S':
+                return new StringColumn(*c->as_string());
+            case 'I':
+                return new IntColumn(*c->as_int());
+            case 'B':
+                return new BoolColumn(*c->as_bool());
+            case 'D':
+                return new DoubleColumn(*c->as_double());
+            default:
+                assert(false);
+                return nullptr;
+        }
     }
 
     virtual ~DataFrame() {
@@ -84,11 +122,12 @@ class DataFrame : public Object {
             delete columns_[i];
         }
         delete df_schema_;
+        delete partitions_;
     }
 
     /** Returns the dataframe's schema. Modifying the schema after a dataframe
      * has been created in undefined. */
-    Schema& get_schema() {
+    Schema& get_schema() override {
         return *df_schema_;
     }
 
@@ -148,7 +187,7 @@ class DataFrame : public Object {
     }
 
     /** The number of rows in the dataframe. */
-    size_t nrows() {
+    size_t nrows() override {
         return df_schema_->length();
     }
 
@@ -162,11 +201,115 @@ class DataFrame : public Object {
         return df_schema_->col_type(col_idx);
     }
 
+    /**
+     * Gets how the rows are range partitioned, or nullptr if they are not.
+     * Owned by the data frame.
+     */
+    RangePartitions* partitions() {
+        return partitions_;
+    }
+
+    /**
+     * Records how the rows are range partitioned. Takes ownership. Must be
+     * called before the data frame is stored for it to be stored as well.
+     */
+    void set_partitions(RangePartitions* p) {
+        delete partitions_;
+        partitions_ = p;
+    }
+
+    /**
+     * Makes a view of the rows from begin to end. The view reads the stored
+     * segments of this frame: no values are copied or stored, and storing
+     * the view only stores its metadata. Removing the view from a store
+     * leaves the segments to this frame. The range partitions are dropped.
+     * @arg begin  the first row of the view
+     * @arg end  the row after the last one of the view
+     * @return the view, owned by the caller
+     */
+    DataFrame* slice(size_t begin, size_t end) {
+        assert(begin <= end && end <= nrows());
+        std::vector<Column*> cols;
+        for (size_t i = 0; i < columns_.size(); i++) {
+            cols.push_back(copy_column_(columns_[i]));
+            cols.back()->narrow(begin, end);
+            cols.back()->disown();
+        }
+        return new DataFrame(cols, store_);
+    }
+
+    /**
+     * Makes a view of the given columns, in the given order. Like slice(), it
+     * copies and stores no values. The range partitions are dropped.
+     * @arg cols  the indices of the columns
+     * @return the view, owned by the caller
+     */
+    DataFrame* select(std::vector<size_t> cols) {
+        assert(!cols.empty());
+        std::vector<Column*> picked;
+        for (size_t c : cols) {
+            assert(c < columns_.size());
+            picked.push_back(copy_column_(columns_[c]));
+            picked.back()->disown();
+        }
+        return new DataFrame(picked, store_);
+    }
+
+    /**
+     * Makes a frame of the rows of this frame followed by those of another
+     * with the same column types. Like slice(), it copies and stores no
+     * values: the result reads the segments of both frames, which may be
+     * views. The range partitions are dropped.
+     * @arg other  the frame whose rows follow
+     * @return the frame, owned by the caller
+     */
+    DataFrame* concat(DataFrame& other) {
+        assert(other.ncols() == ncols());
+        std::vector<Column*> cols;
+        for (size_t i = 0; i < columns_.size(); i++) {
+            assert(other.col_type(i) == col_type(i));
+            cols.push_back(copy_column_(columns_[i]));
+            cols.back()->concat(*other.columns_[i]);
+            cols.back()->disown();
+        }
+        return new DataFrame(cols, store_);
+    }
+
+    /**
+     * Appends the rows a writer produces. Full segments are stored as they
+     * fill up and the rest when the writer is done. Stored segments are not
+     * changed, so frames read from the store before keep their rows; store
+     * the frame again to publish the new ones (see KDStore::append). The
+     * range partitions are dropped, since the new rows do not follow them.
+     * @arg v  the writer
+     */
+    void append(Writer& v) {
+        for (size_t i = 0; i < columns_.size(); i++) {
+            columns_[i]->reopen();
+        }
+        Row r(*df_schema_);
+        size_t added = 0;
+        while (!v.done()) {
+            v.visit(r);
+            r.add_to_columns(columns_);
+            added++;
+        }
+        for (size_t i = 0; i < columns_.size(); i++) {
+            columns_[i]->finalize();
+        }
+        df_schema_->add_rows(added);
+        set_partitions(nullptr);
+    }
+
     void serialize(Serializer* s) {
         df_schema_->serialize(s);
         for (size_t i = 0; i < columns_.size(); i++) {
             columns_[i]->serialize(s);
         }
+        s->add_bool(partitions_ != nullptr);
+        if (partitions_ != nullptr) {
+            partitions_->serialize(s);
+        }
     }
 
     /**
@@ -174,7 +317,7 @@ class DataFrame : public Object {
      * @arg v  the reader to use
      * @arg node  the node index
      */
-    void local_map(Reader& v) {
+    void local_map(Reader& v) override {
         Row r(*df_schema_);
         std::vector<size_t> indices = columns_[0]->local_indices();
         for (size_t i = 0; i < indices.size(); i++) {
@@ -195,6 +338,16 @@ class DataFrame : public Object {
             v.visit(r);
         }
     }
+
+    /**
+     * Maps several readers over the rows of the data frame in one pass, see
+     * RowSource::local_map_all.
+     * @arg readers  the readers, external
+     */
+    void map_all(std::vector<Reader*> readers) {
+        ReaderGroup group(readers);
+        map(group);
+    }
     
     /** Adds a column this dataframe, updates the schema, the new column
      * is external, and appears as the last column of the dataframe.
@@ -207,6 +360,37 @@ class DataFrame : public Object {
         columns_.push_back(col);
     }
 
+    /**
+     * Groups the rows of the data frame by the given columns. The grouping is
+     * aggregated with GroupBy::agg (see groupby.h).
+     * @arg key_cols  the indices of the key columns
+     */
+    GroupBy group_by(std::vector<size_t> key_cols);
+
+    /**
+     * Inner joins this frame with another on one column of each and stores
+     * the result, every column of this frame followed by every column of the
+     * other. Collective, see join.h.
+     * @arg k  the key to store the result at
+     * @arg kd  the store
+     * @arg other  the right frame
+     * @arg left_key  the key column of this frame
+     * @arg right_key  the key column of the other frame
+     * @return the result frame
+     */
+    DataFrame* join(Key* k, KDStore* kd, DataFrame* other, size_t left_key, size_t right_key);
+
+    /**
+     * Sorts the rows by the given columns, in ascending order, and stores the
+     * result. The result records its range partitions. Collective, see
+     * sort.h.
+     * @arg k  the key to store the result at
+     * @arg kd  the store
+     * @arg cols  the indices of the sort columns, most significant first
+     * @return the result frame
+     */
+    DataFrame* sort_by(Key* k, KDStore* kd, std::vector<size_t> cols);
+
     static DataFrame* fromArray(Key* k, KDStore* kd, size_t size, double* vals);
     static DataFrame* fromArray(Key* k, KDStore* kd, size_t size, int* vals);
     static DataFrame* fromArray(Key* k, KDStore* kd, size_t size, bool* vals);
@@ -220,4 +404,6 @@ class DataFrame : public Object {
     static DataFrame* fromSorFile(Key* k, KDStore* kd, const char* file_name);
 
     static DataFrame* fromVisitor(Key* k, KDStore* kd, const char* types, Writer& v);
+    static DataFrame* fromVisitor(KVStore* kv, const char* types, Writer& v, bool local = false);
+    static DataFrame* fromDistributedVisitor(Key* k, KDStore* kd, const char* types, Writer& v);
 };
@@ -0,0 +1,471 @@
+#pragma once
+#include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "row.h"
+#include "rowsource.h"
+#include "store/bitmaps.h"
+#include "store/exchange.h"
+#include "store/kvstore.h"
+#include "util/bitmap.h"
+#include "util/serial.h"
+#include "util/string.h"
+#include "util/thread.h"
+#include "visitor.h"
+
+static const size_t GRAPH_WORKERS = 4;
+static const size_t GRAPH_PULL_RATIO = 14;  // pull once the frontier has this share of the
+                                            // unexplored edges (Beamer et al.)
+static const double PAGERANK_DAMPING = 0.85;
+
+/**
+ * Where one end of the edges of a Graph comes from: the int column holding
+ * it, and the vertices its values are numbered as. A value v becomes
+ * vertex base_ + v. Values of count_ or more are dropped, with their edge,
+ * or, if others_ is set, all become the one vertex base_ + count_.
+ */
+struct EdgeEnd {
+    size_t col_;
+    size_t base_;
+    size_t count_;
+    bool others_;
+
+    /** The vertex a value becomes, or SIZE_MAX if its edge is dropped. */
+    size_t vertex(size_t val) const {
+        if (val < count_) {
+            return base_ + val;
+        }
+        return others_ ? base_ + count_ : SIZE_MAX;
+    }
+
+    /** The vertex after the last one a value can become. */
+    size_t end() const {
+        return base_ + count_ + others_;
+    }
+};
+
+/**
+ * Collects the edges of the rows it visits, as (from, to) vertex pairs.
+ */
+class EdgeCollector : public Reader {
+   public:
+    EdgeEnd from_;
+    EdgeEnd to_;
+    std::vector<std::pair<uint32_t, uint32_t>> edges_;
+
+    EdgeCollector(EdgeEnd from, EdgeEnd to) : Reader(), from_(from), to_(to) {}
+
+    void visit(Row& r) override {
+        size_t from = from_.vertex((unsigned)r.get_int(from_.col_));
+        size_t to = to_.vertex((unsigned)r.get_int(to_.col_));
+        if (from != SIZE_MAX && to != SIZE_MAX) {
+            edges_.push_back(std::make_pair(from, to));
+        }
+    }
+};
+
+/**
+ * Runs one share of a parallel loop on its own thread.
+ */
+class GraphWorker : public Thread {
+   public:
+    std::function<void(size_t)> body_;
+    size_t id_;
+
+    GraphWorker(std::function<void(size_t)> body, size_t id) : Thread(), body_(body), id_(id) {}
+
+    void run() override {
+        body_(id_);
+    }
+};
+
+/**
+ * A graph whose edges are the rows of a RowSource. Every node keeps the
+ * edges it holds as compressed sparse rows, both ways, so algorithms only
+ * touch the edges of the vertices they work on rather than scanning the
+ * rows again. Per vertex values (frontiers, labels, ranks) are the same on
+ * every node; each node works out its edges' share of a step with a few
+ * worker threads and the shares are merged across nodes. Building the graph
+ * and running an algorithm on it are collective operations.
+ * Author: gomes.chri, modi.an
+ */
+class Graph : public Object {
+   public:
+    KVStore* kv_;
+    String* name_;
+    size_t ops_;  // collective operations run so far, to name their exchanges
+    size_t n_;
+    size_t workers_;
+    std::vector<size_t> out_starts_;  // out_ from out_starts_[v] holds the targets of v
+    std::vector<uint32_t> out_;
+    std::vector<size_t> in_starts_;  // in_ from in_starts_[v] holds the sources of v
+    std::vector<uint32_t> in_;
+
+    /**
+     * Builds the graph of the edges held by this node. No edge leaves the
+     * node.
+     * @arg kv  the store
+     * @arg name  the name of the exchanges of the graph, which must not be
+     *   reused
+     * @arg edges  the rows holding the edges, external
+     * @arg from  where the sources of the edges come from
+     * @arg to  where the targets of the edges come from
+     * @arg workers  how many threads work on a step on each node
+     */
+    Graph(KVStore* kv, const char* name, RowSource* edges, EdgeEnd from, EdgeEnd to,
+          size_t workers = GRAPH_WORKERS)
+        : Object(), kv_(kv), ops_(0), workers_(workers) {
+        assert(workers > 0);
+        assert(edges->get_schema().col_type(from.col_) == 'I');
+        assert(edges->get_schema().col_type(to.col_) == 'I');
+        name_ = new String(name);
+        n_ = std::max(from.end(), to.end());
+        EdgeCollector collector(from, to);
+        edges->local_map(collector);
+        build_(collector.edges_, false, out_starts_, out_);
+        build_(collector.edges_, true, in_starts_, in_);
+    }
+
+    virtual ~Graph() {
+        delete name_;
+    }
+
+    /** The number of vertices. */
+    size_t nvertices() {
+        return n_;
+    }
+
+    /** The number of edges held by this node. */
+    size_t local_edges() {
+        return out_.size();
+    }
+
+    /**
+     * Takes one step of a breadth first search. The frontier becomes the
+     * vertices next to it that were not visited yet, which are then marked
+     * visited. Each node pushes out of the frontier while it is small, and
+     * pulls into the unvisited vertices once its edges make up a large
+     * enough share of the unexplored ones.
+     * @arg frontier  the vertices reached last
+     * @arg visited  the vertices reached so far
+     * @arg directed  whether to follow edges only from source to target
+     */
+    void bfs_step(Bitmap& frontier, Bitmap& visited, bool directed = false) {
+        size_t frontier_edges = 0;
+        for (uint32_t v : frontier.values()) {
+            frontier_edges += degree_(v, directed);
+        }
+        size_t unexplored = directed ? out_.size() : out_.size() + in_.size();
+        for (uint32_t v : visited.values()) {
+            unexplored -= degree_(v, directed);
+        }
+        Bitmap next;
+        if (frontier_edges * GRAPH_PULL_RATIO > unexplored) {
+            next = pull_(frontier, visited, directed);
+        } else {
+            next = push_(frontier, visited, directed);
+        }
+        String* name = next_name_();
+        union_all(kv_, name->c_str(), next);
+        delete name;
+        visited.union_with(next);
+        frontier.containers_.swap(next.containers_);
+    }
+
+    /**
+     * Finds how many steps away from a vertex every vertex is.
+     * @arg source  the vertex to start from
+     * @arg directed  whether to follow edges only from source to target
+     * @return the distance of every vertex, or -1 for those not reached
+     */
+    std::vector<int> bfs(uint32_t source, bool directed = false) {
+        assert(source < n_);
+        std::vector<int> dist(n_, -1);
+        Bitmap frontier;
+        frontier.add(source);
+        Bitmap visited = frontier;
+        dist[source] = 0;
+        for (int level = 1; frontier.cardinality() > 0; level++) {
+            bfs_step(frontier, visited, directed);
+            for (uint32_t v : frontier.values()) {
+                dist[v] = level;
+            }
+        }
+        return dist;
+    }
+
+    /**
+     * Labels every vertex with the smallest vertex connected to it, ignoring
+     * the direction of the edges. Labels spread from the vertices whose
+     * label changed in the last round only, and only the changes are sent
+     * between nodes.
+     * @return the label of every vertex
+     */
+    std::vector<uint32_t> components() {
+        std::vector<uint32_t> labels(n_);
+        Bitmap active;
+        for (size_t v = 0; v < n_; v++) {
+            labels[v] = v;
+            active.add(v);
+        }
+        while (active.cardinality() > 0) {
+            // lower the labels of the neighbours of the active vertices
+            std::unordered_map<uint32_t, uint32_t> lowered;
+            for (uint32_t v : active.values()) {
+                uint32_t label = labels[v];
+                for (int dir = 0; dir < 2; dir++) {
+                    std::vector<size_t>& starts = dir == 0 ? out_starts_ : in_starts_;
+                    std::vector<uint32_t>& adj = dir == 0 ? out_ : in_;
+                    for (size_t e = starts[v]; e < starts[v + 1]; e++) {
+                        uint32_t w = adj[e];
+                        if (label < labels[w]) {
+                            std::unordered_map<uint32_t, uint32_t>::iterator it = lowered.find(w);
+                            if (it == lowered.end()) {
+                                lowered[w] = label;
+                            } else if (label < it->second) {
+                                it->second = label;
+                            }
+                        }
+                    }
+                }
+            }
+            // every node applies the changes of every node
+            Serializer s;
+            s.add_size_t(lowered.size());
+            for (std::pair<const uint32_t, uint32_t>& change : lowered) {
+                s.add_uint32_t(change.first);
+                s.add_uint32_t(change.second);
+            }
+            Bitmap changed;
+            String* name = next_name_();
+            Exchange ex(kv_, name->c_str());
+            delete name;
+            for (size_t n = 0; n < kv_->num_nodes(); n++) {
+                ex.send(n, s);
+            }
+            for (size_t n = 0; n < kv_->num_nodes(); n++) {
+                Value* v = ex.receive(n);
+                Deserializer d(v->get_bytes(), v->size());
+                size_t count = d.get_size_t();
+                for (size_t i = 0; i < count; i++) {
+                    uint32_t w = d.get_uint32_t();
+                    uint32_t label = d.get_uint32_t();
+                    if (label < labels[w]) {
+                        labels[w] = label;
+                        changed.add(w);
+                    }
+                }
+                delete v;
+            }
+            active.containers_.swap(changed.containers_);
+        }
+        return labels;
+    }
+
+    /**
+     * Ranks the vertices by PageRank, following edges from source to target.
+     * The rank of vertices without edges out is spread over every vertex.
+     * @arg iterations  how many rounds to run
+     * @return the rank of every vertex, adding up to 1
+     */
+    std::vector<double> pagerank(size_t iterations) {
+        std::vector<double> out_degree(n_);
+        for (size_t v = 0; v < n_; v++) {
+            out_degree[v] = out_starts_[v + 1] - out_starts_[v];
+        }
+        sum_all_(out_degree);
+        std::vector<double> rank(n_, 1.0 / n_);
+        for (size_t i = 0; i < iterations; i++) {
+            double dangling = 0;
+            for (size_t v = 0; v < n_; v++) {
+                if (out_degree[v] == 0) {
+                    dangling += rank[v];
+                }
+            }
+            // pull the rank of the sources of the local edges into each target
+            std::vector<double> incoming(n_, 0.0);
+            run_workers_(n_, [&](size_t w, size_t begin, size_t end) {
+                for (size_t v = begin; v < end; v++) {
+                    double sum = 0;
+                    for (size_t e = in_starts_[v]; e < in_starts_[v + 1]; e++) {
+                        sum += rank[in_[e]] / out_degree[in_[e]];
+                    }
+                    incoming[v] = sum;
+                }
+            });
+            sum_all_(incoming);
+            for (size_t v = 0; v < n_; v++) {
+                rank[v] = (1 - PAGERANK_DAMPING) / n_ +
+                          PAGERANK_DAMPING * (incoming[v] + dangling / n_);
+            }
+        }
+        return rank;
+    }
+
+    /**
+     * Lays the edges out as compressed sparse rows, by source or, if
+     * reverse is set, by target.
+     */
+    void build_(std::vector<std::pair<uint32_t, uint32_t>>& edges, bool reverse,
+                std::vector<size_t>& starts, std::vector<uint32_t>& adj) {
+        starts.assign(n_ + 1, 0);
+        for (std::pair<uint32_t, uint32_t>& e : edges) {
+            starts[(reverse ? e.second : e.first) + 1]++;
+        }
+        for (size_t v = 0; v < n_; v++) {
+            starts[v + 1] += starts[v];
+        }
+        std::vector<size_t> next(starts.begin(), starts.end() - 1);
+        adj.resize(edges.size());
+        for (std::pair<uint32_t, uint32_t>& e : edges) {
+            adj[next[reverse ? e.second : e.first]++] = reverse ? e.first : e.second;
+        }
+    }
+
+    /** The number of local edges of a vertex, out only if directed. */
+    size_t degree_(uint32_t v, bool directed) {
+        size_t result = out_starts_[v + 1] - out_starts_[v];
+        if (!directed) {
+            result += in_starts_[v + 1] - in_starts_[v];
+        }
+        return result;
+    }
+
+    /**
+     * Splits the indices below count into a range per worker and runs the
+     * body on each, one range on the calling thread. The body gets the
+     * number of the worker and its range.
+     */
+    void run_workers_(size_t count, std::function<void(size_t, size_t, size_t)> body) {
+        size_t share = (count + workers_ - 1) / workers_;
+        std::function<void(size_t)> range = [&](size_t w) {
+            body(w, std::min(count, w * share), std::min(count, (w + 1) * share));
+        };
+        std::vector<GraphWorker*> threads;
+        for (size_t w = 1; w < workers_ && w * share < count; w++) {
+            threads.push_back(new GraphWorker(range, w));
+            threads.back()->start();
+        }
+        range(0);
+        for (GraphWorker* t : threads) {
+            t->join();
+            delete t;
+        }
+    }
+
+    /** The unvisited vertices next to the frontier, found from the frontier. */
+    Bitmap push_(Bitmap& frontier, Bitmap& visited, bool directed) {
+        std::vector<uint32_t> from = frontier.values();
+        std::vector<Bitmap> found(workers_);
+        run_workers_(from.size(), [&](size_t w, size_t begin, size_t end) {
+            Bitmap& mine = found[w];
+            for (size_t i = begin; i < end; i++) {
+                uint32_t v = from[i];
+                for (size_t e = out_starts_[v]; e < out_starts_[v + 1]; e++) {
+                    if (!visited.contains(out_[e])) mine.add(out_[e]);
+                }
+                if (directed) continue;
+                for (size_t e = in_starts_[v]; e < in_starts_[v + 1]; e++) {
+                    if (!visited.contains(in_[e])) mine.add(in_[e]);
+                }
+            }
+        });
+        return merge_(found);
+    }
+
+    /**
+     * The unvisited vertices next to the frontier, found by looking for the
+     * frontier next to every unvisited vertex.
+     */
+    Bitmap pull_(Bitmap& frontier, Bitmap& visited, bool directed) {
+        std::vector<Bitmap> found(workers_);
+        run_workers_(n_, [&](size_t w, size_t begin, size_t end) {
+            Bitmap& mine = found[w];
+            for (size_t v = begin; v < end; v++) {
+                if (visited.contains(v)) continue;
+                bool next = false;
+                for (size_t e = in_starts_[v]; e < in_starts_[v + 1] && !next; e++) {
+                    next = frontier.contains(in_[e]);
+                }
+                for (size_t e = out_starts_[v]; !directed && e < out_starts_[v + 1] && !next;
+                     e++) {
+                    next = frontier.contains(out_[e]);
+                }
+                if (next) mine.add(v);
+            }
+        });
+        return merge_(found);
+    }
+
+    /** The union of the bitmaps found by the workers. */
+    Bitmap merge_(std::vector<Bitmap>& found) {
+        Bitmap result;
+        for (Bitmap& b : found) {
+            result.union_with(b);
+        }
+        return result;
+    }
+
+    /**
+     * Adds up a vector of values across nodes, up a binomial tree rooted at
+     * node 0 and back down, as union_all does for bitmaps.
+     */
+    void sum_all_(std::vector<double>& vals) {
+        size_t nodes = kv_->num_nodes();
+        size_t me = kv_->this_node();
+        if (nodes == 1) {
+            return;
+        }
+        String* name = next_name_();
+        Exchange ex(kv_, name->c_str());
+        delete name;
+        size_t bytes = vals.size() * sizeof(double);
+        size_t step = 1;
+        for (; step < nodes; step <<= 1) {
+            if (me & step) {
+                Serializer s;
+                s.add_size_t(vals.size());
+                s.add_buffer(vals.data(), bytes);
+                ex.send(me - step, s);
+                Value* v = ex.receive(me - step);
+                Deserializer d(v->get_bytes(), v->size());
+                size_t count = d.get_size_t();
+                assert(count == vals.size());
+                d.get_buffer(bytes, (char*)vals.data());
+                delete v;
+                break;
+            }
+            if (me + step < nodes) {
+                Value* v = ex.receive(me + step);
+                Deserializer d(v->get_bytes(), v->size());
+                size_t count = d.get_size_t();
+                assert(count == vals.size());
+                std::vector<double> theirs(vals.size());
+                d.get_buffer(bytes, (char*)theirs.data());
+                for (size_t i = 0; i < vals.size(); i++) {
+                    vals[i] += theirs[i];
+                }
+                delete v;
+            }
+        }
+        Serializer s;
+        s.add_size_t(vals.size());
+        s.add_buffer(vals.data(), bytes);
+        for (step >>= 1; step > 0; step >>= 1) {
+            if (me + step < nodes) {
+                ex.send(me + step, s);
+            }
+        }
+    }
+
+    /** Names the exchange of the next collective operation. */
+    String* next_name_() {
+        return StrBuff().c(*name_).c("~g").c(ops_++).get();
+    }
+};
@@ -0,0 +1,417 @@
+#pragma once
+#include <assert.h>
+
+#include <string>
+#include <vector>
+
+#include "dataframe.h"
+#include "row.h"
+#include "rowbatch.h"
+#include "rowsource.h"
+#include "store/exchange.h"
+#include "store/kdstore.h"
+#include "util/hashtable.h"
+#include "visitor.h"
+
+/**
+ * The aggregate functions supported by GroupBy.
+ */
+enum class AggType { COUNT, SUM, MIN, MAX, MEAN };
+
+/**
+ * An aggregate function applied to one column of every group.
+ * COUNT ignores the column and produces an 'I' column. SUM, MIN and MAX
+ * require an 'I' or 'D' column and produce a column of the same type.
+ * MEAN requires an 'I' or 'D' column and produces a 'D' column.
+ * Author: gomes.chri, modi.an
+ */
+class Aggregate : public Object {
+   public:
+    AggType type_;
+    size_t col_;
+
+    Aggregate(AggType type, size_t col) : Object() {
+        type_ = type;
+        col_ = col;
+    }
+
+    Aggregate(AggType type) : Aggregate(type, 0) {}
+
+    Aggregate(const Aggregate& other) : Aggregate(other.type_, other.col_) {}
+
+    /**
+     * Gets the type of the output column.
+     * @arg src  the type of the aggregated column
+     * @return the output type
+     */
+    char out_type(char src) {
+        switch (type_) {
+            case AggType::COUNT:
+                return 'I';
+            case AggType::MEAN:
+                assert(src == 'I' || src == 'D');
+                return 'D';
+            default:
+                assert(src == 'I' || src == 'D');
+                return src;
+        }
+    }
+};
+
+/**
+ * Running state of one aggregate for one group. Plain data so groups can
+ * be kept in one flat vector.
+ */
+class AggSlot {
+   public:
+    size_t count_;
+    long long int_;
+    double double_;
+};
+
+/**
+ * Aggregated groups keyed by the encoded values of the key columns.
+ * Author: gomes.chri, modi.an
+ */
+class GroupTable : public Object {
+   public:
+    HashTable table_;
+    std::vector<Aggregate> aggs_;
+    std::vector<char> src_types_;  // type of the column each aggregate reads
+    std::vector<AggSlot> slots_;   // aggs_.size() slots per group
+
+    GroupTable(std::vector<Aggregate>& aggs, Schema& s) : Object(), table_(), aggs_(aggs) {
+        for (Aggregate& a : aggs_) {
+            src_types_.push_back(a.type_ == AggType::COUNT ? 'I' : s.col_type(a.col_));
+            a.out_type(src_types_.back());  // checks the column type
+        }
+    }
+
+    virtual ~GroupTable() {}
+
+    /** The number of groups. */
+    size_t size() {
+        return table_.size();
+    }
+
+    /**
+     * Finds the group for the encoded key, creating it if needed.
+     * @return the group number
+     */
+    size_t group(const char* key, size_t len) {
+        size_t before = table_.size();
+        size_t g = table_.insert(key, len);
+        if (table_.size() != before) {
+            AggSlot empty = {0, 0, 0.0};
+            slots_.resize(slots_.size() + aggs_.size(), empty);
+        }
+        return g;
+    }
+
+    /**
+     * Folds a row into the given group.
+     */
+    void update(size_t g, Row& r) {
+        AggSlot* slots = &slots_[g * aggs_.size()];
+        for (size_t a = 0; a < aggs_.size(); a++) {
+            AggSlot& slot = slots[a];
+            if (aggs_[a].type_ == AggType::COUNT) {
+                slot.count_ += 1;
+                continue;
+            }
+            long long iv = 0;
+            double dv;
+            if (src_types_[a] == 'I') {
+                iv = r.get_int(aggs_[a].col_);
+                dv = iv;
+            } else {
+                dv = r.get_double(aggs_[a].col_);
+            }
+            switch (aggs_[a].type_) {
+                case AggType::SUM:
+                case AggType::MEAN:
+                    slot.int_ += iv;
+                    slot.double_ += dv;
+                    break;
+                case AggType::MIN:
+                    if (slot.count_ == 0 || iv < slot.int_) slot.int_ = iv;
+                    if (slot.count_ == 0 || dv < slot.double_) slot.double_ = dv;
+                    break;
+                case AggType::MAX:
+                    if (slot.count_ == 0 || iv > slot.int_) slot.int_ = iv;
+                    if (slot.count_ == 0 || dv > slot.double_) slot.double_ = dv;
+                    break;
+                default:
+                    assert(false);
+            }
+            slot.count_ += 1;
+        }
+    }
+
+    /**
+     * Folds the partial state of another table's group into the given group.
+     */
+    void merge(size_t g, AggSlot* other) {
+        AggSlot* slots = &slots_[g * aggs_.size()];
+        for (size_t a = 0; a < aggs_.size(); a++) {
+            AggSlot& slot = slots[a];
+            AggSlot& o = other[a];
+            switch (aggs_[a].type_) {
+                case AggType::MIN:
+                    if (o.count_ > 0 && (slot.count_ == 0 || o.int_ < slot.int_)) {
+                        slot.int_ = o.int_;
+                    }
+                    if (o.count_ > 0 && (slot.count_ == 0 || o.double_ < slot.double_)) {
+                        slot.double_ = o.double_;
+                    }
+                    break;
+                case AggType::MAX:
+                    if (o.count_ > 0 && (slot.count_ == 0 || o.int_ > slot.int_)) {
+                        slot.int_ = o.int_;
+                    }
+                    if (o.count_ > 0 && (slot.count_ == 0 || o.double_ > slot.double_)) {
+                        slot.double_ = o.double_;
+                    }
+                    break;
+                default:
+                    slot.int_ += o.int_;
+                    slot.double_ += o.double_;
+            }
+            slot.count_ += o.count_;
+        }
+    }
+
+    /**
+     * Picks the node that owns a group. Uses the high bits of the hash since
+     * the owner's table probes with the low bits.
+     */
+    size_t owner(size_t g, size_t num_nodes) {
+        return (table_.hash_of(g) >> 32) % num_nodes;
+    }
+
+    /**
+     * Serializes a group: the encoded key followed by its slots.
+     */
+    void serialize_group(size_t g, Serializer* s) {
+        s->add_size_t(table_.key_size(g));
+        s->add_buffer(table_.key(g), table_.key_size(g));
+        s->add_buffer(&slots_[g * aggs_.size()], sizeof(AggSlot) * aggs_.size());
+    }
+
+    /**
+     * Merges serialized groups: a count followed by that many groups.
+     */
+    void merge_from(Deserializer* d) {
+        size_t n = d->get_size_t();
+        std::vector<char> key;
+        std::vector<AggSlot> slots(aggs_.size());
+        for (size_t i = 0; i < n; i++) {
+            size_t len = d->get_size_t();
+            key.resize(len);
+            d->get_buffer(len, key.data());
+            d->get_buffer(sizeof(AggSlot) * aggs_.size(), (char*)slots.data());
+            merge(group(key.data(), len), slots.data());
+        }
+    }
+
+    /**
+     * Sets the aggregate fields of a row from a group, starting at the given
+     * field.
+     */
+    void fill_row(size_t g, Row& r, size_t first) {
+        AggSlot* slots = &slots_[g * aggs_.size()];
+        for (size_t a = 0; a < aggs_.size(); a++) {
+            AggSlot& slot = slots[a];
+            switch (aggs_[a].type_) {
+                case AggType::COUNT:
+                    r.set(first + a, (int)slot.count_);
+                    break;
+                case AggType::MEAN:
+                    r.set(first + a, slot.count_ == 0 ? 0.0 : slot.double_ / slot.count_);
+                    break;
+                default:
+                    if (src_types_[a] == 'I') {
+                        r.set(first + a, (int)slot.int_);
+                    } else {
+                        r.set(first + a, slot.double_);
+                    }
+            }
+        }
+    }
+};
+
+/**
+ * Reader that folds every visited row into a GroupTable.
+ */
+class GroupAdder : public Reader {
+   public:
+    GroupTable& table_;
+    std::vector<size_t>& keys_;
+    std::vector<char> buf_;
+
+    GroupAdder(GroupTable& table, std::vector<size_t>& keys)
+        : Reader(), table_(table), keys_(keys) {}
+
+    void visit(Row& r) override {
+        buf_.clear();
+        r.encode(keys_, buf_);
+        table_.update(table_.group(buf_.data(), buf_.size()), r);
+    }
+};
+
+/**
+ * Writer that emits one row per group: the key fields, then the aggregates.
+ */
+class GroupWriter : public Writer {
+   public:
+    GroupTable& table_;
+    size_t num_keys_;
+    size_t g_;
+
+    GroupWriter(GroupTable& table, size_t num_keys) : Writer(), table_(table) {
+        num_keys_ = num_keys;
+        g_ = 0;
+    }
+
+    void visit(Row& r) override {
+        r.decode(table_.table_.key(g_), 0, num_keys_);
+        table_.fill_row(g_, r, num_keys_);
+        g_++;
+    }
+
+    bool done() override {
+        return g_ == table_.size();
+    }
+};
+
+/**
+ * A pending grouping of a data frame, or any other row source, by some of
+ * its columns. Aggregating is a collective operation: every node must call
+ * agg() or run() with the same arguments. Each node pre-aggregates the rows
+ * it holds and the partial groups are shuffled by key hash, so that every
+ * group is merged by exactly one owner node.
+ * Author: gomes.chri, modi.an
+ */
+class GroupBy : public Object {
+   public:
+    RowSource* src_;
+    std::vector<size_t> keys_;
+
+    /**
+     * Creates a grouping of the rows by the given columns.
+     * @arg src  the rows, external
+     * @arg keys  the indices of the key columns
+     */
+    GroupBy(RowSource* src, std::vector<size_t> keys) : Object(), keys_(keys) {
+        assert(src != nullptr);
+        assert(keys_.size() > 0);
+        for (size_t c : keys_) {
+            assert(c < src->get_schema().width());
+        }
+        src_ = src;
+    }
+
+    GroupBy(const GroupBy& other) : GroupBy(other.src_, other.keys_) {}
+
+    virtual ~GroupBy() {}
+
+    /**
+     * The column types of the output: the key columns followed by one column
+     * per aggregate. Owned by the caller.
+     */
+    String* out_types(std::vector<Aggregate>& aggs) {
+        Schema& in = src_->get_schema();
+        StrBuff types;
+        for (size_t c : keys_) {
+            char t[2] = {in.col_type(c), '\0'};
+            types.c(t);
+        }
+        for (Aggregate& a : aggs) {
+            char src = a.type_ == AggType::COUNT ? 'I' : in.col_type(a.col_);
+            char t[2] = {a.out_type(src), '\0'};
+            types.c(t);
+        }
+        return types.get();
+    }
+
+    /**
+     * Aggregates every group and visits the groups this node owns, one row
+     * per group laid out as out_types().
+     * @arg name  the name of the exchange, which must not be reused
+     * @arg kv  the store to exchange the groups through
+     * @arg aggs  the aggregates to compute
+     * @arg v  the reader to visit the groups with
+     */
+    void run(const char* name, KVStore* kv, std::vector<Aggregate>& aggs, Reader& v) {
+        size_t nodes = kv->num_nodes();
+        Schema& s = src_->get_schema();
+
+        // pre-aggregate the local rows
+        GroupTable local(aggs, s);
+        GroupAdder adder(local, keys_);
+        src_->local_map(adder);
+
+        // shuffle the partial groups to their owners
+        Exchange shuffle(kv, name);
+        std::vector<std::vector<size_t>> parts(nodes);
+        for (size_t g = 0; g < local.size(); g++) {
+            parts[local.owner(g, nodes)].push_back(g);
+        }
+        for (size_t n = 0; n < nodes; n++) {
+            Serializer ser;
+            ser.add_size_t(parts[n].size());
+            for (size_t g : parts[n]) {
+                local.serialize_group(g, &ser);
+            }
+            shuffle.send(n, ser);
+        }
+
+        // merge the groups this node owns
+        GroupTable owned(aggs, s);
+        for (size_t n = 0; n < nodes; n++) {
+            Value* val = shuffle.receive(n);
+            Deserializer d(val->get_bytes(), val->size());
+            owned.merge_from(&d);
+            delete val;
+        }
+
+        String* types = out_types(aggs);
+        Schema out(types->c_str());
+        Row r(out);
+        delete types;
+        GroupWriter writer(owned, keys_.size());
+        while (!writer.done()) {
+            writer.visit(r);
+            v.visit(r);
+        }
+    }
+
+    /**
+     * Aggregates every group and stores the groups as a frame at the output
+     * key, each node storing the groups it owns with store_rows. The output
+     * frame is laid out as out_types(). The name of the key must not be
+     * reused by another collective operation.
+     * @arg k  the key to store the result at
+     * @arg kd  the store
+     * @arg aggs  the aggregates to compute
+     * @return the result frame, owned by the caller
+     */
+    DataFrame* agg(Key* k, KDStore* kd, std::vector<Aggregate> aggs) {
+        String* types = out_types(aggs);
+        RowBatch rows;
+        RowCollector collector(rows, types->size());
+        String* name = StrBuff().c(k->k_.c_str()).c("~gb").get();
+        run(name->c_str(), kd->get_kvstore(), aggs, collector);
+
+        String* gname = StrBuff().c(*name).c("~all").get();
+        DataFrame* result = store_rows(k, kd, gname->c_str(), types->c_str(), rows);
+        delete types;
+        delete gname;
+        delete name;
+        return result;
+    }
+};
+
+inline GroupBy DataFrame::group_by(std::vector<size_t> key_cols) {
+    return GroupBy(this, key_cols);
+}
@@ -0,0 +1,266 @@
+#pragma once
+#include <assert.h>
+
+#include <vector>
+
+#include "dataframe.h"
+#include "row.h"
+#include "rowbatch.h"
+#include "rowsource.h"
+#include "store/exchange.h"
+#include "store/kdstore.h"
+#include "util/hashtable.h"
+#include "visitor.h"
+
+/**
+ * How the two sides of a join are brought together.
+ * BROADCAST ships every row of the smaller (build) side to every node and
+ * probes the larger side where it lies. PARTITIONED ships the rows of both
+ * sides to the node owning their key hash.
+ */
+enum class JoinStrategy { BROADCAST, PARTITIONED };
+
+/**
+ * Hash table over the rows of the build side of a join. Distinct keys are
+ * numbered by a HashTable and the rows of each key are chained through
+ * flat arrays, so the table holds no per-row objects.
+ * Author: gomes.chri, modi.an
+ */
+class JoinTable : public Object {
+   public:
+    HashTable keys_;
+    std::vector<size_t> heads_;    // first row of each key, plus one
+    std::vector<size_t> next_;     // next row with the same key, plus one
+    std::vector<size_t> offsets_;  // start of each row in rows_, plus the end
+    std::vector<char> rows_;
+
+    JoinTable() : Object(), keys_() {
+        offsets_.push_back(0);
+    }
+
+    virtual ~JoinTable() {}
+
+    /** The number of rows in the table. */
+    size_t size() {
+        return next_.size();
+    }
+
+    /** Adds an encoded row under an encoded key. */
+    void add(const char* key, size_t klen, const char* row, size_t rlen) {
+        size_t before = keys_.size();
+        size_t k = keys_.insert(key, klen);
+        if (keys_.size() != before) {
+            heads_.push_back(0);
+        }
+        rows_.insert(rows_.end(), row, row + rlen);
+        offsets_.push_back(rows_.size());
+        next_.push_back(heads_[k]);
+        heads_[k] = next_.size();
+    }
+
+    /**
+     * Gets the first row stored under a key.
+     * @return the row number plus one, or 0 if there is none
+     */
+    size_t first(const char* key, size_t klen) {
+        size_t k = keys_.find(key, klen);
+        return k == HASH_NOT_FOUND ? 0 : heads_[k];
+    }
+
+    /**
+     * Gets the row after the given one with the same key.
+     * @arg r  a row number plus one
+     * @return the row number plus one, or 0 if there is none
+     */
+    size_t next(size_t r) {
+        return next_[r - 1];
+    }
+
+    /** Gets the encoded row with the given number plus one. */
+    const char* row(size_t r, size_t* len) {
+        *len = offsets_[r] - offsets_[r - 1];
+        return rows_.data() + offsets_[r - 1];
+    }
+};
+
+/**
+ * An inner equi-join of two data frames, or other row sources, on one column
+ * of each. Joining is a collective operation: every node must run it with
+ * the same arguments. The output rows hold every column of the left side
+ * followed by every column of the right side. Each node joins the rows it
+ * is sent.
+ * Author: gomes.chri, modi.an
+ */
+class Join : public Object {
+   public:
+    RowSource* left_;
+    RowSource* right_;
+    size_t left_key_;
+    size_t right_key_;
+    bool build_left_;  // is the left frame the build side?
+    JoinStrategy strategy_;
+
+    /**
+     * Prepares a join and picks a strategy. The smaller frame is the build
+     * side. It is broadcast when sending it to every other node moves no
+     * more rows than the probe side holds, otherwise both sides are
+     * partitioned.
+     * @arg left  the left rows, external
+     * @arg right  the right rows, external
+     * @arg left_key  the key column of the left rows
+     * @arg right_key  the key column of the right rows
+     * @arg num_nodes  the number of nodes taking part
+     */
+    Join(RowSource* left, RowSource* right, size_t left_key, size_t right_key, size_t num_nodes)
+        : Object() {
+        assert(left != nullptr && right != nullptr);
+        Schema& ls = left->get_schema();
+        Schema& rs = right->get_schema();
+        assert(left_key < ls.width() && right_key < rs.width());
+        assert(ls.col_type(left_key) == rs.col_type(right_key));
+        left_ = left;
+        right_ = right;
+        left_key_ = left_key;
+        right_key_ = right_key;
+        build_left_ = left->nrows() < right->nrows();
+        size_t build = build_left_ ? left->nrows() : right->nrows();
+        size_t probe = build_left_ ? right->nrows() : left->nrows();
+        // divides rather than multiplies, as the sizes of joined sources may be SIZE_MAX
+        if (num_nodes == 1 || build <= probe / (num_nodes - 1)) {
+            strategy_ = JoinStrategy::BROADCAST;
+        } else {
+            strategy_ = JoinStrategy::PARTITIONED;
+        }
+    }
+
+    virtual ~Join() {}
+
+    /**
+     * Sends the local rows of one side to their destinations.
+     * @arg src  the rows
+     * @arg key  the key column
+     * @arg ex  the exchange to send through
+     * @arg broadcast  send the rows to every node instead of the key owner
+     */
+    void ship_(RowSource* src, size_t key, Exchange& ex, bool broadcast, size_t nodes) {
+        bool partition = strategy_ == JoinStrategy::PARTITIONED;
+        std::vector<RowBatch> batches(partition ? nodes : 1);
+        size_t width = src->get_schema().width();
+        KeyedRowCollector collector(batches, std::vector<size_t>(1, key), width, partition);
+        src->local_map(collector);
+        if (partition) {
+            for (size_t n = 0; n < nodes; n++) {
+                Serializer s;
+                batches[n].serialize(&s);
+                ex.send(n, s);
+            }
+        } else {
+            Serializer s;
+            batches[0].serialize(&s);
+            if (broadcast) {
+                for (size_t n = 0; n < nodes; n++) {
+                    ex.send(n, s);
+                }
+            } else {
+                ex.send(ex.store_->this_node(), s);
+            }
+        }
+    }
+
+    /** The column types of the output, owned by the caller. */
+    String* out_types() {
+        String* left = left_->get_schema().types();
+        String* right = right_->get_schema().types();
+        String* types = StrBuff().c(*left).c(*right).get();
+        delete left;
+        delete right;
+        return types;
+    }
+
+    /**
+     * Runs the join and collects the joined rows of this node.
+     * @arg name  the prefix of the exchange names, which must not be reused
+     * @arg kv  the store to exchange the rows through
+     * @arg out  gets one record per joined row, holding every field
+     */
+    void run(const char* name, KVStore* kv, RowBatch& out) {
+        size_t nodes = kv->num_nodes();
+        size_t me = kv->this_node();
+        bool partition = strategy_ == JoinStrategy::PARTITIONED;
+        RowSource* build = build_left_ ? left_ : right_;
+        RowSource* probe = build_left_ ? right_ : left_;
+        char key_type = left_->get_schema().col_type(left_key_);
+
+        String* bname = StrBuff().c(name).c("~jb").get();
+        String* pname = StrBuff().c(name).c("~jp").get();
+        Exchange bex(kv, bname->c_str());
+        Exchange pex(kv, pname->c_str());
+        ship_(build, build_left_ ? left_key_ : right_key_, bex, true, nodes);
+        ship_(probe, build_left_ ? right_key_ : left_key_, pex, false, nodes);
+
+        // build the hash table from every build row sent here
+        JoinTable table;
+        for (size_t n = 0; n < nodes; n++) {
+            Value* v = bex.receive(n);
+            BatchCursor cur(v);
+            while (!cur.done()) {
+                size_t len;
+                const char* rec = cur.next(&len);
+                size_t klen = encoded_size(key_type, rec);
+                table.add(rec, klen, rec + klen, len - klen);
+            }
+            delete v;
+        }
+
+        // probe it with the probe rows sent here
+        for (size_t n = 0; n < nodes; n++) {
+            if (!partition && n != me) continue;
+            Value* v = pex.receive(n);
+            BatchCursor cur(v);
+            while (!cur.done()) {
+                size_t len;
+                const char* rec = cur.next(&len);
+                size_t klen = encoded_size(key_type, rec);
+                const char* prow = rec + klen;
+                size_t plen = len - klen;
+                for (size_t r = table.first(rec, klen); r != 0; r = table.next(r)) {
+                    size_t blen;
+                    const char* brow = table.row(r, &blen);
+                    if (build_left_) {
+                        out.add(brow, blen, prow, plen);
+                    } else {
+                        out.add(prow, plen, brow, blen);
+                    }
+                }
+            }
+            delete v;
+        }
+        delete bname;
+        delete pname;
+    }
+
+    /**
+     * Runs the join and stores the joined rows as a frame at the output key,
+     * each node storing the rows it joins with store_rows. The name of the
+     * key must not be reused by another collective operation.
+     * @arg k  the key to store the result at
+     * @arg kd  the store
+     * @return the result frame, owned by the caller
+     */
+    DataFrame* run(Key* k, KDStore* kd) {
+        RowBatch out;
+        run(k->k_.c_str(), kd->get_kvstore(), out);
+        String* oname = StrBuff().c(k->k_.c_str()).c("~jo").get();
+        String* types = out_types();
+        DataFrame* result = store_rows(k, kd, oname->c_str(), types->c_str(), out);
+        delete types;
+        delete oname;
+        return result;
+    }
+};
+
+inline DataFrame* DataFrame::join(Key* k, KDStore* kd, DataFrame* other, size_t left_key,
+                                  size_t right_key) {
+    Join j(this, other, left_key, right_key, kd->get_kvstore()->num_nodes());
+    return j.run(k, kd);
+}
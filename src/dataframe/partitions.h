@@ -0,0 +1,215 @@
+#pragma once
+#include <assert.h>
+#include <string.h>
+
+#include <vector>
+
+#include "util/object.h"
+#include "util/serial.h"
+#include "util/string.h"
+
+/**
+ * Gets the length of one field encoded by Row::encode.
+ * @arg type  the type of the field
+ * @arg p  the encoded field
+ * @return the number of bytes it takes
+ */
+inline size_t encoded_size(char type, const char* p) {
+    switch (type) {
+        case 'S': {
+            size_t n;
+            memcpy(&n, p, sizeof(size_t));
+            return sizeof(size_t) + n;
+        }
+        case 'I':
+            return sizeof(int);
+        case 'D':
+            return sizeof(double);
+        case 'B':
+            return sizeof(bool);
+        default:
+            assert(false);
+            return 0;
+    }
+}
+
+/**
+ * Compares two runs of fields encoded by Row::encode. Strings compare like
+ * strcmp, everything else by value.
+ * @arg a  the first fields
+ * @arg b  the second fields
+ * @arg types  the type of each field
+ * @arg n  the number of fields
+ * @return negative, zero or positive as a is less than, equal to or greater
+ *   than b
+ */
+inline int compare_encoded(const char* a, const char* b, const char* types, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        int c = 0;
+        switch (types[i]) {
+            case 'S': {
+                size_t alen, blen;
+                memcpy(&alen, a, sizeof(size_t));
+                memcpy(&blen, b, sizeof(size_t));
+                c = memcmp(a + sizeof(size_t), b + sizeof(size_t), alen < blen ? alen : blen);
+                if (c == 0) c = alen < blen ? -1 : (alen > blen ? 1 : 0);
+                break;
+            }
+            case 'I': {
+                int x, y;
+                memcpy(&x, a, sizeof(int));
+                memcpy(&y, b, sizeof(int));
+                c = x < y ? -1 : (x > y ? 1 : 0);
+                break;
+            }
+            case 'D': {
+                double x, y;
+                memcpy(&x, a, sizeof(double));
+                memcpy(&y, b, sizeof(double));
+                c = x < y ? -1 : (x > y ? 1 : 0);
+                break;
+            }
+            case 'B': {
+                bool x, y;
+                memcpy(&x, a, sizeof(bool));
+                memcpy(&y, b, sizeof(bool));
+                c = (int)x - (int)y;
+                break;
+            }
+            default:
+                assert(false);
+        }
+        if (c != 0) return c;
+        a += encoded_size(types[i], a);
+        b += encoded_size(types[i], b);
+    }
+    return 0;
+}
+
+/**
+ * Describes how the rows of a sorted data frame are split into ranges.
+ * Partition p holds the rows [start(p), start(p + 1)) whose sort keys lie
+ * in [splitter(p - 1), splitter(p)), where the first partition has no lower
+ * bound and the last no upper bound. Sort keys are the sort columns encoded
+ * by Row::encode.
+ * Author: gomes.chri, modi.an
+ */
+class RangePartitions : public Object {
+   public:
+    std::vector<size_t> cols_;               // the sort columns
+    String* types_;                          // their types
+    std::vector<size_t> starts_;             // first row of each partition, plus the end
+    std::vector<std::vector<char>> splits_;  // one fewer than the partitions
+
+    RangePartitions(std::vector<size_t> cols, const char* types) : Object(), cols_(cols) {
+        assert(strlen(types) == cols_.size());
+        types_ = new String(types);
+        starts_.push_back(0);
+    }
+
+    RangePartitions(Deserializer* d) : Object() {
+        size_t ncols = d->get_size_t();
+        for (size_t i = 0; i < ncols; i++) {
+            cols_.push_back(d->get_size_t());
+        }
+        types_ = d->get_string();
+        size_t nparts = d->get_size_t();
+        for (size_t i = 0; i <= nparts; i++) {
+            starts_.push_back(d->get_size_t());
+        }
+        for (size_t i = 0; i + 1 < nparts; i++) {
+            size_t len = d->get_size_t();
+            splits_.push_back(std::vector<char>(len));
+            d->get_buffer(len, splits_.back().data());
+        }
+    }
+
+    RangePartitions(RangePartitions& from)
+        : Object(), cols_(from.cols_), starts_(from.starts_), splits_(from.splits_) {
+        types_ = from.types_->clone();
+    }
+
+    virtual ~RangePartitions() {
+        delete types_;
+    }
+
+    /**
+     * Adds a partition after the existing ones.
+     * @arg rows  the number of rows in the partition
+     * @arg low  the encoded lower bound of its keys, ignored for the first
+     * @arg len  the length of low
+     */
+    void add(size_t rows, const char* low, size_t len) {
+        if (starts_.size() > 1) {
+            splits_.push_back(std::vector<char>(low, low + len));
+        }
+        starts_.push_back(starts_.back() + rows);
+    }
+
+    /**
+     * Sets the number of rows in every partition.
+     * @arg rows  the number of rows of each partition, one per partition
+     */
+    void set_sizes(std::vector<size_t>& rows) {
+        assert(rows.size() == size());
+        for (size_t p = 0; p < rows.size(); p++) {
+            starts_[p + 1] = starts_[p] + rows[p];
+        }
+    }
+
+    /** The number of partitions. */
+    size_t size() {
+        return starts_.size() - 1;
+    }
+
+    /** The first row of a partition. Partition size() is the end. */
+    size_t start(size_t p) {
+        assert(p <= size());
+        return starts_[p];
+    }
+
+    /** The partition whose key range holds the encoded key. */
+    size_t partition_of(const char* key) {
+        size_t lo = 0;
+        size_t hi = splits_.size();
+        // the number of splitters at or below the key
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (compare_encoded(splits_[mid].data(), key, types_->c_str(), cols_.size()) <= 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    /**
+     * Narrows a range query on the sort keys to the rows that can match.
+     * @arg lo  the encoded smallest key wanted
+     * @arg hi  the encoded largest key wanted
+     * @arg begin  set to the first row that can match
+     * @arg end  set to one past the last row that can match
+     */
+    void rows_for(const char* lo, const char* hi, size_t* begin, size_t* end) {
+        assert(size() > 0);
+        *begin = starts_[partition_of(lo)];
+        *end = starts_[partition_of(hi) + 1];
+    }
+
+    void serialize(Serializer* s) {
+        s->add_size_t(cols_.size());
+        for (size_t c : cols_) {
+            s->add_size_t(c);
+        }
+        s->add_string(types_);
+        s->add_size_t(size());
+        for (size_t start : starts_) {
+            s->add_size_t(start);
+        }
+        for (std::vector<char>& split : splits_) {
+            s->add_size_t(split.size());
+            s->add_buffer(split.data(), split.size());
+        }
+    }
+};
@@ -0,0 +1,817 @@
+#pragma once
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "dataframe.h"
+#include "groupby.h"
+#include "join.h"
+#include "row.h"
+#include "rowbatch.h"
+#include "rowsource.h"
+#include "schema.h"
+#include "store/exchange.h"
+#include "store/kdstore.h"
+#include "util/data.h"
+#include "visitor.h"
+
+/**
+ * The comparisons a Compare filter can make.
+ */
+enum class CmpOp { EQ, NE, LT, LE, GT, GE };
+
+/**
+ * Decides which rows pass a filter step of a query. A filter is given the
+ * columns it reads when it is added to the query. The query may move the
+ * filter before earlier steps, so it must find those columns through the
+ * positions it is handed rather than remember them.
+ * Author: gomes.chri, modi.an
+ */
+class Filter : public Object {
+   public:
+    Filter() : Object() {}
+
+    virtual ~Filter() {}
+
+    /**
+     * Decides whether a row passes.
+     * @arg r  the row
+     * @arg cols  the positions in r of the columns the filter reads, in the
+     *   order they were given
+     * @return true if the row passes
+     */
+    virtual bool accept(Row& r, std::vector<size_t>& cols) {
+        return true;
+    }
+};
+
+/**
+ * Filter that compares one column to a constant.
+ * Author: gomes.chri, modi.an
+ */
+class Compare : public Filter {
+   public:
+    CmpOp op_;
+    char type_;
+    Data value_;  // owns the string, if any
+
+    Compare(CmpOp op, int v) : Filter() {
+        op_ = op;
+        type_ = 'I';
+        value_.payload.i = v;
+    }
+
+    Compare(CmpOp op, double v) : Filter() {
+        op_ = op;
+        type_ = 'D';
+        value_.payload.d = v;
+    }
+
+    Compare(CmpOp op, bool v) : Filter() {
+        op_ = op;
+        type_ = 'B';
+        value_.payload.b = v;
+    }
+
+    Compare(CmpOp op, const char* v) : Filter() {
+        op_ = op;
+        type_ = 'S';
+        value_.payload.s = new String(v);
+    }
+
+    virtual ~Compare() {
+        if (type_ == 'S') {
+            delete value_.payload.s;
+        }
+    }
+
+    bool accept(Row& r, std::vector<size_t>& cols) override {
+        size_t col = cols[0];
+        assert(r.col_type(col) == type_);
+        int c;
+        switch (type_) {
+            case 'I':
+                c = r.get_int(col) < value_.payload.i ? -1 : r.get_int(col) > value_.payload.i;
+                break;
+            case 'D':
+                c = r.get_double(col) < value_.payload.d ? -1
+                                                         : r.get_double(col) > value_.payload.d;
+                break;
+            case 'B':
+                c = (int)r.get_bool(col) - (int)value_.payload.b;
+                break;
+            case 'S':
+                c = strcmp(r.get_string(col)->c_str(), value_.payload.s->c_str());
+                break;
+            default:
+                assert(false);
+                return false;
+        }
+        switch (op_) {
+            case CmpOp::EQ:
+                return c == 0;
+            case CmpOp::NE:
+                return c != 0;
+            case CmpOp::LT:
+                return c < 0;
+            case CmpOp::LE:
+                return c <= 0;
+            case CmpOp::GT:
+                return c > 0;
+            case CmpOp::GE:
+                return c >= 0;
+        }
+        return false;
+    }
+};
+
+/**
+ * Turns every row into a row of a new schema for a map step of a query.
+ * Author: gomes.chri, modi.an
+ */
+class Mapper : public Object {
+   public:
+    Mapper() : Object() {}
+
+    virtual ~Mapper() {}
+
+    /**
+     * Sets every field of the output row from the input row.
+     * @arg in  the input row
+     * @arg out  the output row
+     */
+    virtual void map(Row& in, Row& out) {}
+};
+
+/**
+ * The kinds of steps of a query.
+ */
+enum class QueryOp { FILTER, PROJECT, MAP, AGGREGATE, JOIN };
+
+class Query;
+
+/**
+ * One step of a query. The fields used depend on the kind of step.
+ * Author: gomes.chri, modi.an
+ */
+class QueryStep : public Object {
+   public:
+    QueryOp op_;
+    std::vector<size_t> cols_;  // columns read by a filter, kept by a project, or group keys
+    Filter* filter_;            // external unless owns_filter_
+    bool owns_filter_;
+    Mapper* mapper_;  // external
+    String* types_;   // the output types of a map
+    std::vector<Aggregate> aggs_;
+    Query* right_;  // owned, the right side of a join
+    size_t left_key_;
+    size_t right_key_;
+
+    QueryStep(QueryOp op, std::vector<size_t> cols) : Object(), cols_(cols) {
+        op_ = op;
+        filter_ = nullptr;
+        owns_filter_ = false;
+        mapper_ = nullptr;
+        types_ = nullptr;
+        right_ = nullptr;
+        left_key_ = 0;
+        right_key_ = 0;
+    }
+
+    virtual ~QueryStep();
+
+    /**
+     * Gets the schema of the rows this step produces.
+     * @arg in  the schema of the rows it is given
+     * @return the schema, owned by the caller
+     */
+    Schema* out_schema(Schema& in);
+};
+
+/**
+ * Reader that passes the rows a filter accepts on to the next reader.
+ */
+class FilterStage : public Reader {
+   public:
+    Reader& next_;
+    QueryStep* step_;
+
+    FilterStage(Reader& next, QueryStep* step) : Reader(), next_(next), step_(step) {}
+
+    void visit(Row& r) override {
+        if (step_->filter_->accept(r, step_->cols_)) {
+            next_.visit(r);
+        }
+    }
+};
+
+/**
+ * Reader that passes some of the fields of every row on to the next reader.
+ */
+class ProjectStage : public Reader {
+   public:
+    Reader& next_;
+    QueryStep* step_;
+    Row out_;
+
+    ProjectStage(Reader& next, QueryStep* step, Schema& out)
+        : Reader(), next_(next), step_(step), out_(out) {}
+
+    void visit(Row& r) override {
+        for (size_t i = 0; i < step_->cols_.size(); i++) {
+            size_t c = step_->cols_[i];
+            switch (r.col_type(c)) {
+                case 'S':
+                    out_.set(i, r.get_string(c)->clone());
+                    break;
+                case 'I':
+                    out_.set(i, r.get_int(c));
+                    break;
+                case 'D':
+                    out_.set(i, r.get_double(c));
+                    break;
+                case 'B':
+                    out_.set(i, r.get_bool(c));
+                    break;
+                default:
+                    assert(false);
+            }
+        }
+        next_.visit(out_);
+    }
+};
+
+/**
+ * Reader that passes every row through a mapper on to the next reader.
+ */
+class MapStage : public Reader {
+   public:
+    Reader& next_;
+    QueryStep* step_;
+    Row out_;
+
+    MapStage(Reader& next, QueryStep* step, Schema& out)
+        : Reader(), next_(next), step_(step), out_(out) {}
+
+    void visit(Row& r) override {
+        step_->mapper_->map(r, out_);
+        next_.visit(out_);
+    }
+};
+
+/**
+ * Rows of another source after a run of filter, project and map steps. The
+ * steps are fused: every row of the input goes through all of them in one
+ * pass, without any intermediate frame.
+ * Author: gomes.chri, modi.an
+ */
+class FusedSource : public RowSource {
+   public:
+    RowSource* in_;                 // external
+    std::vector<QueryStep*> steps_;  // external
+    std::vector<Schema*> schemas_;  // the output of each step, owned
+
+    FusedSource(RowSource* in, std::vector<QueryStep*> steps) : RowSource(), steps_(steps) {
+        in_ = in;
+        Schema* s = &in->get_schema();
+        for (QueryStep* step : steps_) {
+            schemas_.push_back(step->out_schema(*s));
+            s = schemas_.back();
+        }
+    }
+
+    virtual ~FusedSource() {
+        for (Schema* s : schemas_) {
+            delete s;
+        }
+    }
+
+    Schema& get_schema() override {
+        return steps_.empty() ? in_->get_schema() : *schemas_.back();
+    }
+
+    size_t nrows() override {
+        return in_->nrows();
+    }
+
+    void local_map(Reader& v) override {
+        // chain the stages from the last one back
+        std::vector<Reader*> stages;
+        Reader* next = &v;
+        for (size_t i = steps_.size(); i-- > 0;) {
+            switch (steps_[i]->op_) {
+                case QueryOp::FILTER:
+                    stages.push_back(new FilterStage(*next, steps_[i]));
+                    break;
+                case QueryOp::PROJECT:
+                    stages.push_back(new ProjectStage(*next, steps_[i], *schemas_[i]));
+                    break;
+                case QueryOp::MAP:
+                    stages.push_back(new MapStage(*next, steps_[i], *schemas_[i]));
+                    break;
+                default:
+                    assert(false);
+            }
+            next = stages.back();
+        }
+        in_->local_map(*next);
+        for (Reader* stage : stages) {
+            delete stage;
+        }
+    }
+};
+
+/**
+ * The groups of an aggregate step. Producing them is collective, so every
+ * node must call local_map() exactly once.
+ * Author: gomes.chri, modi.an
+ */
+class AggSource : public RowSource {
+   public:
+    GroupBy group_by_;
+    std::vector<Aggregate> aggs_;
+    KVStore* kv_;
+    String* name_;
+    Schema* schema_;
+
+    /**
+     * @arg in  the rows to group, external
+     * @arg step  the aggregate step
+     * @arg kv  the store to exchange the groups through
+     * @arg name  the name of the exchange
+     */
+    AggSource(RowSource* in, QueryStep* step, KVStore* kv, const char* name)
+        : RowSource(), group_by_(in, step->cols_), aggs_(step->aggs_) {
+        kv_ = kv;
+        name_ = new String(name);
+        String* types = group_by_.out_types(aggs_);
+        schema_ = new Schema(types->c_str());
+        delete types;
+    }
+
+    virtual ~AggSource() {
+        delete name_;
+        delete schema_;
+    }
+
+    Schema& get_schema() override {
+        return *schema_;
+    }
+
+    size_t nrows() override {
+        return group_by_.src_->nrows();
+    }
+
+    void local_map(Reader& v) override {
+        group_by_.run(name_->c_str(), kv_, aggs_, v);
+    }
+};
+
+/**
+ * The joined rows of a join step. Producing them is collective, so every
+ * node must call local_map() exactly once.
+ * Author: gomes.chri, modi.an
+ */
+class JoinSource : public RowSource {
+   public:
+    Join join_;
+    KVStore* kv_;
+    String* name_;
+    Schema* schema_;
+
+    /**
+     * @arg left  the left rows, external
+     * @arg right  the right rows, external
+     * @arg step  the join step
+     * @arg kv  the store to exchange the rows through
+     * @arg name  the prefix of the exchange names
+     */
+    JoinSource(RowSource* left, RowSource* right, QueryStep* step, KVStore* kv, const char* name)
+        : RowSource(), join_(left, right, step->left_key_, step->right_key_, kv->num_nodes()) {
+        kv_ = kv;
+        name_ = new String(name);
+        String* types = join_.out_types();
+        schema_ = new Schema(types->c_str());
+        delete types;
+    }
+
+    virtual ~JoinSource() {
+        delete name_;
+        delete schema_;
+    }
+
+    Schema& get_schema() override {
+        return *schema_;
+    }
+
+    /** Every pair of rows may match, so the bound is their product, or SIZE_MAX past it. */
+    size_t nrows() override {
+        size_t left = join_.left_->nrows();
+        size_t right = join_.right_->nrows();
+        if (left != 0 && right > SIZE_MAX / left) {
+            return SIZE_MAX;
+        }
+        return left * right;
+    }
+
+    void local_map(Reader& v) override {
+        RowBatch joined;
+        join_.run(name_->c_str(), kv_, joined);
+        Row r(*schema_);
+        Serializer s;
+        joined.serialize(&s);
+        BatchCursor cur(s.get_bytes(), s.size());
+        while (!cur.done()) {
+            size_t len;
+            r.decode(cur.next(&len), 0, r.width());
+            v.visit(r);
+        }
+    }
+};
+
+/**
+ * A lazy query over the data frame stored at a key. Steps are only recorded
+ * when they are added; nothing runs until collect() or store() is called.
+ * Running a query is a collective operation: every node must build the same
+ * query and run it the same way.
+ *
+ * When the query runs, filters that only read columns an earlier project,
+ * group key or join side passes through unchanged are moved before that
+ * step, so that rows are dropped before they are shuffled. Then runs of
+ * filter, project and map steps are fused into a single pass over the local
+ * rows of their input, and aggregate and join steps stream their output
+ * into the next run. Only the final result is written to the store.
+ * Author: gomes.chri, modi.an
+ */
+class Query : public Object {
+   public:
+    KDStore* kd_;
+    Key* src_;                       // owned
+    DataFrame* frame_;               // owned, loaded when first needed
+    std::vector<QueryStep*> steps_;  // owned
+    bool optimized_;                 // whether optimize() ran since the last step was added
+
+    /**
+     * Starts a query with a scan of a stored data frame.
+     * @arg kd  the store
+     * @arg k  the key of the frame, copied
+     */
+    Query(KDStore* kd, Key& k) : Object() {
+        kd_ = kd;
+        src_ = k.clone();
+        frame_ = nullptr;
+        optimized_ = false;
+    }
+
+    virtual ~Query() {
+        for (QueryStep* step : steps_) {
+            delete step;
+        }
+        delete frame_;
+        delete src_;
+    }
+
+    /**
+     * Keeps the rows whose column compares to a constant as given.
+     * @arg col  the column
+     * @arg op  the comparison
+     * @arg v  the constant, of the type of the column
+     */
+    Query& filter(size_t col, CmpOp op, int v) {
+        return add_filter_(col, new Compare(op, v));
+    }
+
+    Query& filter(size_t col, CmpOp op, double v) {
+        return add_filter_(col, new Compare(op, v));
+    }
+
+    Query& filter(size_t col, CmpOp op, bool v) {
+        return add_filter_(col, new Compare(op, v));
+    }
+
+    Query& filter(size_t col, CmpOp op, const char* v) {
+        return add_filter_(col, new Compare(op, v));
+    }
+
+    /**
+     * Keeps the rows a filter accepts.
+     * @arg cols  the columns the filter reads
+     * @arg f  the filter, external
+     */
+    Query& filter(std::vector<size_t> cols, Filter* f) {
+        QueryStep* step = new QueryStep(QueryOp::FILTER, cols);
+        step->filter_ = f;
+        optimized_ = false;
+        steps_.push_back(step);
+        return *this;
+    }
+
+    /**
+     * Keeps the given columns, in the given order.
+     */
+    Query& project(std::vector<size_t> cols) {
+        assert(cols.size() > 0);
+        optimized_ = false;
+        steps_.push_back(new QueryStep(QueryOp::PROJECT, cols));
+        return *this;
+    }
+
+    /**
+     * Replaces every row with the row a mapper makes from it.
+     * @arg types  the types of the rows the mapper makes
+     * @arg m  the mapper, external
+     */
+    Query& map(const char* types, Mapper* m) {
+        QueryStep* step = new QueryStep(QueryOp::MAP, std::vector<size_t>());
+        step->mapper_ = m;
+        step->types_ = new String(types);
+        optimized_ = false;
+        steps_.push_back(step);
+        return *this;
+    }
+
+    /**
+     * Groups the rows by the given columns and aggregates every group, like
+     * GroupBy::agg().
+     */
+    Query& agg(std::vector<size_t> keys, std::vector<Aggregate> aggs) {
+        assert(keys.size() > 0);
+        QueryStep* step = new QueryStep(QueryOp::AGGREGATE, keys);
+        step->aggs_ = aggs;
+        optimized_ = false;
+        steps_.push_back(step);
+        return *this;
+    }
+
+    /**
+     * Joins the rows with the result of another query, like Join.
+     * @arg right  the right side, owned by this query from now on
+     * @arg left_key  the key column of these rows
+     * @arg right_key  the key column of the rows of right
+     */
+    Query& join(Query* right, size_t left_key, size_t right_key) {
+        assert(right != nullptr);
+        QueryStep* step = new QueryStep(QueryOp::JOIN, std::vector<size_t>());
+        step->right_ = right;
+        step->left_key_ = left_key;
+        step->right_key_ = right_key;
+        optimized_ = false;
+        steps_.push_back(step);
+        return *this;
+    }
+
+    /**
+     * Runs the query and stores the result, each node storing its rows of it
+     * with store_rows. The name of the key must not be reused by another
+     * collective operation.
+     * @arg k  the key to store the result at
+     * @return the result frame, owned by the caller
+     */
+    DataFrame* store(Key* k) {
+        std::vector<RowSource*> sources;
+        RowSource* result = build_(k->k_.c_str(), sources);
+        RowBatch rows;
+        RowCollector collector(rows, result->get_schema().width());
+        result->local_map(collector);
+        String* types = result->get_schema().types();
+        String* name = StrBuff().c(k->k_.c_str()).c("~qo").get();
+        DataFrame* df = store_rows(k, kd_, name->c_str(), types->c_str(), rows);
+        delete name;
+        delete types;
+        delete_all_(sources);
+        return df;
+    }
+
+    /**
+     * Runs the query and gives every node all of the result. The result
+     * frame is not stored at any key, and the segments of each copy stay on
+     * the node that has it.
+     * @return the result frame, owned by the caller
+     */
+    DataFrame* collect() {
+        KVStore* kv = kd_->get_kvstore();
+        String* prefix = StrBuff().c(src_->k_.c_str()).c("~q").c(kd_->next_query_id()).get();
+        std::vector<RowSource*> sources;
+        RowSource* result = build_(prefix->c_str(), sources);
+        RowBatch rows;
+        RowCollector collector(rows, result->get_schema().width());
+        result->local_map(collector);
+
+        String* name = StrBuff().c(*prefix).c("~qc").get();
+        Exchange all(kv, name->c_str());
+        Serializer s;
+        rows.serialize(&s);
+        for (size_t n = 0; n < kv->num_nodes(); n++) {
+            all.send(n, s);
+        }
+        std::vector<Value*> batches;
+        for (size_t n = 0; n < kv->num_nodes(); n++) {
+            batches.push_back(all.receive(n));
+        }
+        String* types = result->get_schema().types();
+        RowBatchWriter writer(batches);
+        // every node has all the rows, so each keeps its copy to itself
+        DataFrame* df = DataFrame::fromVisitor(kv, types->c_str(), writer, true);
+        delete types;
+        delete name;
+        delete prefix;
+        delete_all_(sources);
+        return df;
+    }
+
+    /**
+     * Moves filters as early in the query as they can go, including into the
+     * right side of joins. Called by collect() and store(); once the steps
+     * are in order, calling it again does nothing until a step is added.
+     */
+    void optimize() {
+        if (optimized_) {
+            return;
+        }
+        optimized_ = true;
+        bool moved = true;
+        while (moved) {
+            moved = false;
+            for (size_t i = 1; i < steps_.size() && !moved; i++) {
+                if (steps_[i]->op_ == QueryOp::FILTER) {
+                    moved = push_down_(i);
+                }
+            }
+        }
+    }
+
+    /**
+     * Tries to move the filter at the given step before the step ahead of it.
+     * @return whether the filter moved
+     */
+    bool push_down_(size_t i) {
+        QueryStep* f = steps_[i];
+        QueryStep* prev = steps_[i - 1];
+        switch (prev->op_) {
+            case QueryOp::PROJECT:
+                for (size_t& c : f->cols_) {
+                    c = prev->cols_[c];
+                }
+                break;
+            case QueryOp::AGGREGATE:
+                for (size_t c : f->cols_) {
+                    if (c >= prev->cols_.size()) return false;
+                }
+                for (size_t& c : f->cols_) {
+                    c = prev->cols_[c];
+                }
+                break;
+            case QueryOp::JOIN: {
+                size_t left = width_(i - 1);
+                bool all_left = true;
+                bool all_right = true;
+                for (size_t c : f->cols_) {
+                    all_left = all_left && c < left;
+                    all_right = all_right && c >= left;
+                }
+                if (all_right) {
+                    for (size_t& c : f->cols_) {
+                        c -= left;
+                    }
+                    prev->right_->optimized_ = false;
+                    prev->right_->steps_.push_back(f);
+                    steps_.erase(steps_.begin() + i);
+                    return true;
+                }
+                if (!all_left) return false;
+                break;
+            }
+            default:
+                return false;
+        }
+        steps_[i - 1] = f;
+        steps_[i] = prev;
+        return true;
+    }
+
+    /** Gets the scanned frame. */
+    DataFrame* frame_of_() {
+        if (frame_ == nullptr) {
+            frame_ = kd_->waitAndGet(*src_);
+        }
+        return frame_;
+    }
+
+    /** The number of columns of the rows going into the given step. */
+    size_t width_(size_t step) {
+        size_t width = frame_of_()->ncols();
+        for (size_t i = 0; i < step; i++) {
+            switch (steps_[i]->op_) {
+                case QueryOp::FILTER:
+                    break;
+                case QueryOp::PROJECT:
+                    width = steps_[i]->cols_.size();
+                    break;
+                case QueryOp::MAP:
+                    width = steps_[i]->types_->size();
+                    break;
+                case QueryOp::AGGREGATE:
+                    width = steps_[i]->cols_.size() + steps_[i]->aggs_.size();
+                    break;
+                case QueryOp::JOIN: {
+                    Query* right = steps_[i]->right_;
+                    width += right->width_(right->steps_.size());
+                    break;
+                }
+            }
+        }
+        return width;
+    }
+
+    /**
+     * Builds the sources that produce the rows of the query.
+     * @arg prefix  the prefix of the names of the exchanges
+     * @arg sources  gets every source built, to be deleted by the caller
+     * @return the source of the final rows
+     */
+    RowSource* build_(const char* prefix, std::vector<RowSource*>& sources) {
+        optimize();
+        KVStore* kv = kd_->get_kvstore();
+        RowSource* cur = frame_of_();
+        std::vector<QueryStep*> fused;
+        for (size_t i = 0; i < steps_.size(); i++) {
+            QueryStep* step = steps_[i];
+            if (step->op_ != QueryOp::AGGREGATE && step->op_ != QueryOp::JOIN) {
+                fused.push_back(step);
+                continue;
+            }
+            if (!fused.empty()) {
+                sources.push_back(new FusedSource(cur, fused));
+                cur = sources.back();
+                fused.clear();
+            }
+            String* name = StrBuff().c(prefix).c("~q").c(i).get();
+            if (step->op_ == QueryOp::AGGREGATE) {
+                sources.push_back(new AggSource(cur, step, kv, name->c_str()));
+            } else {
+                String* rname = StrBuff().c(*name).c("r").get();
+                RowSource* right = step->right_->build_(rname->c_str(), sources);
+                sources.push_back(new JoinSource(cur, right, step, kv, name->c_str()));
+                delete rname;
+            }
+            cur = sources.back();
+            delete name;
+        }
+        if (!fused.empty()) {
+            sources.push_back(new FusedSource(cur, fused));
+            cur = sources.back();
+        }
+        return cur;
+    }
+
+    Query& add_filter_(size_t col, Compare* f) {
+        filter(std::vector<size_t>(1, col), f);
+        steps_.back()->owns_filter_ = true;
+        return *this;
+    }
+
+    void delete_all_(std::vector<RowSource*>& sources) {
+        for (RowSource* s : sources) {
+            delete s;
+        }
+    }
+};
+
+inline QueryStep::~QueryStep() {
+    if (owns_filter_) {
+        delete filter_;
+    }
+    delete types_;
+    delete right_;
+}
+
+inline Schema* QueryStep::out_schema(Schema& in) {
+    Schema* out = new Schema();
+    switch (op_) {
+        case QueryOp::FILTER:
+            delete out;
+            return new Schema(in);
+        case QueryOp::PROJECT:
+            for (size_t c : cols_) {
+                out->add_column(in.col_type(c));
+            }
+            return out;
+        case QueryOp::MAP:
+            delete out;
+            return new Schema(types_->c_str());
+        case QueryOp::AGGREGATE:
+            for (size_t c : cols_) {
+                out->add_column(in.col_type(c));
+            }
+            for (Aggregate& a : aggs_) {
+                out->add_column(a.out_type(a.type_ == AggType::COUNT ? 'I' : in.col_type(a.col_)));
+            }
+            return out;
+        default:
+            // the output of a join depends on its right side, see JoinSource
+            assert(false);
+            return out;
+    }
+}
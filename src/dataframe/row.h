@@ -114,6 +114,98 @@ class Row : public Object {
         return s_.col_type(idx);
     }
 
+    /**
+     * Appends the raw bytes of the given fields to a buffer. Two rows agree
+     * on those fields exactly when their encodings are equal, which makes the
+     * encoding usable as a hash key.
+     * @arg cols  the indices of the fields to encode
+     * @arg buf  the buffer to append to
+     */
+    void encode(std::vector<size_t>& cols, std::vector<char>& buf) {
+        for (size_t c : cols) {
+            assert(c < s_.width());
+            const char* start;
+            size_t len;
+            switch (s_.col_type(c)) {
+                case 'S': {
+                    String* str = values_[c].payload.s;
+                    assert(str != nullptr);
+                    size_t n = str->size();
+                    start = (const char*)&n;
+                    buf.insert(buf.end(), start, start + sizeof(size_t));
+                    start = str->c_str();
+                    len = n;
+                    break;
+                }
+                case 'I':
+                    start = (const char*)&values_[c].payload.i;
+                    len = sizeof(int);
+                    break;
+                case 'D':
+                    start = (const char*)&values_[c].payload.d;
+                    len = sizeof(double);
+                    break;
+                case 'B':
+                    start = (const char*)&values_[c].payload.b;
+                    len = sizeof(bool);
+                    break;
+                default:
+                    assert(false);
+            }
+            buf.insert(buf.end(), start, start + len);
+        }
+    }
+
+    /**
+     * Sets consecutive fields from bytes produced by encode().
+     * @arg bytes  the encoded fields
+     * @arg first  the index of the first field to set
+     * @arg count  the number of fields to set
+     * @return the first byte after the decoded fields
+     */
+    const char* decode(const char* bytes, size_t first, size_t count) {
+        assert(first + count <= s_.width());
+        for (size_t c = first; c < first + count; c++) {
+            switch (s_.col_type(c)) {
+                case 'S': {
+                    size_t n;
+                    memcpy(&n, bytes, sizeof(size_t));
+                    bytes += sizeof(size_t);
+                    char* cstr = new char[n + 1];
+                    memcpy(cstr, bytes, n);
+                    cstr[n] = '\0';
+                    set(c, new String(true, cstr, n));
+                    bytes += n;
+                    break;
+                }
+                case 'I': {
+                    int v;
+                    memcpy(&v, bytes, sizeof(int));
+                    set(c, v);
+                    bytes += sizeof(int);
+                    break;
+                }
+                case 'D': {
+                    double v;
+                    memcpy(&v, bytes, sizeof(double));
+                    set(c, v);
+                    bytes += sizeof(double);
+                    break;
+                }
+                case 'B': {
+                    bool v;
+                    memcpy(&v, bytes, sizeof(bool));
+                    set(c, v);
+                    bytes += sizeof(bool);
+                    break;
+                }
+                default:
+                    assert(false);
+            }
+        }
+        return bytes;
+    }
+
     /**
      * Adds the row contents to the given columns.
      * Adds in order of the row's schema.
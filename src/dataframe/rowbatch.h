@@ -0,0 +1,246 @@
+#pragma once
+#include <assert.h>
+#include <string.h>
+
+#include <vector>
+
+#include "dataframe.h"
+#include "row.h"
+#include "store/exchange.h"
+#include "store/kdstore.h"
+#include "store/value.h"
+#include "util/hashtable.h"
+#include "util/serial.h"
+#include "visitor.h"
+
+/**
+ * A batch of length prefixed byte records, used to ship rows encoded with
+ * Row::encode between nodes. A record may be built from several parts, for
+ * instance a key followed by the row it belongs to.
+ * Author: gomes.chri, modi.an
+ */
+class RowBatch : public Object {
+   public:
+    std::vector<char> bytes_;
+    size_t count_;
+
+    RowBatch() : Object() {
+        count_ = 0;
+    }
+
+    virtual ~RowBatch() {}
+
+    /** The number of records in the batch. */
+    size_t size() {
+        return count_;
+    }
+
+    /** Appends a record. */
+    void add(const char* rec, size_t len) {
+        add_len_(len);
+        bytes_.insert(bytes_.end(), rec, rec + len);
+        count_++;
+    }
+
+    /** Appends a record made of two parts. */
+    void add(const char* a, size_t alen, const char* b, size_t blen) {
+        add_len_(alen + blen);
+        bytes_.insert(bytes_.end(), a, a + alen);
+        bytes_.insert(bytes_.end(), b, b + blen);
+        count_++;
+    }
+
+    /** Appends the given fields of a row as one record. */
+    void add(Row& r, std::vector<size_t>& cols) {
+        size_t at = bytes_.size();
+        add_len_(0);
+        r.encode(cols, bytes_);
+        size_t len = bytes_.size() - at - sizeof(size_t);
+        memcpy(bytes_.data() + at, &len, sizeof(size_t));
+        count_++;
+    }
+
+    void add_len_(size_t len) {
+        const char* p = (const char*)&len;
+        bytes_.insert(bytes_.end(), p, p + sizeof(size_t));
+    }
+
+    /** Serializes the batch: the record count, the byte count and the bytes. */
+    void serialize(Serializer* s) {
+        s->add_size_t(count_);
+        s->add_size_t(bytes_.size());
+        if (bytes_.size() > 0) {
+            s->add_buffer(bytes_.data(), bytes_.size());
+        }
+    }
+};
+
+/**
+ * Walks the records of a serialized RowBatch without copying them. The
+ * bytes must outlive the cursor.
+ * Author: gomes.chri, modi.an
+ */
+class BatchCursor : public Object {
+   public:
+    const char* cur_;
+    size_t left_;  // records not yet returned
+
+    BatchCursor(const char* bytes, size_t size) : Object() {
+        assert(size >= 2 * sizeof(size_t));
+        memcpy(&left_, bytes, sizeof(size_t));
+        cur_ = bytes + 2 * sizeof(size_t);
+    }
+
+    BatchCursor(Value* v) : BatchCursor(v->get_bytes(), v->size()) {}
+
+    /** Are there no more records? */
+    bool done() {
+        return left_ == 0;
+    }
+
+    /**
+     * Returns the next record.
+     * @arg len  set to the length of the record
+     * @return the record bytes
+     */
+    const char* next(size_t* len) {
+        assert(left_ > 0);
+        memcpy(len, cur_, sizeof(size_t));
+        const char* rec = cur_ + sizeof(size_t);
+        cur_ = rec + *len;
+        left_--;
+        return rec;
+    }
+};
+
+/**
+ * Writer that emits every record of a sequence of serialized RowBatches as
+ * a row. Each record must hold all fields of the row.
+ * Author: gomes.chri, modi.an
+ */
+class RowBatchWriter : public Writer {
+   public:
+    std::vector<Value*> batches_;  // owned
+    size_t batch_;
+    BatchCursor* cur_;
+
+    /** Takes ownership of the given batches. */
+    RowBatchWriter(std::vector<Value*> batches) : Writer(), batches_(batches) {
+        batch_ = 0;
+        cur_ = nullptr;
+    }
+
+    virtual ~RowBatchWriter() {
+        delete cur_;
+        for (Value* v : batches_) {
+            delete v;
+        }
+    }
+
+    void visit(Row& r) override {
+        size_t len;
+        const char* rec = cur_->next(&len);
+        r.decode(rec, 0, r.width());
+    }
+
+    bool done() override {
+        while (cur_ == nullptr || cur_->done()) {
+            delete cur_;
+            cur_ = nullptr;
+            if (batch_ == batches_.size()) {
+                return true;
+            }
+            cur_ = new BatchCursor(batches_[batch_++]);
+        }
+        return false;
+    }
+};
+
+/**
+ * Reader that encodes every visited row as a (key, row) record, where the
+ * key holds the given key fields and the row all fields, and adds it to the
+ * batch of its destination node.
+ * Author: gomes.chri, modi.an
+ */
+class KeyedRowCollector : public Reader {
+   public:
+    std::vector<RowBatch>& batches_;
+    std::vector<size_t> keys_;
+    std::vector<size_t> all_;
+    bool partition_;
+    std::vector<char> kbuf_;
+    std::vector<char> rbuf_;
+
+    /**
+     * @arg batches  one batch per node, or a single batch when not partitioning
+     * @arg keys  the key columns
+     * @arg width  the number of columns
+     * @arg partition  send each row to the owner of its key hash
+     */
+    KeyedRowCollector(std::vector<RowBatch>& batches, std::vector<size_t> keys, size_t width,
+                      bool partition)
+        : Reader(), batches_(batches), keys_(keys) {
+        for (size_t i = 0; i < width; i++) {
+            all_.push_back(i);
+        }
+        partition_ = partition;
+    }
+
+    void visit(Row& r) override {
+        kbuf_.clear();
+        rbuf_.clear();
+        r.encode(keys_, kbuf_);
+        r.encode(all_, rbuf_);
+        size_t dest = 0;
+        if (partition_) {
+            size_t hash = HashTable::hash_bytes(kbuf_.data(), kbuf_.size());
+            dest = (hash >> 32) % batches_.size();
+        }
+        batches_[dest].add(kbuf_.data(), kbuf_.size(), rbuf_.data(), rbuf_.size());
+    }
+};
+
+/**
+ * Reader that adds every visited row, with all its fields, to a batch.
+ * Author: gomes.chri, modi.an
+ */
+class RowCollector : public Reader {
+   public:
+    RowBatch& batch_;
+    std::vector<size_t> all_;
+
+    RowCollector(RowBatch& batch, size_t width) : Reader(), batch_(batch) {
+        for (size_t i = 0; i < width; i++) {
+            all_.push_back(i);
+        }
+    }
+
+    void visit(Row& r) override {
+        batch_.add(r, all_);
+    }
+};
+
+/**
+ * Stores the rows of every node, in node order, as a frame at a key. Each
+ * node writes its own rows to segments it keeps, and only the metadata is
+ * gathered on the home node of the key (see KDStore::commit). Every node
+ * must call it.
+ * @arg k  the key to store the frame at
+ * @arg kd  the store
+ * @arg name  the name of the exchange, which must not be reused
+ * @arg types  the types of the columns
+ * @arg rows  the rows of this node, each record holding every field
+ * @arg bounds  the range partitions of the rows, where partition i holds the
+ *   rows of node i, or nullptr; owned
+ * @return the frame, owned by the caller
+ */
+inline DataFrame* store_rows(Key* k, KDStore* kd, const char* name, const char* types,
+                             RowBatch& rows, RangePartitions* bounds = nullptr) {
+    Serializer s;
+    rows.serialize(&s);
+    RowBatchWriter writer(std::vector<Value*>(1, new Value(s.get_bytes(), s.size())));
+    DataFrame* part = DataFrame::fromVisitor(kd->get_kvstore(), types, writer, true);
+    DataFrame* result = kd->commit(*k, name, part, bounds);
+    delete part;
+    return result;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <vector>
+
+#include "schema.h"
+#include "util/object.h"
+#include "visitor.h"
+
+/**
+ * Anything that holds rows of a fixed schema spread over the nodes: a data
+ * frame, or a stage of a query that produces its rows on the fly. Operators
+ * that move rows between nodes read their input through this interface.
+ * Author: gomes.chri, modi.an
+ */
+class RowSource : public Object {
+   public:
+    RowSource() : Object() {}
+
+    virtual ~RowSource() {}
+
+    /** The schema of the rows. */
+    virtual Schema& get_schema() = 0;
+
+    /**
+     * The number of rows over all nodes, or an upper bound on it when it is
+     * not known before the rows are produced. Every node gets the same answer.
+     */
+    virtual size_t nrows() = 0;
+
+    /**
+     * Visits the rows held by this node.
+     * @arg v  the reader to use
+     */
+    virtual void local_map(Reader& v) = 0;
+
+    /**
+     * Visits the rows held by this node with several readers in one pass.
+     * Each row is produced once and handed to every reader in turn, in
+     * order; the readers must not change it.
+     * @arg readers  the readers, external
+     */
+    void local_map_all(std::vector<Reader*> readers) {
+        ReaderGroup group(readers);
+        local_map(group);
+    }
+};
@@ -85,6 +85,16 @@ class Schema : public Object {
         return num_rows_;
     }
 
+    /** The column types as a string, owned by the caller. */
+    String* types() {
+        StrBuff buf;
+        for (char type : col_types_) {
+            char t[2] = {type, '\0'};
+            buf.c(t);
+        }
+        return buf.get();
+    }
+
     void serialize(Serializer* s) {
         s->add_size_t(width());
         for(size_t i = 0; i < width(); i++) {
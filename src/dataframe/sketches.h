@@ -0,0 +1,191 @@
+#pragma once
+#include <assert.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "row.h"
+#include "rowsource.h"
+#include "schema.h"
+#include "store/exchange.h"
+#include "store/kvstore.h"
+#include "util/sketch.h"
+#include "visitor.h"
+
+static const size_t SKETCH_HLL_PRECISION = 12;  // 4096 registers, about 1.6% error
+static const size_t SKETCH_CM_WIDTH = 2048;
+static const size_t SKETCH_CM_DEPTH = 4;
+static const size_t SKETCH_TOP_COUNTERS = 64;  // monitored values, at least
+
+/**
+ * Approximate statistics of one column of a RowSource: the number of
+ * distinct values (HyperLogLog), how often a value occurs (Count-Min) and
+ * the most frequent values (Space-Saving). Every node sketches the rows it
+ * holds; only the sketches cross the network, to be merged on node 0 and
+ * sent back, so that every node ends up with the same answer. Running it is
+ * a collective operation.
+ * Author: gomes.chri, modi.an
+ */
+class ColumnSketch : public Reader {
+   public:
+    size_t col_;
+    char type_;
+    HyperLogLog* distinct_;
+    CountMin* counts_;
+    SpaceSaving* top_;
+    size_t k_;
+    std::vector<size_t> cols_;
+    std::vector<char> buf_;
+
+    /**
+     * @arg col  the column to sketch
+     * @arg type  its type
+     * @arg k  how many of the most frequent values to keep
+     */
+    ColumnSketch(size_t col, char type, size_t k) : Reader(), col_(col), type_(type), k_(k) {
+        distinct_ = new HyperLogLog(SKETCH_HLL_PRECISION);
+        counts_ = new CountMin(SKETCH_CM_WIDTH, SKETCH_CM_DEPTH);
+        // monitoring more values than are reported keeps newcomers, whose
+        // counts start out inflated, out of the top
+        top_ = new SpaceSaving(std::max(k * 4, SKETCH_TOP_COUNTERS));
+        cols_.push_back(col);
+    }
+
+    virtual ~ColumnSketch() {
+        delete distinct_;
+        delete counts_;
+        delete top_;
+    }
+
+    /** Adds the value of a row to the sketches. */
+    void visit(Row& r) override {
+        buf_.clear();
+        r.encode(cols_, buf_);
+        uint64_t h = sketch_hash(buf_.data(), buf_.size());
+        distinct_->add(h);
+        counts_->add(h, 1);
+        top_->add(buf_.data(), buf_.size(), 1);
+    }
+
+    /**
+     * Sketches the rows of this node, then merges the sketches of every node.
+     * @arg kv  the store
+     * @arg name  the name of the exchange, which must not be reused
+     * @arg in  the rows, external
+     */
+    void run(KVStore* kv, const char* name, RowSource* in) {
+        std::vector<ColumnSketch*> sketches(1, this);
+        run_all(kv, name, in, sketches);
+    }
+
+    /**
+     * Sketches several columns of the rows of this node in a single pass
+     * over them, then merges the sketches of every node. The sketches of
+     * all the columns travel together.
+     * @arg kv  the store
+     * @arg name  the name of the exchange, which must not be reused
+     * @arg in  the rows, external
+     * @arg sketches  the sketches, external
+     */
+    static void run_all(KVStore* kv, const char* name, RowSource* in,
+                        std::vector<ColumnSketch*>& sketches) {
+        std::vector<Reader*> readers;
+        for (ColumnSketch* sketch : sketches) {
+            assert(in->get_schema().col_type(sketch->col_) == sketch->type_);
+            readers.push_back(sketch);
+        }
+        in->local_map_all(readers);
+        size_t nodes = kv->num_nodes();
+        if (nodes == 1) {
+            return;
+        }
+        Exchange ex(kv, name);
+        if (kv->this_node() != 0) {
+            Serializer s;
+            for (ColumnSketch* sketch : sketches) {
+                sketch->serialize(&s);
+            }
+            ex.send(0, s);
+            Value* v = ex.receive(0);
+            Deserializer d(v->get_bytes(), v->size());
+            for (ColumnSketch* sketch : sketches) {
+                sketch->replace_(&d);
+            }
+            delete v;
+            return;
+        }
+        for (size_t n = 1; n < nodes; n++) {
+            Value* v = ex.receive(n);
+            Deserializer d(v->get_bytes(), v->size());
+            for (ColumnSketch* sketch : sketches) {
+                HyperLogLog distinct(&d);
+                CountMin counts(&d);
+                SpaceSaving top(&d);
+                sketch->distinct_->merge(distinct);
+                sketch->counts_->merge(counts);
+                sketch->top_->merge(top);
+            }
+            delete v;
+        }
+        Serializer s;
+        for (ColumnSketch* sketch : sketches) {
+            sketch->serialize(&s);
+        }
+        for (size_t n = 1; n < nodes; n++) {
+            ex.send(n, s);
+        }
+    }
+
+    /** Replaces the sketches by the serialized ones. */
+    void replace_(Deserializer* d) {
+        delete distinct_;
+        delete counts_;
+        delete top_;
+        distinct_ = new HyperLogLog(d);
+        counts_ = new CountMin(d);
+        top_ = new SpaceSaving(d);
+    }
+
+    void serialize(Serializer* s) {
+        distinct_->serialize(s);
+        counts_->serialize(s);
+        top_->serialize(s);
+    }
+
+    /** Estimates the number of distinct values. */
+    size_t distinct() {
+        return (size_t)(distinct_->estimate() + 0.5);
+    }
+
+    /**
+     * Estimates how often a value occurs, never under.
+     * @arg r  a row holding the value
+     * @arg col  the field of the row holding it
+     */
+    size_t frequency(Row& r, size_t col) {
+        assert(r.col_type(col) == type_);
+        std::vector<size_t> cols(1, col);
+        std::vector<char> buf;
+        r.encode(cols, buf);
+        return counts_->estimate(sketch_hash(buf.data(), buf.size()));
+    }
+
+    /**
+     * Visits the k most frequent values, most frequent first, as rows
+     * (value, count). The count may be over by as much as the count of the
+     * least frequent value monitored.
+     * @arg v  the reader
+     */
+    void top(Reader& v) {
+        char types[] = {type_, 'I', '\0'};
+        Schema s(types);
+        Row r(s);
+        std::vector<SpaceSavingItem> items = top_->top();
+        for (size_t i = 0; i < k_ && i < items.size(); i++) {
+            SpaceSavingItem& item = items[i];
+            r.decode(item.key_.data(), 0, 1);
+            r.set(1, (int)item.count_);
+            v.visit(r);
+        }
+    }
+};
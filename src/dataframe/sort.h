@@ -0,0 +1,329 @@
+#pragma once
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "dataframe.h"
+#include "partitions.h"
+#include "row.h"
+#include "rowbatch.h"
+#include "store/exchange.h"
+#include "store/kdstore.h"
+#include "visitor.h"
+
+// the number of sort keys each node contributes to choose the splitters
+static const size_t SORT_SAMPLES_PER_NODE = 64;
+
+/**
+ * Maps an encoded int, double or bool field to an unsigned integer with the
+ * same order, so that numeric keys can be radix sorted.
+ * @arg type  the type of the field
+ * @arg p  the encoded field
+ * @return the radix key
+ */
+inline uint64_t radix_key(char type, const char* p) {
+    switch (type) {
+        case 'I': {
+            uint32_t bits;
+            memcpy(&bits, p, sizeof(uint32_t));
+            return bits ^ 0x80000000u;
+        }
+        case 'D': {
+            uint64_t bits;
+            memcpy(&bits, p, sizeof(uint64_t));
+            // negatives reverse their order, positives go above them
+            return (bits >> 63) ? ~bits : bits | (1ULL << 63);
+        }
+        case 'B':
+            return *p != 0;
+        default:
+            assert(false);
+            return 0;
+    }
+}
+
+/**
+ * Stable least significant digit radix sort, one byte per pass. Passes
+ * where every key has the same byte are skipped.
+ * @arg keys  the keys, keys[i] belongs to items[i]
+ * @arg items  the items, reordered along with their keys
+ */
+inline void radix_sort(std::vector<uint64_t>& keys, std::vector<size_t>& items) {
+    assert(keys.size() == items.size());
+    size_t n = keys.size();
+    std::vector<uint64_t> keys_to(n);
+    std::vector<size_t> items_to(n);
+    for (size_t shift = 0; shift < 64; shift += 8) {
+        size_t counts[257] = {0};
+        for (size_t i = 0; i < n; i++) {
+            counts[((keys[i] >> shift) & 0xff) + 1]++;
+        }
+        bool trivial = false;
+        for (size_t b = 1; b <= 256; b++) {
+            trivial = trivial || counts[b] == n;
+        }
+        if (trivial) continue;
+        for (size_t b = 1; b <= 256; b++) {
+            counts[b] += counts[b - 1];
+        }
+        for (size_t i = 0; i < n; i++) {
+            size_t at = counts[(keys[i] >> shift) & 0xff]++;
+            keys_to[at] = keys[i];
+            items_to[at] = items[i];
+        }
+        keys.swap(keys_to);
+        items.swap(items_to);
+    }
+}
+
+/**
+ * A set of records whose leading bytes are a sort key encoded by
+ * Row::encode, sorted without moving the records themselves.
+ * Author: gomes.chri, modi.an
+ */
+class SortRecords : public Object {
+   public:
+    const char* types_;  // external
+    size_t ncols_;
+    std::vector<const char*> recs_;  // external
+    std::vector<size_t> lens_;
+
+    SortRecords(const char* types) : Object() {
+        types_ = types;
+        ncols_ = strlen(types);
+    }
+
+    virtual ~SortRecords() {}
+
+    /** Adds a record, which must outlive this object. */
+    void add(const char* rec, size_t len) {
+        recs_.push_back(rec);
+        lens_.push_back(len);
+    }
+
+    /** The number of records. */
+    size_t size() {
+        return recs_.size();
+    }
+
+    /** The number of bytes the sort key of a record takes. */
+    size_t key_size(size_t i) {
+        const char* p = recs_[i];
+        for (size_t c = 0; c < ncols_; c++) {
+            p += encoded_size(types_[c], p);
+        }
+        return p - recs_[i];
+    }
+
+    /**
+     * Sorts the records by their keys, stably. Goes one key column at a
+     * time, least significant first: numeric columns are radix sorted and
+     * string columns merge sorted.
+     * @return the record numbers in sorted order
+     */
+    std::vector<size_t> sort() {
+        size_t n = size();
+        std::vector<size_t> order(n);
+        std::vector<const char*> fields(recs_);
+        std::vector<std::vector<const char*>> at(ncols_);
+        for (size_t c = 0; c < ncols_; c++) {
+            at[c] = fields;
+            for (size_t i = 0; i < n; i++) {
+                fields[i] += encoded_size(types_[c], fields[i]);
+            }
+        }
+        for (size_t i = 0; i < n; i++) {
+            order[i] = i;
+        }
+        for (size_t c = ncols_; c-- > 0;) {
+            std::vector<const char*>& col = at[c];
+            if (types_[c] == 'S') {
+                const char* type = types_ + c;
+                std::stable_sort(order.begin(), order.end(), [&col, type](size_t a, size_t b) {
+                    return compare_encoded(col[a], col[b], type, 1) < 0;
+                });
+            } else {
+                std::vector<uint64_t> keys(n);
+                for (size_t i = 0; i < n; i++) {
+                    keys[i] = radix_key(types_[c], col[order[i]]);
+                }
+                radix_sort(keys, order);
+            }
+        }
+        return order;
+    }
+};
+
+/**
+ * A distributed sample sort of a data frame. Sorting is a collective
+ * operation: every node must run it with the same arguments.
+ * Every node samples the sort keys of its local rows and the samples of all
+ * nodes pick one splitter per node boundary, so node p receives the rows
+ * whose keys lie between splitters p - 1 and p. Each node sorts the rows it
+ * receives and writes them to its own segments. Only the metadata of the
+ * sorted ranges goes to the home node of the output key, which stitches
+ * them in node order and records their RangePartitions (see store_rows).
+ * Author: gomes.chri, modi.an
+ */
+class Sort : public Object {
+   public:
+    DataFrame* df_;
+    std::vector<size_t> cols_;
+    String* types_;  // the types of the sort columns
+
+    /**
+     * @arg df  the frame to sort, external
+     * @arg cols  the sort columns, most significant first
+     */
+    Sort(DataFrame* df, std::vector<size_t> cols) : Object(), cols_(cols) {
+        assert(df != nullptr && cols.size() > 0);
+        df_ = df;
+        StrBuff types;
+        for (size_t c : cols_) {
+            assert(c < df->ncols());
+            char t[2] = {df->col_type(c), '\0'};
+            types.c(t);
+        }
+        types_ = types.get();
+    }
+
+    virtual ~Sort() {
+        delete types_;
+    }
+
+    /**
+     * Chooses the splitters from the key samples of every node. Each sample
+     * batch holds sort keys only.
+     * @arg ex  the exchange the samples arrive through
+     * @arg bounds  gets one partition per node, or a single one if there is
+     *   nothing to sort, with no rows yet
+     */
+    void choose_splitters_(Exchange& ex, RangePartitions& bounds, size_t nodes) {
+        std::vector<Value*> samples;
+        std::vector<const char*> keys;
+        std::vector<size_t> lens;
+        for (size_t n = 0; n < nodes; n++) {
+            samples.push_back(ex.receive(n));
+            BatchCursor cur(samples.back());
+            while (!cur.done()) {
+                size_t len;
+                keys.push_back(cur.next(&len));
+                lens.push_back(len);
+            }
+        }
+        std::vector<size_t> order(keys.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        const char* types = types_->c_str();
+        size_t ncols = cols_.size();
+        std::sort(order.begin(), order.end(), [&keys, types, ncols](size_t a, size_t b) {
+            int c = compare_encoded(keys[a], keys[b], types, ncols);
+            return c < 0 || (c == 0 && a < b);
+        });
+        // with nothing to sort there is a single, empty partition
+        bounds.add(0, nullptr, 0);
+        for (size_t p = 1; p < nodes && order.size() > 0; p++) {
+            size_t s = order[p * order.size() / nodes];
+            bounds.add(0, keys[s], lens[s]);
+        }
+        for (Value* v : samples) {
+            delete v;
+        }
+    }
+
+    /**
+     * Runs the sort and stores the result. The name of the key must not be
+     * reused by another collective operation.
+     * @arg k  the key to store the result at
+     * @arg kd  the store
+     * @return the result frame, owned by the caller
+     */
+    DataFrame* run(Key* k, KDStore* kd) {
+        KVStore* kv = kd->get_kvstore();
+        size_t nodes = kv->num_nodes();
+        String* sname = StrBuff().c(k->k_.c_str()).c("~ss").get();
+        String* xname = StrBuff().c(k->k_.c_str()).c("~sx").get();
+        String* oname = StrBuff().c(k->k_.c_str()).c("~so").get();
+        Exchange sex(kv, sname->c_str());
+        Exchange xex(kv, xname->c_str());
+
+        // encode the local rows as (sort key, row) records
+        std::vector<RowBatch> local(1);
+        KeyedRowCollector collector(local, cols_, df_->ncols(), false);
+        df_->local_map(collector);
+        Serializer ls;
+        local[0].serialize(&ls);
+        SortRecords records(types_->c_str());
+        BatchCursor lcur(ls.get_bytes(), ls.size());
+        while (!lcur.done()) {
+            size_t len;
+            const char* rec = lcur.next(&len);
+            records.add(rec, len);
+        }
+
+        // share evenly spaced samples of the local keys with every node
+        RowBatch sample;
+        size_t step = records.size() / SORT_SAMPLES_PER_NODE + 1;
+        for (size_t i = step / 2; i < records.size(); i += step) {
+            sample.add(records.recs_[i], records.key_size(i));
+        }
+        Serializer ss;
+        sample.serialize(&ss);
+        for (size_t n = 0; n < nodes; n++) {
+            sex.send(n, ss);
+        }
+        RangePartitions* bounds = new RangePartitions(cols_, types_->c_str());
+        choose_splitters_(sex, *bounds, nodes);
+
+        // send every local record to the node owning its key range
+        std::vector<RowBatch> outgoing(nodes);
+        for (size_t i = 0; i < records.size(); i++) {
+            outgoing[bounds->partition_of(records.recs_[i])].add(records.recs_[i],
+                                                                 records.lens_[i]);
+        }
+        for (size_t n = 0; n < nodes; n++) {
+            Serializer s;
+            outgoing[n].serialize(&s);
+            xex.send(n, s);
+        }
+
+        // sort the records of this node's range and strip their keys
+        std::vector<Value*> incoming;
+        SortRecords mine(types_->c_str());
+        for (size_t n = 0; n < nodes; n++) {
+            incoming.push_back(xex.receive(n));
+            BatchCursor cur(incoming.back());
+            while (!cur.done()) {
+                size_t len;
+                const char* rec = cur.next(&len);
+                mine.add(rec, len);
+            }
+        }
+        RowBatch sorted;
+        for (size_t i : mine.sort()) {
+            size_t klen = mine.key_size(i);
+            sorted.add(mine.recs_[i] + klen, mine.lens_[i] - klen);
+        }
+        for (Value* v : incoming) {
+            delete v;
+        }
+
+        // keep the sorted range here and stitch the ranges together
+        String* types = df_->get_schema().types();
+        DataFrame* result = store_rows(k, kd, oname->c_str(), types->c_str(), sorted, bounds);
+        delete types;
+        delete sname;
+        delete xname;
+        delete oname;
+        return result;
+    }
+};
+
+inline DataFrame* DataFrame::sort_by(Key* k, KDStore* kd, std::vector<size_t> cols) {
+    Sort s(this, cols);
+    return s.run(k, kd);
+}
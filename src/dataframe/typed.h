@@ -0,0 +1,232 @@
+#pragma once
+#include <assert.h>
+
+#include <tuple>
+#include <vector>
+
+#include "column.h"
+#include "dataframe.h"
+#include "util/data.h"
+#include "util/string.h"
+
+/**
+ * What a C++ type is stored as in a data frame: the column type, and the
+ * type and payload of a cell. One specialization per column type.
+ * Author: gomes.chri, modi.an
+ */
+template <typename T>
+struct ColumnTraits;
+
+template <>
+struct ColumnTraits<int> {
+    typedef int cell;
+    static char type() {
+        return 'I';
+    }
+    static int load(Data& d) {
+        return d.payload.i;
+    }
+};
+
+template <>
+struct ColumnTraits<double> {
+    typedef double cell;
+    static char type() {
+        return 'D';
+    }
+    static double load(Data& d) {
+        return d.payload.d;
+    }
+};
+
+template <>
+struct ColumnTraits<bool> {
+    typedef bool cell;
+    static char type() {
+        return 'B';
+    }
+    static bool load(Data& d) {
+        return d.payload.b;
+    }
+};
+
+template <>
+struct ColumnTraits<String> {
+    typedef String* cell;  // owned by the segment it was read from
+    static char type() {
+        return 'S';
+    }
+    static String* load(Data& d) {
+        return d.payload.s;
+    }
+};
+
+/**
+ * Reads the cells of one column straight out of the segment it has loaded,
+ * loading another segment only when asked for a row outside of it.
+ * Author: gomes.chri, modi.an
+ */
+template <typename T>
+class TypedCursor {
+   public:
+    Column* col_;  // external
+    size_t begin_;
+    size_t end_;
+    Data* items_;  // the items of the loaded segment from the one at row begin_
+                   // of the segments, which start offset_ rows before the column
+
+    TypedCursor() : col_(nullptr), begin_(0), end_(0), items_(nullptr) {}
+
+    /** Reads the given column, which must hold cells of type T. */
+    void bind(Column* col) {
+        assert(col->get_type() == ColumnTraits<T>::type());
+        col_ = col;
+        begin_ = end_ = 0;
+    }
+
+    /** Gets the cell at the given row. */
+    typename ColumnTraits<T>::cell at(size_t idx) {
+        idx += col_->offset_;
+        if (idx < begin_ || idx >= end_) {
+            load_(idx);
+        }
+        return ColumnTraits<T>::load(items_[idx - begin_]);
+    }
+
+    void load_(size_t idx) {
+        size_t seg = col_->segment_of_(idx);
+        col_->cache_segment_(seg);
+        begin_ = col_->table_->starts_[seg];
+        end_ = col_->segment_end_(seg);
+        items_ = col_->cache_->items_ + col_->table_->bases_[seg];
+    }
+};
+
+/**
+ * Steps through the columns of a typed frame at compile time, the I first
+ * ones at a time.
+ */
+template <size_t I>
+struct TypedColumns_ {
+    template <typename Cursors>
+    static void bind(Cursors& cursors, std::vector<Column*>& cols) {
+        TypedColumns_<I - 1>::bind(cursors, cols);
+        std::get<I - 1>(cursors).bind(cols[I - 1]);
+    }
+
+    template <typename Cursors, typename Cells>
+    static void fill(Cursors& cursors, Cells& cells, size_t idx) {
+        TypedColumns_<I - 1>::fill(cursors, cells, idx);
+        std::get<I - 1>(cells) = std::get<I - 1>(cursors).at(idx);
+    }
+};
+
+template <>
+struct TypedColumns_<0> {
+    template <typename Cursors>
+    static void bind(Cursors& cursors, std::vector<Column*>& cols) {}
+
+    template <typename Cursors, typename Cells>
+    static void fill(Cursors& cursors, Cells& cells, size_t idx) {}
+};
+
+/**
+ * A row of a TypedDataFrame. Cell I has the type the frame was opened with
+ * and is read with get<I>(), without any check at run time. Strings belong
+ * to the frame and are only valid while the row is visited.
+ * Author: gomes.chri, modi.an
+ */
+template <typename... Ts>
+class TypedRow : public Object {
+   public:
+    typedef std::tuple<typename ColumnTraits<Ts>::cell...> Cells;
+
+    template <size_t I>
+    using cell = typename std::tuple_element<I, Cells>::type;
+
+    Cells cells_;
+
+    TypedRow() : Object() {}
+
+    /** Gets cell I. */
+    template <size_t I>
+    cell<I> get() {
+        return std::get<I>(cells_);
+    }
+};
+
+/**
+ * A data frame whose column types are known at compile time, for instance
+ * TypedDataFrame<int, int, String>. The schema is checked once, when the
+ * frame is opened. After that, cells are read straight out of the loaded
+ * segments, and visitors are called directly rather than through a virtual
+ * visit, so they can be inlined. A visitor is any class with a
+ * visit(TypedRow<Ts...>&) method.
+ * Author: gomes.chri, modi.an
+ */
+template <typename... Ts>
+class TypedDataFrame : public Object {
+   public:
+    template <size_t I>
+    using cell = typename TypedRow<Ts...>::template cell<I>;
+
+    DataFrame* df_;  // owned copy of the metadata, so its segment caches are ours
+    std::tuple<TypedCursor<Ts>...> cursors_;
+
+    /**
+     * Opens a data frame. Its columns must have the types Ts.
+     * @arg df  the frame, external
+     */
+    TypedDataFrame(DataFrame& df) : Object() {
+        assert(df.ncols() == sizeof...(Ts));
+        df_ = new DataFrame(df);
+        TypedColumns_<sizeof...(Ts)>::bind(cursors_, df_->columns_);
+    }
+
+    virtual ~TypedDataFrame() {
+        delete df_;
+    }
+
+    /** The number of rows. */
+    size_t nrows() {
+        return df_->nrows();
+    }
+
+    /**
+     * Gets the cell of column I at the given row. Strings belong to the
+     * frame and are only valid until another cell of their column is read.
+     */
+    template <size_t I>
+    cell<I> get(size_t row) {
+        assert(row < nrows());
+        return std::get<I>(cursors_).at(row);
+    }
+
+    /**
+     * Visits every row, in order.
+     * @arg v  the visitor
+     */
+    template <typename V>
+    void map(V& v) {
+        TypedRow<Ts...> r;
+        size_t n = nrows();
+        for (size_t i = 0; i < n; i++) {
+            TypedColumns_<sizeof...(Ts)>::fill(cursors_, r.cells_, i);
+            v.visit(r);
+        }
+    }
+
+    /**
+     * Visits the rows held by this node.
+     * @arg v  the visitor
+     */
+    template <typename V>
+    void local_map(V& v) {
+        TypedRow<Ts...> r;
+        std::vector<size_t> indices = df_->columns_[0]->local_indices();
+        for (size_t i : indices) {
+            TypedColumns_<sizeof...(Ts)>::fill(cursors_, r.cells_, i);
+            v.visit(r);
+        }
+    }
+};
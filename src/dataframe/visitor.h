@@ -1,4 +1,6 @@
 #pragma once
+#include <vector>
+
 #include "util/object.h"
 
 class Row;
@@ -45,3 +47,22 @@ class Reader : public Object {
      */
     virtual void visit(Row &r) {}
 };
+
+/**
+ * Reader that hands every row it visits to several readers in turn, so that
+ * a single pass over the rows serves all of them. The readers must not
+ * change the row.
+ * Author: gomes.chri, modi.an
+ */
+class ReaderGroup : public Reader {
+   public:
+    std::vector<Reader *> readers_;  // external
+
+    ReaderGroup(std::vector<Reader *> readers) : Reader(), readers_(readers) {}
+
+    void visit(Row &r) override {
+        for (Reader *v : readers_) {
+            v->visit(r);
+        }
+    }
+};
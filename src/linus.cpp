@@ -1,7 +1,6 @@
-#include <unordered_set>
-
 #include "application/application.h"
 #include "dataframe/dataframe.h"
+#include "store/snapshot.h"
 #include "util/string.h"
 
 /**
@@ -23,13 +22,13 @@
 /**************************************************************************
  * A bit set contains size() booleans that are initialize to false and can
  * be set to true with the set() method. The test() method returns the
- * value. Does not grow.
+ * value. Does not grow. The values are held in a compressed bitmap, so that
+ * sets can be merged across nodes without going through data frames.
  ************************************************************************/
 class Set {
    public:
-    std::unordered_set<size_t> vals_;  // owned; data
-    size_t size_;                      // number of elements
-    size_t num_items_;
+    Bitmap vals_;  // owned; data
+    size_t size_;  // number of elements
 
     /** Creates a set of the same size as the dataframe. */
     Set(DataFrame* df) : Set(df->nrows()) {}
@@ -45,137 +44,31 @@ class Set {
      */
     void set(size_t idx) {
         if (idx >= size_) return;  // ignoring out of bound writes
-        vals_.insert(idx);
+        vals_.add(idx);
     }
 
     /** Is idx in the set?  See comment for set(). */
     bool test(size_t idx) {
         if (idx >= size_) return true;  // ignoring out of bound reads
-        return vals_.find(idx) != vals_.end();
+        return vals_.contains(idx);
     }
 
     size_t size() {
-        return vals_.size();
+        return vals_.cardinality();
     }
 
     /** Performs set union in place. */
     void union_(Set& from) {
-        for (size_t i : from.vals_) {
-            set(i);
-        }
-    }
-};
-
-/*******************************************************************************
- * A SetUpdater is a reader that gets the first column of the data frame and
- * sets the corresponding value in the given set.
- ******************************************************************************/
-class SetUpdater : public Reader {
-   public:
-    Set& set_;  // set to update
-
-    SetUpdater(Set& set) : set_(set) {}
-
-    /** Assume a row with at least one column of type I. Assumes that there
-     * are no missing. Reads the value and sets the corresponding position.
-     * The return value is irrelevant here. */
-    void visit(Row& row) {
-        set_.set(row.get_int(0));
-    }
-};
-
-/*****************************************************************************
- * A SetWriter copies all the values present in the set into a one-column
- * dataframe. The data contains all the values in the set. The dataframe has
- * at least one integer column.
- ****************************************************************************/
-class SetWriter : public Writer {
-   public:
-    Set& set_;      // set to read from
-    size_t i_ = 0;  // position in set
-
-    SetWriter(Set& set) : set_(set) {}
-
-    /** Skip over false values and stop when the entire set has been seen */
-    bool done() {
-        while (i_ < set_.size_ && set_.test(i_) == false) ++i_;
-        return i_ == set_.size_;
-    }
-
-    void visit(Row& row) {
-        int val = i_;
-        row.set(0, val);
-        i_++;
-    }
-};
-
-/***************************************************************************
- * The ProjectTagger is a reader that is mapped over commits, and marks all
- * of the projects to which a collaborator of Linus committed as an author.
- * The commit dataframe has the form:
- *    pid x uid x uid
- * where the pid is the identifier of a project and the uids are the
- * identifiers of the author and committer. If the author is a collaborator
- * of Linus, then the project is added to the set. If the project was
- * already tagged then it is not added to the set of newProjects.
- *************************************************************************/
-class ProjectsTagger : public Reader {
-   public:
-    Set& uSet;        // set of collaborator
-    Set& pSet;        // set of projects of collaborators
-    Set newProjects;  // newly tagged collaborator projects
-
-    ProjectsTagger(Set& uSet, Set& pSet, DataFrame* proj)
-        : uSet(uSet), pSet(pSet), newProjects(proj) {}
-
-    /** The data frame must have at least two integer columns. The newProject
-     * set keeps track of projects that were newly tagged (they will have to
-     * be communicated to other nodes). */
-    void visit(Row& row) override {
-        int pid = row.get_int(0);
-        int uid = row.get_int(1);
-        if (uSet.test(uid)) {
-            if (!pSet.test(pid)) {
-                pSet.set(pid);
-                newProjects.set(pid);
-            }
-        }
-    }
-};
-
-/***************************************************************************
- * The UserTagger is a reader that is mapped over commits, and marks all of
- * the users which commmitted to a project to which a collaborator of Linus
- * also committed as an author. The commit dataframe has the form:
- *    pid x uid x uid
- * where the pid is the idefntifier of a project and the uids are the
- * identifiers of the author and committer.
- *************************************************************************/
-class UsersTagger : public Reader {
-   public:
-    Set& pSet;
-    Set& uSet;
-    Set newUsers;
-
-    UsersTagger(Set& pSet, Set& uSet, DataFrame* users)
-        : pSet(pSet), uSet(uSet), newUsers(users->nrows()) {}
-
-    void visit(Row& row) override {
-        int pid = row.get_int(0);
-        int uid = row.get_int(1);
-        if (pSet.test(pid)) {
-            if (!uSet.test(uid)) {
-                uSet.set(uid);
-                newUsers.set(uid);
-            }
-        }
+        vals_.union_with(from.vals_);
     }
 };
 
 /*************************************************************************
  * This computes the collaborators of Linus Torvalds.
  * is the linus example using the adapter.  And slightly revised
- *   algorithm that only ever trades the deltas.
+ *   algorithm that only ever trades the deltas: each degree is two steps
+ *   of a breadth first search over the graph of commits, so it only
+ *   touches the edges of the users and projects tagged last.
  **************************************************************************/
 class Linus : public Application {
    public:
@@ -184,17 +77,27 @@ class Linus : public Application {
     const char* PROJ = "data/projects.ltgt";
     const char* USER = "data/users.ltgt";
     const char* COMM = "data/commits.ltgt";
-    DataFrame* projects;  //  pid x project name
-    DataFrame* users;     // uid x user name
-    DataFrame* commits;   // pid x uid x uid
-    Set* uSet;            // Linus' collaborators
-    Set* pSet;            // projects of collaborators
-
-    Linus(NetworkIfc& net) : Application(net) {}
+    const char* SNAP = "data/linus";  // snapshots are SNAP-<node>.snap
+    size_t CACHE = 256 << 20;         // bytes of segments from other nodes kept here
+    DataFrame* projects;   //  pid x project name
+    DataFrame* users;      // uid x user name
+    DataFrame* commits;    // pid x uid x uid
+    Set* uSet;             // Linus' collaborators
+    Set* pSet;             // projects of collaborators
+    Graph* graph;          // users, then projects, linked by the authors of commits
+    size_t otherUsers;     // the vertex of the uids that are not in users
+    size_t otherProjects;  // the vertex of the pids that are not in projects
+    Bitmap frontier;       // users added in the previous round
+    Bitmap visited;        // users and projects tagged so far
+
+    Linus(NetworkIfc& net) : Application(net) {
+        kv_.cache_remote(CACHE);
+    }
 
     ~Linus() {
         delete uSet;
         delete pSet;
+        delete graph;
         delete projects;
         delete users;
         delete commits;
@@ -208,15 +111,29 @@ class Linus : public Application {
 
     /** Node 0 reads three files, cointainng projects, users and commits, and
      *  creates thre dataframes. All other nodes wait and load the three
-     *  dataframes. Once we know the size of users and projects, we create
-     *  sets of each (uSet and pSet). We also output a data frame with a the
-     *  'tagged' users. At this point the dataframe consists of only
-     *  Linus. **/
+     *  dataframes. Every node then snapshots its store, and on the next run
+     *  the nodes load their snapshots instead, unless one of them is
+     *  missing or was built from files whose sizes or times of last change
+     *  differ from the ones here, in which case node 0 reads the files
+     *  again. Once we know
+     *  the size of users and projects, we create sets of each (uSet and
+     *  pSet), and the graph of the commits, whose vertices are the users
+     *  followed by the projects. Ids out of bound are all one vertex per
+     *  kind, which is in every frontier since the sets answer true for
+     *  them (see Set::test). The users added in the previous round are, at
+     *  this point, only Linus. **/
     void readInput() {
         Key pK("projs");
         Key uK("usrs");
         Key cK("comts");
-        if (this_node() == 0) {
+        String* snap = StrBuff().c(SNAP).c("-").c(this_node()).c(".snap").get();
+        // nodes without the files agree on their fingerprint, and node 0 has them
+        size_t inputs = snapshot_inputs({PROJ, USER, COMM});
+        bool restored = allNodes("linus~restored", load_snapshot(&kv_, snap->c_str(), inputs));
+        if (restored) {
+            pln("Restored from snapshots");
+        }
+        if (this_node() == 0 && !restored) {
             pln("Reading...");
             projects = DataFrame::fromSorFile(&pK, &kd_, PROJ);
             p("    ").p(projects->nrows()).pln(" projects");
@@ -224,9 +141,6 @@ class Linus : public Application {
             p("    ").p(users->nrows()).pln(" users");
             commits = DataFrame::fromSorFile(&cK, &kd_, COMM);
             p("    ").p(commits->nrows()).pln(" commits");
-            Key scalar("users-0-0");
-            // This dataframe contains the id of Linus.
-            delete DataFrame::fromScalar(&scalar, &kd_, LINUS);
         } else {
             projects = kd_.waitAndGet(pK);
             pln("received projects");
@@ -235,80 +149,75 @@ class Linus : public Application {
             commits = kd_.waitAndGet(cK);
             pln("received commits");
         }
+        if (!restored) {
+            // node 0 answers once it has put every segment, which arrive first
+            allNodes("linus~loaded", true);
+            save_snapshot(&kv_, snap->c_str(), inputs);
+        }
+        delete snap;
         uSet = new Set(users);
         pSet = new Set(projects);
+        EdgeEnd uids = {1, 0, users->nrows(), true};
+        EdgeEnd pids = {0, uids.end(), projects->nrows(), true};
+        graph = new Graph(&kv_, "commits", commits, uids, pids);
+        otherUsers = uids.end() - 1;
+        otherProjects = pids.end() - 1;
+        visited.add(otherUsers);
+        visited.add(otherProjects);
+        frontier.add(LINUS);
+        frontier.add(otherUsers);
     }
 
-    /** Performs a step of the linus calculation. It operates over the three
-     *  datafrrames (projects, users, commits), the sets of tagged users and
-     *  projects, and the users added in the previous round. */
+    /** Node 0 gathers a flag from every node and tells them all whether
+     *  every one of them set it. Every node must call it. **/
+    bool allNodes(const char* name, bool mine) {
+        Exchange ex(&kv_, name);
+        if (this_node() != 0) {
+            Serializer s;
+            s.add_bool(mine);
+            ex.send(0, s);
+            Value* v = ex.receive(0);
+            Deserializer d(v->get_bytes(), v->size());
+            bool result = d.get_bool();
+            delete v;
+            return result;
+        }
+        bool result = mine;
+        for (size_t i = 1; i < kv_.num_nodes(); i++) {
+            Value* v = ex.receive(i);
+            Deserializer d(v->get_bytes(), v->size());
+            result = d.get_bool() && result;
+            delete v;
+        }
+        Serializer s;
+        s.add_bool(result);
+        for (size_t i = 1; i < kv_.num_nodes(); i++) {
+            ex.send(i, s);
+        }
+        return result;
+    }
+
+    /** Performs a step of the linus calculation. It tags the projects of
+     *  the users added in the previous round, then the users of those
+     *  projects. **/
     void step(int stage) {
         p("Stage ").pln(stage);
-        // Key of the shape: users-stage-0
-        String* tmp = StrBuff().c("users-").c(stage).c("-0").get();
-        Key uK(tmp->c_str());
-        delete tmp;
-        // A df with all the users added on the previous round
-        DataFrame* newUsers = (kd_.waitAndGet(uK));
-        Set delta(users);
-        SetUpdater upd(delta);
-        newUsers->map(upd);  // all of the new users are copied to delta.
-        delete newUsers;
-        ProjectsTagger ptagger(delta, *pSet, projects);
-        commits->local_map(ptagger);  // marking all projects touched by delta
-        merge(ptagger.newProjects, "projects-", stage);
-        pSet->union_(ptagger.newProjects);  //
-        UsersTagger utagger(ptagger.newProjects, *uSet, users);
-        commits->local_map(utagger);
-        merge(utagger.newUsers, "users-", stage + 1);
-        uSet->union_(utagger.newUsers);
+        graph->bfs_step(frontier, visited);
+        p("    tagged ").p(frontier.cardinality()).pln(" new projects");
+        for (uint32_t v : frontier.values()) {
+            pSet->set(v - otherUsers - 1);
+        }
+        frontier.add(otherProjects);
+        graph->bfs_step(frontier, visited);
+        p("    tagged ").p(frontier.cardinality()).pln(" new users");
+        for (uint32_t v : frontier.values()) {
+            uSet->set(v);
+        }
+        frontier.add(otherUsers);
         p("    after stage ").p(stage).pln(":");
         p("        tagged projects: ").pln(pSet->size());
         p("        tagged users: ").pln(uSet->size());
     }
-
-    /** Gather updates to the given set from all the nodes in the systems.
-     * The union of those updates is then published as dataframe.  The key
-     * used for the otuput is of the form "name-stage-0" where name is either
-     * 'users' or 'projects', stage is the degree of separation being
-     * computed.
-     */
-    void merge(Set& set, char const* name, int stage) {
-        if (this_node() == 0) {
-            for (size_t i = 1; i < num_nodes(); ++i) {
-                String* str = StrBuff().c(name).c(stage).c("-").c(i).get();
-                Key nK(str->c_str());
-                delete str;
-                DataFrame* delta = kd_.waitAndGet(nK);
-                p("    received delta of ").p(delta->nrows()).p(" elements from node ").pln(i);
-                SetUpdater upd(set);
-                delta->map(upd);
-                delete delta;
-            }
-            p("    storing ").p(set.size()).pln(" merged elements");
-            SetWriter writer(set);
-            String* tmp = StrBuff().c(name).c(stage).c("-0").get();
-            Key k(tmp->c_str());
-            delete tmp;
-            delete DataFrame::fromVisitor(&k, &kd_, "I", writer);
-        } else {
-            p("    sending ").p(set.size()).pln(" elements to master node");
-            SetWriter writer(set);
-            String* tmp = StrBuff().c(name).c(stage).c("-").c(this_node()).get();
-            Key k(tmp->c_str());
-            delete tmp;
-            delete DataFrame::fromVisitor(&k, &kd_, "I", writer);
-
-            String* tmp2 = StrBuff().c(name).c(stage).c("-0").get();
-            Key mK(tmp2->c_str());
-            delete tmp2;
-            DataFrame* merged = kd_.waitAndGet(mK);
-            p("    receiving ").p(merged->nrows()).pln(" merged elements");
-            SetUpdater upd(set);
-            merged->map(upd);
-            delete merged;
-        }
-    }
 };
 
 int server(int argc, char** argv) {
@@ -1,5 +1,7 @@
 #pragma once
-#include <queue>
+#include <functional>
+#include <memory>
+#include <unordered_map>
 
 #include "message.h"
 #include "network.h"
@@ -14,6 +16,31 @@
  */
 class KVStore;
 
+/** Called with the value of a reply, which it owns. */
+typedef std::function<void(Value*)> ReplyCallback;
+
+class Connection;
+
+/**
+ * The way back to the peer of a connection for replies sent later, from
+ * other threads. It outlives the connection, and replies sent through it
+ * once the connection is gone are dropped.
+ * Authors: gomes.chri@husky.neu.edu and modi.an@husky.neu.edu
+ */
+class ReplyRoute : public Object {
+   public:
+    Lock l_;
+    Connection* c_;  // external, nullptr once the connection is gone
+
+    ReplyRoute(Connection* c) : Object(), c_(c) {}
+
+    /**
+     * Sends a message to the peer unless the connection is gone.
+     * @arg m the message to be sent
+     */
+    void send_message(Message* m);
+};
+
 /**
  * Represents an active connection to another node in the network.
  * Authors: gomes.chri@husky.neu.edu and modi.an@husky.neu.edu
@@ -24,23 +51,29 @@ class Connection : public Thread {
     ConnectionSocket* s_;
     KVStore* local_store_;
     bool keep_processing_;
-    std::queue<Reply*> replies;
+    Lock pending_l_;
+    std::unordered_map<size_t, ReplyCallback> pending_;  // by the id of their request
+    std::shared_ptr<ReplyRoute> route_;  // for replies to waits, see handle_wait_and_get_message_
 
     /**
      * Constructs a connection from a socket and a kv store.
      * @arg s the Socket this connection should use
      * @arg kv a pointer to the kvstore this connection should use as a datastore
      */
-    Connection(ConnectionSocket* s, KVStore* kv) : Thread(), l_(), replies() {
+    Connection(ConnectionSocket* s, KVStore* kv) : Thread(), l_(), pending_() {
         s_ = s;
         local_store_ = kv;
         keep_processing_ = true;
+        route_ = std::make_shared<ReplyRoute>(this);
     }
 
     /**
      * Destructor for a connection.
      */
     virtual ~Connection() {
+        route_->l_.lock();
+        route_->c_ = nullptr;
+        route_->l_.unlock();
         delete s_;
     }
 
@@ -127,12 +160,58 @@ class Connection : public Thread {
     void handle_wait_and_get_message_(Deserializer& d);
 
     /**
-     * Handles a Reply message by pushing the provided message to the reply queue.
+     * Handles a MultiGet message by getting every value from the local KV and sending them all
+     * back in one reply.
+     * @arg d the deserializer containing the MultiGet message.
+     */
+    void handle_multi_get_message_(Deserializer& d);
+
+    /**
+     * Handles a MultiPut message by calling put on the local KV store object for every pair.
+     * @arg d the deserializer containing the MultiPut message.
+     */
+    void handle_multi_put_message_(Deserializer& d);
+
+    /**
+     * Handles a Remove message by calling remove on the local KV store object for every key.
+     * @arg d the deserializer containing the Remove message.
+     */
+    void handle_remove_message_(Deserializer& d);
+
+    /**
+     * Handles a Refresh message by calling refresh on the local KV and sending back the stamp,
+     * and the value if it changed.
+     * @arg d the deserializer containing the Refresh message.
+     */
+    void handle_refresh_message_(Deserializer& d);
+
+    /**
+     * Registers what to do with the reply to a request before the request is sent. Requests
+     * carry ids, so their replies may come back in any order.
+     * @arg id  the id of the request
+     * @arg done  called with the value of the reply, from the thread of this connection
+     */
+    void expect_reply(size_t id, ReplyCallback done) {
+        pending_l_.lock();
+        pending_[id] = done;
+        pending_l_.unlock();
+    }
+
+    /**
+     * Handles a Reply message by handing its value to the callback registered for its request.
      * @arg d the deserializer containing the Reply Message.
      */
     void handle_reply_message_(Deserializer& d) {
-        Reply* r = new Reply(&d);
-        replies.push(r);
+        Reply r(&d);
+        pending_l_.lock();
+        std::unordered_map<size_t, ReplyCallback>::iterator it = pending_.find(r.id_);
+        assert(it != pending_.end());
+        ReplyCallback done = it->second;
+        pending_.erase(it);
+        pending_l_.unlock();
+        Value* v = r.v_;
+        r.v_ = nullptr;
+        done(v);
     }
 
     /** Handles a message by checking the message type and calling the appropriate helper handler.
@@ -148,6 +227,14 @@ class Connection : public Thread {
             handle_put_message_(d);
         } else if (m == MsgType::WAITANDGET) {
             handle_wait_and_get_message_(d);
+        } else if (m == MsgType::MULTIGET) {
+            handle_multi_get_message_(d);
+        } else if (m == MsgType::MULTIPUT) {
+            handle_multi_put_message_(d);
+        } else if (m == MsgType::REMOVE) {
+            handle_remove_message_(d);
+        } else if (m == MsgType::REFRESH) {
+            handle_refresh_message_(d);
         } else if (m == MsgType::REPLY) {
             handle_reply_message_(d);
         } else if (m == MsgType::KILL) {
@@ -173,3 +260,11 @@ class Connection : public Thread {
         }
     }
 };
+
+inline void ReplyRoute::send_message(Message* m) {
+    l_.lock();
+    if (c_ != nullptr) {
+        c_->send_message(m);
+    }
+    l_.unlock();
+}
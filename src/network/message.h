@@ -12,7 +12,20 @@
  * Represents a message type to pass over a network.
  * Authors: gomes.chri@husky.neu.edu and modi.an@husky.neu.edu
  */
-enum class MsgType : int { PUT, GET, WAITANDGET, REPLY, KILL, REGISTER, DIRECTORY, STATUS };
+enum class MsgType : int {
+    PUT,
+    GET,
+    WAITANDGET,
+    REPLY,
+    KILL,
+    REGISTER,
+    DIRECTORY,
+    STATUS,
+    MULTIGET,
+    MULTIPUT,
+    REMOVE,
+    REFRESH
+};
 
 /**
  * Represents a message to send over a network.
@@ -163,16 +176,179 @@ class WaitAndGet : public Message {
     }
 };
 
+/**
+ * Asks a node for the value at one of its keys unless it is still the one
+ * with the given stamp (see KVStore::refresh). It answers with a Reply whose
+ * value holds the current stamp, followed by the serialized value if it is
+ * another one.
+ * Authors: gomes.chri@husky.neu.edu and modi.an@husky.neu.edu
+ */
+class Refresh : public Message {
+   public:
+    Key k_;
+    size_t stamp_;
+
+    Refresh(Key& k, size_t stamp) : Message(MsgType::REFRESH), k_(k), stamp_(stamp) {}
+
+    Refresh(Deserializer* d) : Message(MsgType::REFRESH, d) {
+        k_ = Key(d);
+        stamp_ = d->get_size_t();
+    }
+
+    /**
+     * Deconstructs an instance of a refresh message.
+     */
+    virtual ~Refresh() {}
+
+    /**
+     * Serializes the object into a string of chars.
+     */
+    virtual void serialize(Serializer* s) {
+        Message::serialize(s);
+        k_.serialize(s);
+        s->add_size_t(stamp_);
+    }
+};
+
+/**
+ * Asks a node for the values at several of its keys at once, skipping the
+ * ones the sender has a current copy of (see Refresh). It answers with a
+ * single Reply whose value holds, for each key in order, its stamp, whether
+ * the value follows and the serialized value.
+ * Authors: gomes.chri@husky.neu.edu and modi.an@husky.neu.edu
+ */
+class MultiGet : public Message {
+   public:
+    std::vector<Key> keys_;
+    std::vector<size_t> stamps_;  // of the copies the sender has, 0 for none
+
+    MultiGet(std::vector<Key>& keys)
+        : Message(MsgType::MULTIGET), keys_(keys), stamps_(keys.size(), 0) {}
+
+    MultiGet(std::vector<Key>& keys, std::vector<size_t>& stamps)
+        : Message(MsgType::MULTIGET), keys_(keys), stamps_(stamps) {
+        assert(keys_.size() == stamps_.size());
+    }
+
+    MultiGet(Deserializer* d) : Message(MsgType::MULTIGET, d) {
+        size_t n = d->get_size_t();
+        for (size_t i = 0; i < n; i++) {
+            keys_.push_back(Key(d));
+            stamps_.push_back(d->get_size_t());
+        }
+    }
+
+    /**
+     * Deconstructs an instance of a multi get message.
+     */
+    virtual ~MultiGet() {}
+
+    /**
+     * Serializes the object into a string of chars.
+     */
+    virtual void serialize(Serializer* s) {
+        Message::serialize(s);
+        s->add_size_t(keys_.size());
+        for (size_t i = 0; i < keys_.size(); i++) {
+            keys_[i].serialize(s);
+            s->add_size_t(stamps_[i]);
+        }
+    }
+};
+
+/**
+ * Tells a node to put values at several of its keys at once.
+ * Authors: gomes.chri@husky.neu.edu and modi.an@husky.neu.edu
+ */
+class MultiPut : public Message {
+   public:
+    std::vector<Key> keys_;
+    std::vector<Value*> values_;  // owned
+
+    /**
+     * Creates a multi put message, which consumes the values.
+     * @arg keys  the keys
+     * @arg values  the values, in the order of the keys
+     */
+    MultiPut(std::vector<Key>& keys, std::vector<Value*>& values)
+        : Message(MsgType::MULTIPUT), keys_(keys), values_(values) {
+        assert(keys_.size() == values_.size());
+    }
+
+    MultiPut(Deserializer* d) : Message(MsgType::MULTIPUT, d) {
+        size_t n = d->get_size_t();
+        for (size_t i = 0; i < n; i++) {
+            keys_.push_back(Key(d));
+            values_.push_back(new Value(d));
+        }
+    }
+
+    /**
+     * Deconstructs an instance of a multi put message.
+     */
+    virtual ~MultiPut() {
+        for (Value* v : values_) {
+            delete v;
+        }
+    }
+
+    /**
+     * Serializes the object into a string of chars.
+     */
+    virtual void serialize(Serializer* s) {
+        Message::serialize(s);
+        s->add_size_t(keys_.size());
+        for (size_t i = 0; i < keys_.size(); i++) {
+            keys_[i].serialize(s);
+            values_[i]->serialize(s);
+        }
+    }
+};
+
+/**
+ * Tells a node to remove the values at several of its keys at once.
+ * Authors: gomes.chri@husky.neu.edu and modi.an@husky.neu.edu
+ */
+class Remove : public Message {
+   public:
+    std::vector<Key> keys_;
+
+    Remove(std::vector<Key>& keys) : Message(MsgType::REMOVE), keys_(keys) {}
+
+    Remove(Deserializer* d) : Message(MsgType::REMOVE, d) {
+        size_t n = d->get_size_t();
+        for (size_t i = 0; i < n; i++) {
+            keys_.push_back(Key(d));
+        }
+    }
+
+    /**
+     * Deconstructs an instance of a remove message.
+     */
+    virtual ~Remove() {}
+
+    /**
+     * Serializes the object into a string of chars.
+     */
+    virtual void serialize(Serializer* s) {
+        Message::serialize(s);
+        s->add_size_t(keys_.size());
+        for (Key& k : keys_) {
+            k.serialize(s);
+        }
+    }
+};
+
 class Reply : public Message {
    public:
-    Value* v_;
+    Value* v_;  // nullptr if there is no value to answer with
 
     Reply(Value* v) : Message(MsgType::REPLY) {
         v_ = v;
     }
 
     Reply(Deserializer* d) : Message(MsgType::REPLY, d) {
-        v_ = new Value(d);
+        v_ = d->get_bool() ? new Value(d) : nullptr;
     }
 
     /**
@@ -187,7 +363,10 @@ class Reply : public Message {
      */
     virtual void serialize(Serializer* s) {
         Message::serialize(s);
-        v_->serialize(s);
+        s->add_bool(v_ != nullptr);
+        if (v_ != nullptr) {
+            v_->serialize(s);
+        }
     }
 };
 
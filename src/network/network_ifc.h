@@ -1,10 +1,14 @@
 #pragma once
+#include <atomic>
 #include <cassert>
+#include <future>
+#include <memory>
 #include <unordered_map>
 
 #include "connection.h"
 #include "message.h"
 #include "network.h"
+#include "util/lock.h"
 #include "util/thread.h"
 
 /**
@@ -23,10 +27,12 @@ class NetworkIfc : public Thread {
     size_t node_num_;
     size_t total_nodes_;
     std::unordered_map<size_t, Connection*> connections_;
+    Lock connections_l_;  // guards connections_, which any thread may open a connection in
     std::unordered_map<size_t, Address*> peer_addresses_;
     ListenSocket* listen_sock_;
     Address my_addr_;
     KVStore* local_kv_;
+    std::atomic<size_t> next_id_;  // for requests that expect a reply, 0 is for those that do not
 
     /**
      * NetworkIfc constructor to be called by all "clients" (node_num != 0)
@@ -36,7 +42,8 @@ class NetworkIfc : public Thread {
           node_num_(node_num),
           total_nodes_(total_nodes),
           connections_(),
-          my_addr_(address) {
+          my_addr_(address),
+          next_id_(1) {
         peer_addresses_[0] = new Address(controller);
         local_kv_ = nullptr;
         keep_processing_ = false;
@@ -104,7 +111,9 @@ class NetworkIfc : public Thread {
                 assert(cs->recv_bytes((char*)&node, sizeof(size_t)) > 0);
                 assert(node != total_nodes_);
                 c->start();
+                connections_l_.lock();
                 connections_[node] = c;
+                connections_l_.unlock();
             }
         }
 
@@ -114,8 +123,11 @@ class NetworkIfc : public Thread {
             broadcast_(&kill_msg);
         }
 
-        // end all connections and their threads
-        for (std::pair<size_t, Connection*> p : connections_) {
+        // end all connections and their threads, whose callbacks may still want the lock
+        connections_l_.lock();
+        std::unordered_map<size_t, Connection*> open = connections_;
+        connections_l_.unlock();
+        for (std::pair<size_t, Connection*> p : open) {
             p.second->stop();
             p.second->join();
         }
@@ -159,14 +171,19 @@ class NetworkIfc : public Thread {
 
         // Store peer address in address map
         peer_addresses_[reg.node_num_] = new Address(reg.client_addr_);
+        connections_l_.lock();
         connections_[reg.node_num_] = c;
+        connections_l_.unlock();
     }
 
     /**
      * Sends message to all nodes.
      */
     void broadcast_(Message* message) {
-        for (std::pair<size_t, Connection*> p : connections_) {
+        connections_l_.lock();
+        std::unordered_map<size_t, Connection*> open = connections_;
+        connections_l_.unlock();
+        for (std::pair<size_t, Connection*> p : open) {
             // send all client addresses over server
             p.second->send_message(message);
         }
@@ -181,7 +198,9 @@ class NetworkIfc : public Thread {
         ConnectionSocket* server_connection = new ConnectionSocket();
         server_connection->connect_to_other(peer_addresses_[0]);
         Connection* c = new Connection(server_connection, local_kv_);
+        connections_l_.lock();
         connections_[0] = c;
+        connections_l_.unlock();
 
         // Send Server Register
         Register reg(new Address(&my_addr_), node_num_);
@@ -232,18 +251,24 @@ class NetworkIfc : public Thread {
 
     /**
      * A helper method which takes a node number and opens a connection to it if one does not
-     * already exist.
+     * already exist. Threads asking for the same node at once share one connection.
+     * @return the connection to the node
      */
-    void connect_to_node_(size_t node) {
-        if (connections_.find(node) == connections_.end()) {
+    Connection* connect_to_node_(size_t node) {
+        connections_l_.lock();
+        std::unordered_map<size_t, Connection*>::iterator it = connections_.find(node);
+        Connection* c = it == connections_.end() ? nullptr : it->second;
+        if (c == nullptr) {
             assert(peer_addresses_.size() == total_nodes_);
             ConnectionSocket* cs = new ConnectionSocket();
             cs->connect_to_other(peer_addresses_.at(node));
             cs->send_bytes((char*)&node_num_, sizeof(size_t));
-            Connection* c = new Connection(cs, local_kv_);
+            c = new Connection(cs, local_kv_);
             c->start();
             connections_[node] = c;
         }
+        connections_l_.unlock();
+        return c;
     }
 
     /**
@@ -253,60 +278,151 @@ class NetworkIfc : public Thread {
         wait_for_registration_();
         assert(node_num_ != node);
         Put p(k, v);
-        connect_to_node_(node);
-        connections_.at(node)->send_message(&p);
+        connect_to_node_(node)->send_message(&p);
     }
 
     /**
-     * A helper method which waits for and processes a reply to a get or waitAndGet call.
+     * A helper method which sends a request to another node, after registering what to do with
+     * its reply. The callback runs on the thread of the connection, so it must not wait for
+     * another reply itself.
      */
-    Value* process_reply_(Connection* c) {
-        // Wait for a reply to come back
-        while (c->replies.size() == 0) {
-            continue;
-        }
-
-        assert(c->replies.size() == 1);
-
-        Reply* r = c->replies.front();
-        Value* result = r->v_->clone();
-
-        c->replies.pop();
-        delete r;
+    void request_(size_t node, Message* m, ReplyCallback done) {
+        wait_for_registration_();
+        assert(node_num_ != node);
+        m->id_ = next_id_++;
+        Connection* c = connect_to_node_(node);
+        c->expect_reply(m->id_, done);
+        c->send_message(m);
+    }
 
-        return result;
+    /**
+     * A helper method which makes a callback that hands its value to a future, so a caller can
+     * block on the reply without spinning.
+     * @arg f  set to the future
+     */
+    static ReplyCallback promise_(std::future<Value*>& f) {
+        std::shared_ptr<std::promise<Value*>> p = std::make_shared<std::promise<Value*>>();
+        f = p->get_future();
+        return [p](Value* v) { p->set_value(v); };
     }
 
     /**
      * Public API method which gets the data at the given key from another node.
      */
     Value* get_from_node(size_t node, Key& k) {
-        wait_for_registration_();
-        assert(node_num_ != node);
-        Get g(k);
-
-        connect_to_node_(node);
-        Connection* c = connections_.at(node);
-        assert(c->replies.size() == 0);
-        c->send_message(&g);
+        std::future<Value*> f;
+        get_from_node_async(node, k, promise_(f));
+        return f.get();
+    }
 
-        return process_reply_(c);
+    /**
+     * Public API method which asks another node for the data at the given key, and calls the
+     * function with it once it arrives.
+     */
+    void get_from_node_async(size_t node, Key& k, ReplyCallback done) {
+        Get g(k);
+        request_(node, &g, done);
     }
 
     /**
      * Public API method which performs a waitAndGet for the data at the given key on another node.
      */
     Value* wait_and_get_from_node(size_t node, Key& k) {
-        wait_for_registration_();
-        assert(node_num_ != node);
+        std::future<Value*> f;
+        wait_and_get_from_node_async(node, k, promise_(f));
+        return f.get();
+    }
+
+    /**
+     * Public API method which asks another node for the data at the given key once there is some,
+     * and calls the function with it once it arrives.
+     */
+    void wait_and_get_from_node_async(size_t node, Key& k, ReplyCallback done) {
         WaitAndGet g(k);
+        request_(node, &g, done);
+    }
 
-        connect_to_node_(node);
-        Connection* c = connections_.at(node);
-        assert(c->replies.size() == 0);
-        c->send_message(&g);
+    /**
+     * Public API method which gets the data at several keys from other nodes, with one request per
+     * node. Every request is sent before any reply is awaited, so the nodes serve them in parallel.
+     * @arg keys  the keys to get from each node, indexed by node, empty for the nodes not asked
+     * @arg stamps  the stamps of the copies the caller has, like keys, 0 for none; set to the
+     *   stamps on the nodes, see KVStore::refresh
+     * @return the values from each node, in the order of its keys, nullptr for those the caller
+     *   has
+     */
+    std::vector<std::vector<Value*>> multi_get_from_nodes(
+        std::vector<std::vector<Key>>& keys, std::vector<std::vector<size_t>>& stamps) {
+        std::vector<std::future<Value*>> replies(keys.size());
+        for (size_t node = 0; node < keys.size(); node++) {
+            if (!keys[node].empty()) {
+                MultiGet g(keys[node], stamps[node]);
+                request_(node, &g, promise_(replies[node]));
+            }
+        }
+        std::vector<std::vector<Value*>> result(keys.size());
+        for (size_t node = 0; node < keys.size(); node++) {
+            if (keys[node].empty()) {
+                continue;
+            }
+            Value* v = replies[node].get();
+            Deserializer d(v->get_bytes(), v->size());
+            for (size_t i = 0; i < keys[node].size(); i++) {
+                stamps[node][i] = d.get_size_t();
+                result[node].push_back(d.get_bool() ? new Value(&d) : nullptr);
+            }
+            delete v;
+        }
+        return result;
+    }
+
+    /**
+     * Public API method which gets the data at the given key from another node unless it still
+     * has the given stamp, see KVStore::refresh.
+     * @arg stamp  the stamp the caller has, set to the stamp on the node
+     * @return the value, or nullptr if it did not change or there is none
+     */
+    Value* refresh_from_node(size_t node, Key& k, size_t& stamp) {
+        Refresh f(k, stamp);
+        std::future<Value*> reply;
+        request_(node, &f, promise_(reply));
+        Value* v = reply.get();
+        Deserializer d(v->get_bytes(), v->size());
+        stamp = d.get_size_t();
+        Value* result = d.bytes_remaining_ > 0 ? new Value(&d) : nullptr;
+        delete v;
+        return result;
+    }
+
+    /**
+     * Public API method which tells the specified node to put the given value at the given key,
+     * and calls the function with an empty value once the node has stored it. Consumes the value.
+     */
+    void put_at_node_async(size_t node, Key& k, Value* v, ReplyCallback done) {
+        Put p(k, v);
+        request_(node, &p, done);
+    }
+
+    /**
+     * Public API method which tells the specified node to put values at several keys in one
+     * message. Consumes the values.
+     */
+    void multi_put_at_node(size_t node, std::vector<Key>& keys, std::vector<Value*>& values) {
+        wait_for_registration_();
+        assert(node_num_ != node);
+        MultiPut p(keys, values);
+        connect_to_node_(node)->send_message(&p);
+    }
 
-        return process_reply_(c);
+    /**
+     * Public API method which tells the specified node to remove the values at several keys in
+     * one message.
+     */
+    void remove_at_node(size_t node, std::vector<Key>& keys) {
+        wait_for_registration_();
+        assert(node_num_ != node);
+        Remove r(keys);
+        connect_to_node_(node)->send_message(&r);
     }
 
     /**
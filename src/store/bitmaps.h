@@ -0,0 +1,83 @@
+#pragma once
+#include <assert.h>
+
+#include "exchange.h"
+#include "key.h"
+#include "kvstore.h"
+#include "util/bitmap.h"
+#include "util/serial.h"
+#include "value.h"
+
+/**
+ * Stores a bitmap at a key, as its serialized containers.
+ * @arg kv  the store
+ * @arg k  the key
+ * @arg b  the bitmap, external
+ */
+inline void put_bitmap(KVStore* kv, Key& k, Bitmap& b) {
+    Serializer s;
+    b.serialize(&s);
+    kv->put(k, new Value(s.get_bytes(), s.size()));
+}
+
+/**
+ * Waits for the bitmap stored at a key.
+ * @arg kv  the store
+ * @arg k  the key
+ * @return the bitmap, owned by the caller
+ */
+inline Bitmap* get_bitmap(KVStore* kv, Key& k) {
+    Value* v = kv->waitAndGet(k);
+    Deserializer d(v->get_bytes(), v->size());
+    Bitmap* result = new Bitmap(&d);
+    delete v;
+    return result;
+}
+
+/**
+ * Replaces the bitmap of every node by the union of all of them. The
+ * bitmaps are merged up a binomial tree rooted at node 0, whose union is
+ * sent back down the same tree, so every node sends and receives at most
+ * log2(nodes) bitmaps each way and no node merges more than that. Every
+ * node must call it.
+ * @arg kv  the store
+ * @arg name  the name of the exchange, which must not be reused
+ * @arg b  the bitmap of this node
+ */
+inline void union_all(KVStore* kv, const char* name, Bitmap& b) {
+    size_t nodes = kv->num_nodes();
+    size_t me = kv->this_node();
+    if (nodes == 1) {
+        return;
+    }
+    Exchange ex(kv, name);
+    // up: in round i, a node with bit i set sends to the node without it
+    size_t step = 1;
+    for (; step < nodes; step <<= 1) {
+        if (me & step) {
+            Serializer s;
+            b.serialize(&s);
+            ex.send(me - step, s);
+            Value* v = ex.receive(me - step);
+            Deserializer d(v->get_bytes(), v->size());
+            b = Bitmap(&d);
+            delete v;
+            break;
+        }
+        if (me + step < nodes) {
+            Value* v = ex.receive(me + step);
+            Deserializer d(v->get_bytes(), v->size());
+            Bitmap theirs(&d);
+            b.union_with(theirs);
+            delete v;
+        }
+    }
+    // down: pass the union on to the nodes this one merged, last first
+    Serializer s;
+    b.serialize(&s);
+    for (step >>= 1; step > 0; step >>= 1) {
+        if (me + step < nodes) {
+            ex.send(me + step, s);
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "key.h"
+#include "kvstore.h"
+#include "util/serial.h"
+#include "util/string.h"
+#include "value.h"
+
+/**
+ * Point to point exchange of serialized blobs between the nodes of a store.
+ * Every node taking part in an exchange must use the same name, and a name
+ * must not be reused for a different exchange. A blob sent from node i to
+ * node j is stored at "name~i~j" homed on node j, so receiving it never has
+ * to leave the receiving node.
+ * Author: gomes.chri, modi.an
+ */
+class Exchange : public Object {
+   public:
+    KVStore* store_;
+    String* name_;
+
+    /**
+     * Creates an exchange over the given store.
+     * @arg store  the store to move blobs through
+     * @arg name  the name shared by every node taking part
+     */
+    Exchange(KVStore* store, const char* name) : Object() {
+        assert(store != nullptr && name != nullptr);
+        store_ = store;
+        name_ = new String(name);
+    }
+
+    virtual ~Exchange() {
+        delete name_;
+    }
+
+    /**
+     * Builds the key a blob from one node to another is stored at.
+     * @arg from  the sending node
+     * @arg to  the receiving node
+     * @return the key, owned by the caller
+     */
+    Key* key_(size_t from, size_t to) {
+        String* s = StrBuff().c(*name_).c("~").c(from).c("~").c(to).get();
+        Key* k = new Key(s->c_str(), to);
+        delete s;
+        return k;
+    }
+
+    /**
+     * Sends the serialized bytes to a node. The serializer must not be empty.
+     * @arg to  the receiving node
+     * @arg s  the bytes to send
+     */
+    void send(size_t to, Serializer& s) {
+        assert(s.size() > 0);
+        Key* k = key_(store_->this_node(), to);
+        store_->put(*k, new Value(s.get_bytes(), s.size()));
+        delete k;
+    }
+
+    /**
+     * Waits for the blob sent by a node to this node and removes it from the
+     * store, so an exchange leaves no keys behind once every blob has been
+     * received.
+     * @arg from  the sending node
+     * @return the blob, owned by the caller
+     */
+    Value* receive(size_t from) {
+        Key* k = key_(from, store_->this_node());
+        Value* v = store_->waitAndTake(*k);
+        delete k;
+        return v;
+    }
+};
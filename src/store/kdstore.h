@@ -1,35 +1,74 @@
 #pragma once
+#include <chrono>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
 #include "dataframe/dataframe.h"
+#include "exchange.h"
 #include "key.h"
 #include "kvstore.h"
 #include "sorer/parser.h"
 #include "util/serial.h"
 
+static const size_t KDSTORE_FRAMES = 256;  // decoded frames a KDStore keeps
+
 /**
- * Wrapper to hold DataFrames in a KVStore.
+ * A decoded data frame kept by a KDStore, with the stamp of the value it
+ * was decoded from (see KVStore::refresh) and its place in the order of use.
+ * Author: gomes.chri, modi.an
+ */
+class CachedFrame : public Object {
+   public:
+    DataFrame* df_;  // owned
+    size_t stamp_;
+    std::list<Key>::iterator used_;
+
+    CachedFrame(DataFrame* df, size_t stamp, std::list<Key>::iterator used)
+        : Object(), df_(df), stamp_(stamp), used_(used) {}
+};
+
+/**
+ * Wrapper to hold DataFrames in a KVStore. The metadata of the frames read
+ * is cached on this node, up to KDSTORE_FRAMES of them with the ones used
+ * least recently dropped first. Every read asks the home node of the key
+ * whether the frame was put again since, which for another node is a round
+ * trip carrying only a stamp, and copies the cached frame if it was not.
+ * The copy shares the segment tables of the columns, so it costs the same
+ * however many segments the frame has. Frames put through this store can
+ * be given a lifetime, after which they are removed.
  * Author: gomes.chri, modi.an
  */
 class KDStore : public Object {
    public:
     KVStore* store_;
+    size_t queries_;  // queries collected through this store, names their exchanges
+    std::unordered_map<Key, CachedFrame> frames_;
+    std::list<Key> used_;  // keys of frames_, most recently used first
+    std::unordered_map<Key, std::chrono::steady_clock::time_point> expiries_;
 
     KDStore(KVStore* kv) : Object() {
         store_ = kv;
+        queries_ = 0;
     }
 
-    virtual ~KDStore() {}
+    virtual ~KDStore() {
+        for (auto& item : frames_) {
+            delete item.second.df_;
+        }
+    }
 
     /**
-     * Gets the value at the given key.
+     * Gets the value at the given key, after removing the frames whose
+     * lifetime is over.
      * @arg k  the key
      * @return the value
      */
     DataFrame* get(Key& k) {
-        Value* v = store_->get(k);
-        Deserializer d(v->get_bytes(), v->size());
-        DataFrame* df = new DataFrame(&d, store_);
-        delete v;
-        return df;
+        expire();
+        DataFrame* result = read_(k);
+        assert(result != nullptr);
+        return result;
     }
 
     /**
@@ -41,28 +80,245 @@ class KDStore : public Object {
     }
 
     /**
-     * Waits until there is a value at the given key and then gets it.
+     * Waits until there is a value at the given key and then gets it, after
+     * removing the frames whose lifetime is over. Fails if the frame is
+     * removed meanwhile.
      * @arg k  the key
      * @return the value
      */
     DataFrame* waitAndGet(Key& k) {
+        expire();
+        DataFrame* result = read_(k);
+        if (result != nullptr) {
+            return result;
+        }
+        // a wait does not tell the stamp, so the frame is cached by the next read
         Value* v = store_->waitAndGet(k);
+        assert(v != nullptr);
         Deserializer d(v->get_bytes(), v->size());
-        DataFrame* df = new DataFrame(&d, store_);
+        result = new DataFrame(&d, store_);
         delete v;
+        return result;
+    }
+
+    /**
+     * Drops the cached frame at the given key, and the cached value of the
+     * KVStore, so that the next read fetches it again.
+     * @arg k  the key
+     */
+    void forget(Key& k) {
+        drop_(k);
+        store_->forget(k);
+    }
+
+    /** Drops the cached frame at the given key. */
+    void drop_(Key& k) {
+        std::unordered_map<Key, CachedFrame>::iterator it = frames_.find(k);
+        if (it != frames_.end()) {
+            delete it->second.df_;
+            used_.erase(it->second.used_);
+            frames_.erase(it);
+        }
+    }
+
+    /**
+     * Removes the frame at the given key, along with the segments its
+     * columns own, from every node holding them, with one message per node.
+     * A column owns the segments it wrote (see Column::owns): views made
+     * with slice, select or concat own none, and a frame appended to does
+     * not own the segments it kept from before, which copies read earlier
+     * still use. Frames that read the segments removed, like views of this
+     * frame, fail to read their rows rather than waiting for segments that
+     * will not come. Does nothing if there is no frame at the key, as when
+     * another node removed it first.
+     * @arg k  the key
+     */
+    void remove(Key& k) {
+        expiries_.erase(k);
+        DataFrame* df = read_(k);
+        if (df == nullptr) {
+            return;
+        }
+        std::vector<Key> keys;
+        for (size_t i = 0; i < df->ncols(); i++) {
+            Column* c = df->columns_[i];
+            for (Key& segment : c->table_->keys_) {
+                if (c->owns(segment)) {
+                    keys.push_back(segment);
+                }
+            }
+        }
+        keys.push_back(k);
+        delete df;
+        store_->remove(keys);
+        drop_(k);
+    }
+
+    /**
+     * Gives the frame at the given key a lifetime, after which the first
+     * get or put through this store, or expire(), removes it (see remove).
+     * Another put at the key through this store ends the lifetime. Only
+     * this store keeps track of it: gets and puts through the stores of
+     * other nodes do not remove the frame, so iterative jobs can let the
+     * frames of earlier rounds go from the node that made them without
+     * knowing when every reader is done.
+     * @arg k  the key
+     * @arg millis  how long the frame lives
+     */
+    void expire_after(Key& k, size_t millis) {
+        expiries_[k] = std::chrono::steady_clock::now() + std::chrono::milliseconds(millis);
+    }
+
+    /**
+     * Removes the frames whose lifetime is over.
+     * @return how many were removed
+     */
+    size_t expire() {
+        if (expiries_.empty()) {
+            return 0;
+        }
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        std::vector<Key> over;
+        for (auto& item : expiries_) {
+            if (item.second <= now) {
+                over.push_back(item.first);
+            }
+        }
+        for (Key& k : over) {
+            remove(k);
+        }
+        return over.size();
+    }
+
+    /**
+     * Appends the rows a writer produces to the frame at the given key. The
+     * new segments are stored before the frame is put back in a single put,
+     * so readers get either the old or the new rows, never a mix. Frames read
+     * before keep the rows they had. Only one node may append to a frame at a
+     * time.
+     * @arg k  the key of the frame
+     * @arg v  the writer
+     * @return the new version of the frame, owned by the caller
+     */
+    DataFrame* append(Key& k, Writer& v) {
+        DataFrame* df = get(k);
+        df->append(v);
+        put(k, df);
         return df;
     }
 
     /**
-     * Puts the data frame at the given key.
+     * Stitches the parts of a frame built on every node into one frame and
+     * stores it at the given key. The parts keep their segments where they
+     * are: only their metadata is sent to the home node of the key, which
+     * appends the parts in node order. Every node must call it.
+     * @arg k  the key to store the frame at
+     * @arg name  the name of the exchange, which must not be reused
+     * @arg part  the part built on this node, external
+     * @arg bounds  the range partitions of the frame, where partition i is
+     *   the part of node i, or nullptr; owned
+     * @return the frame, owned by the caller
+     */
+    DataFrame* commit(Key& k, const char* name, DataFrame* part,
+                      RangePartitions* bounds = nullptr) {
+        Exchange gather(store_, name);
+        Serializer s;
+        part->serialize(&s);
+        gather.send(k.get_node(), s);
+        if (store_->this_node() != k.get_node()) {
+            delete bounds;
+            return waitAndGet(k);
+        }
+        DataFrame* result = nullptr;
+        std::vector<size_t> rows;
+        for (size_t n = 0; n < store_->num_nodes(); n++) {
+            Value* v = gather.receive(n);
+            Deserializer d(v->get_bytes(), v->size());
+            DataFrame* df = new DataFrame(&d, store_);
+            delete v;
+            if (bounds != nullptr && n < bounds->size()) {
+                rows.push_back(df->nrows());
+            }
+            assert(bounds == nullptr || n < bounds->size() || df->nrows() == 0);
+            if (result == nullptr) {
+                result = df;
+                continue;
+            }
+            for (size_t i = 0; i < result->ncols(); i++) {
+                result->columns_[i]->concat(*df->columns_[i]);
+            }
+            result->df_schema_->add_rows(df->nrows());
+            delete df;
+        }
+        if (bounds != nullptr) {
+            bounds->set_sizes(rows);
+        }
+        result->set_partitions(bounds);
+        put(k, result);
+        return result;
+    }
+
+    /**
+     * Numbers a collective query run through this store. Nodes that run the
+     * same queries in the same order get the same numbers.
+     * @return the number
+     */
+    size_t next_query_id() {
+        return queries_++;
+    }
+
+    /**
+     * Puts the data frame at the given key, after removing the frames whose
+     * lifetime is over.
      * @arg k  the key to put the value at
      * @arg df  the data frame
      */
     void put(Key& k, DataFrame* df) {
+        expiries_.erase(k);
+        expire();
         Serializer s;
         df->serialize(&s);
         Value* v = new Value(s.get_bytes(), s.size());
         store_->put(k, v);
+        drop_(k);
+    }
+
+    /**
+     * Reads the frame at the given key through the cache.
+     * @return a copy of the frame, or nullptr if the key has no value
+     */
+    DataFrame* read_(Key& k) {
+        std::unordered_map<Key, CachedFrame>::iterator it = frames_.find(k);
+        size_t stamp = it == frames_.end() ? 0 : it->second.stamp_;
+        Value* v = store_->refresh(k, stamp);
+        if (v != nullptr) {
+            return remember_(k, stamp, v);
+        }
+        if (stamp == 0) {
+            drop_(k);
+            return nullptr;
+        }
+        used_.splice(used_.begin(), used_, it->second.used_);
+        return new DataFrame(*it->second.df_);
+    }
+
+    /**
+     * Decodes a frame with the given stamp and caches it, dropping the frame
+     * used least recently if there are too many. Consumes the value.
+     * @return a copy of the frame, owned by the caller
+     */
+    DataFrame* remember_(Key& k, size_t stamp, Value* v) {
+        Deserializer d(v->get_bytes(), v->size());
+        DataFrame* df = new DataFrame(&d, store_);
+        delete v;
+        drop_(k);
+        used_.push_front(k);
+        frames_.insert(std::make_pair(k, CachedFrame(df, stamp, used_.begin())));
+        if (frames_.size() > KDSTORE_FRAMES) {
+            Key oldest = used_.back();
+            drop_(oldest);
+        }
+        return new DataFrame(*df);
     }
 };
 
@@ -153,32 +409,62 @@ inline DataFrame* DataFrame::fromSorFile(Key* k, KDStore* kd, const char* file_n
 }
 
 inline DataFrame* DataFrame::fromVisitor(Key* k, KDStore* kd, const char* types, Writer& v) {
+    DataFrame* df = DataFrame::fromVisitor(kd->get_kvstore(), types, v);
+    kd->put(*k, df);
+    return df;
+}
+
+/**
+ * Builds a data frame from a writer without storing the frame itself. Its
+ * column segments are stored as they fill up, spread over the nodes or, if
+ * local is set, on this node.
+ */
+inline DataFrame* DataFrame::fromVisitor(KVStore* kv, const char* types, Writer& v,
+                                         bool local) {
     Schema s(types);
     std::vector<Column*> cols = std::vector<Column*>();
     for (size_t i = 0; i < s.width(); i++) {
         switch (s.col_type(i)) {
             case 'S':
-                cols.push_back(new StringColumn(kd->get_kvstore()));
+                cols.push_back(new StringColumn(kv));
                 break;
             case 'I':
-                cols.push_back(new IntColumn(kd->get_kvstore()));
+                cols.push_back(new IntColumn(kv));
                 break;
             case 'B':
-                cols.push_back(new BoolColumn(kd->get_kvstore()));
+                cols.push_back(new BoolColumn(kv));
                 break;
             case 'D':
-                cols.push_back(new DoubleColumn(kd->get_kvstore()));
+                cols.push_back(new DoubleColumn(kv));
                 break;
             default:
                 assert(false);
         }
+        if (local) {
+            cols.back()->place_locally();
+        }
     }
     Row r(s);
     while (!v.done()) {
         v.visit(r);
         r.add_to_columns(cols);
     }
-    DataFrame* df = new DataFrame(cols, kd->get_kvstore());
-    kd->put(*k, df);
+    return new DataFrame(cols, kv);
+}
+
+/**
+ * Builds a data frame from a writer on every node and stores it at the
+ * given key. Each node keeps the segments of the rows its writer produces;
+ * the frame holds the rows of node 0 first, then those of node 1, and so on.
+ * Every node must call it. The name of the key must not be reused by another
+ * collective operation.
+ */
+inline DataFrame* DataFrame::fromDistributedVisitor(Key* k, KDStore* kd, const char* types,
+                                                    Writer& v) {
+    DataFrame* part = DataFrame::fromVisitor(kd->get_kvstore(), types, v, true);
+    String* name = StrBuff().c(k->k_.c_str()).c("~parts").get();
+    DataFrame* df = kd->commit(*k, name->c_str(), part);
+    delete name;
+    delete part;
     return df;
 }
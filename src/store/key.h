@@ -6,7 +6,11 @@
 #include "util/string.h"
 
 /**
- * Array: Represents a key in a key value store.
+ * Represents a key in a key value store. The string is a std::string,
+ * which keeps strings of up to 15 chars inside the key itself, so the keys
+ * of column segments (10 random chars, '_' and a segment number below
+ * 10000) are never allocated on the heap. The hash is computed once, so
+ * lookups compare hashes before strings.
  * Author: gomes.chri, modi.an
  */
 class Key : public Object {
@@ -19,20 +23,21 @@ class Key : public Object {
     Key(const char* k, size_t node) : Object() {
         k_ = std::string(k);
         node_ = node;
+        hash_ = hash_me();
     }
 
     Key(const char* k) : Key(k, 0) {}
 
     Key(Deserializer* d) : Object() {
-        String* temp = d->get_string();
-        k_ = std::string(temp->c_str());
+        d->get_string(k_);
         node_ = d->get_size_t();
-        delete temp;
+        hash_ = hash_me();
     }
 
     Key(const Key& k) : Object() {
         node_ = k.node_;
-        k_ = std::string(k.k_);
+        k_ = k.k_;
+        hash_ = k.hash_;
     }
 
     virtual ~Key() {}
@@ -62,12 +67,17 @@ class Key : public Object {
      */
     bool equals(Object* other) {
         if (other == this) return true;
+        // hashes are cached, so most other objects are told apart before the cast
+        if (other == nullptr || other->hash() != hash_) return false;
         Key* o = dynamic_cast<Key*>(other);
         if (o == nullptr) return false;
-        return k_ == o->k_;
+        return o->k_ == k_;
     }
 
-    /** Compute a hash for this key. */
+    /**
+     * Compute a hash for this key. Every constructor stores it in hash_, so
+     * hashing and comparing keys never has to walk the string again.
+     */
     size_t hash_me() {
         return std::hash<std::string>()(k_);
     }
@@ -85,14 +95,13 @@ class Key : public Object {
      * @arg s  the serializer
      */
     void serialize(Serializer* s) {
-        String* temp = new String(k_.c_str());
-        s->add_string(temp);
+        s->add_string(k_);
         s->add_size_t(node_);
-        delete temp;
     }
 
+    /** Keys with different hashes are told apart without looking at the strings. */
     bool operator==(const Key& k) const {
-        return k.k_ == k_;
+        return k.hash_ == hash_ && k.k_ == k_;
     }
 
     bool operator!=(const Key& k) const {
@@ -104,7 +113,7 @@ namespace std {
 template <>
 struct hash<Key> {
     size_t operator()(const Key& k) const {
-        return hash<string>()(k.k_);
+        return k.hash_;
     }
 };
 }  // namespace std
@@ -1,37 +1,563 @@
 #pragma once
-#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <typeinfo>
+#include <vector>
 
 #include "key.h"
 #include "network/network_ifc.h"
+#include "remote_cache.h"
+#include "spill.h"
 #include "util/lock.h"
 #include "value.h"
 
+static const size_t KVSTORE_SHARDS = 16;
+static const size_t KVSTORE_BUCKETS = 64;     // buckets of a new shard
+static const size_t KVSTORE_SPILL_MIN = 256;  // smaller values are not worth spilling
+
+/** How the gets of a KVStore were served, and where its values are. */
+struct KVStats {
+    size_t hits_;           // gets served from memory
+    size_t misses_;         // gets read back from the spill file
+    size_t resident_;       // bytes of values in memory
+    size_t spilled_;        // bytes written to the spill file
+    size_t remote_hits_;    // gets of remote keys served from the cache
+    size_t remote_misses_;  // gets of remote keys sent to their node
+};
+
+/** Called with a copy of a value, which it owns. */
+typedef std::function<void(Value*)> KVCallback;
+
+/**
+ * The reply to a wait for a remote key that gives up after a while. A
+ * value that arrives once the waiter gave up is dropped.
+ * Author: gomes.chri, modi.an
+ */
+class TimedReply : public Object {
+   public:
+    Lock l_;
+    std::promise<Value*> p_;
+    bool gave_up_;  // under l_
+
+    TimedReply() : Object(), gave_up_(false) {}
+
+    /**
+     * Hands a value to the waiter, or drops it if the waiter gave up.
+     * @arg v  the value, owned
+     */
+    void arrive(Value* v) {
+        l_.lock();
+        if (gave_up_) {
+            delete v;
+        } else {
+            p_.set_value(v);
+        }
+        l_.unlock();
+    }
+};
+
+/**
+ * A local key of a KVStore, its current value and whoever waits for one.
+ * An entry outlives the tables that link it, so a put seen through one
+ * table is seen through all, and a key that is waited for gets an entry
+ * before it has a value.
+ * Author: gomes.chri, modi.an
+ */
+class KVEntry : public Object {
+   public:
+    Key k_;
+    size_t code_;                        // std::hash of the key
+    std::atomic<Value*> v_;              // nullptr until put and once taken
+    std::atomic<size_t> version_;        // puts so far
+    std::atomic<size_t> stamp_;          // the put of v_ among all puts to the store, set after v_
+    std::atomic<size_t> used_;           // clock of the shard at the last put or get
+    std::condition_variable_any cv_;     // notified by puts, with the shard lock
+    size_t waiting_;                     // threads on cv_, under the shard lock
+    std::vector<KVCallback> callbacks_;  // to call on the next put, under the shard lock
+    std::atomic<bool> removed_;          // from the last remove until the next put
+
+    KVEntry(Key& k, size_t code)
+        : Object(),
+          k_(k),
+          code_(code),
+          v_(nullptr),
+          version_(0),
+          stamp_(0),
+          used_(0),
+          waiting_(0),
+          removed_(false) {}
+
+    /**
+     * Whether the entry has no value and nobody waits for one. A removed
+     * key keeps its entry, so that waits for it fail instead of blocking.
+     */
+    bool idle() {
+        return v_.load() == nullptr && waiting_ == 0 && callbacks_.empty() && !removed_.load();
+    }
+};
+
+/** A link of a bucket chain, never changed once it is published. */
+struct KVNode {
+    KVEntry* entry_;
+    KVNode* next_;
+};
+
+/**
+ * A chained hash table of entries. Chains only grow at their head, so a
+ * reader walking one sees a consistent list without any lock. Owns its
+ * nodes but not their entries.
+ * Author: gomes.chri, modi.an
+ */
+class KVTable : public Object {
+   public:
+    size_t size_;                    // buckets
+    std::atomic<KVNode*>* buckets_;  // owned
+    size_t entries_;                 // linked so far, changed under the shard lock
+
+    KVTable(size_t size) : Object(), size_(size), entries_(0) {
+        buckets_ = new std::atomic<KVNode*>[size];
+        for (size_t i = 0; i < size; i++) {
+            buckets_[i].store(nullptr);
+        }
+    }
+
+    virtual ~KVTable() {
+        for (size_t i = 0; i < size_; i++) {
+            KVNode* n = buckets_[i].load();
+            while (n != nullptr) {
+                KVNode* next = n->next_;
+                delete n;
+                n = next;
+            }
+        }
+        delete[] buckets_;
+    }
+
+    /** Finds the entry of a key, or returns nullptr. */
+    KVEntry* find(Key& k, size_t code) {
+        for (KVNode* n = buckets_[bucket_(code)].load(); n != nullptr; n = n->next_) {
+            if (n->entry_->code_ == code && n->entry_->k_ == k) {
+                return n->entry_;
+            }
+        }
+        return nullptr;
+    }
+
+    /** Links an entry at the head of its chain. Only one writer at a time. */
+    void add(KVEntry* e) {
+        std::atomic<KVNode*>& head = buckets_[bucket_(e->code_)];
+        head.store(new KVNode{e, head.load()});
+        entries_++;
+    }
+
+    /** The bucket of a hash; its low bits already picked the shard. */
+    size_t bucket_(size_t code) {
+        return code / KVSTORE_SHARDS % size_;
+    }
+};
+
+/**
+ * The values of the local keys of a KVStore whose hash falls in one shard.
+ * Reads never lock: they walk the current table inside an epoch, while puts
+ * take the shard lock, publish with an atomic store, and retire what they
+ * replace. What they retire is freed an epoch later, and the epoch only moves
+ * on once every reader that entered before the last move has left.
+ * With a spill file, the values past the memory budget of the shard that
+ * were used least recently are swapped for SpilledValues.
+ * Author: gomes.chri, modi.an
+ */
+class KVShard : public Object {
+   public:
+    std::atomic<KVTable*> table_;
+    std::atomic<size_t> count_;        // keys with a value
+    std::atomic<size_t> epoch_;
+    std::atomic<size_t> readers_[2];   // readers in an even and an odd epoch
+    std::vector<Object*> retired_[2];  // retired in an even and an odd epoch, under l_
+    Lock l_;                           // held by writers and waiters
+    SpillFile* spill_;                 // external, nullptr to keep everything in memory
+    size_t budget_;                    // bytes of values to keep in memory
+    bool evicting_;                    // while a thread spills values, under l_
+    std::atomic<size_t> resident_;     // bytes of values in memory
+    std::atomic<size_t> clock_;        // puts so far, to order uses
+    std::atomic<size_t> hits_;         // gets served from memory, when spilling
+    std::atomic<size_t> misses_;       // gets served from the spill file
+
+    KVShard()
+        : Object(),
+          table_(new KVTable(KVSTORE_BUCKETS)),
+          count_(0),
+          epoch_(0),
+          spill_(nullptr),
+          budget_(0),
+          evicting_(false),
+          resident_(0),
+          clock_(0),
+          hits_(0),
+          misses_(0) {
+        readers_[0].store(0);
+        readers_[1].store(0);
+    }
+
+    virtual ~KVShard() {
+        KVTable* t = table_.load();
+        for (size_t i = 0; i < t->size_; i++) {
+            for (KVNode* n = t->buckets_[i].load(); n != nullptr; n = n->next_) {
+                delete n->entry_->v_.load();
+                delete n->entry_;
+            }
+        }
+        delete t;
+        for (std::vector<Object*>& retired : retired_) {
+            for (Object* o : retired) {
+                delete o;
+            }
+        }
+    }
+
+    /**
+     * Starts a read, which keeps everything reachable from the table alive
+     * until exit_.
+     * @return the parity of the epoch, to pass to exit_
+     */
+    size_t enter_() {
+        while (true) {
+            size_t e = epoch_.load();
+            readers_[e & 1]++;
+            // a writer may have moved on before it could see this reader
+            if (epoch_.load() == e) {
+                return e & 1;
+            }
+            readers_[e & 1]--;
+        }
+    }
+
+    /** Ends a read started by enter_. */
+    void exit_(size_t parity) {
+        readers_[parity]--;
+    }
+
+    /**
+     * Copies the value at a key without locking.
+     * @return the copy, or nullptr if the key has no value
+     */
+    Value* read_(Key& k, size_t code) {
+        size_t parity = enter_();
+        KVEntry* e = table_.load()->find(k, code);
+        Value* v = e == nullptr ? nullptr : e->v_.load();
+        if (v != nullptr && spill_ != nullptr) {
+            touch_(e, v);
+        }
+        Value* result = v == nullptr ? nullptr : v->clone();
+        exit_(parity);
+        return result;
+    }
+
+    /**
+     * Copies the value at a key without locking, unless it is still the one
+     * with the given stamp.
+     * @arg stamp  the stamp of the value the caller has, or 0; set to the
+     *   stamp of the value at the key, or 0 if it has none
+     * @return the copy, or nullptr if the stamp is the same or there is no value
+     */
+    Value* refresh_(Key& k, size_t code, size_t& stamp) {
+        size_t parity = enter_();
+        KVEntry* e = table_.load()->find(k, code);
+        // puts set the stamp after the value, so a value is never older than a stamp read before it
+        size_t now = e == nullptr ? 0 : e->stamp_.load();
+        Value* v = e == nullptr ? nullptr : e->v_.load();
+        Value* result = nullptr;
+        if (v == nullptr) {
+            now = 0;
+        } else if (now != stamp) {
+            if (spill_ != nullptr) {
+                touch_(e, v);
+            }
+            result = v->clone();
+        }
+        stamp = now;
+        exit_(parity);
+        return result;
+    }
+
+    /** Marks an entry as just used and counts where its value was found. */
+    void touch_(KVEntry* e, Value* v) {
+        size_t now = clock_.load();
+        // skips the store when it would change nothing, so hot keys stay shared in caches
+        if (e->used_.load() != now) {
+            e->used_.store(now);
+        }
+        if (dynamic_cast<SpilledValue*>(v) == nullptr) {
+            hits_++;
+        } else {
+            misses_++;
+        }
+    }
+
+    /**
+     * The bytes a stored value takes in memory, which is nothing for the
+     * subclasses of Value that read their bytes from a file.
+     */
+    static size_t resident_size_(Value* v) {
+        return typeid(*v) == typeid(Value) ? v->size() : 0;
+    }
+
+    /**
+     * Swaps the values used least recently for SpilledValues once the shard
+     * holds more than its budget, until it holds at most three quarters of
+     * it, so that the table is not scanned on every put. The values are
+     * picked under l_ but written out without it, inside an epoch that keeps
+     * them alive, and only swapped under l_ again if they were not put over
+     * meanwhile. Takes l_.
+     */
+    void evict_() {
+        if (spill_ == nullptr || resident_.load() <= budget_) {
+            return;
+        }
+        l_.lock();
+        if (evicting_ || resident_.load() <= budget_) {
+            l_.unlock();
+            return;
+        }
+        evicting_ = true;
+        std::vector<KVEntry*> cold;
+        KVTable* t = table_.load();
+        for (size_t i = 0; i < t->size_; i++) {
+            for (KVNode* n = t->buckets_[i].load(); n != nullptr; n = n->next_) {
+                Value* v = n->entry_->v_.load();
+                if (v != nullptr && resident_size_(v) >= KVSTORE_SPILL_MIN) {
+                    cold.push_back(n->entry_);
+                }
+            }
+        }
+        std::sort(cold.begin(), cold.end(),
+                  [](KVEntry* a, KVEntry* b) { return a->used_.load() < b->used_.load(); });
+        std::vector<KVEntry*> entries;
+        std::vector<Value*> values;
+        size_t left = resident_.load();
+        for (KVEntry* e : cold) {
+            if (left <= budget_ / 4 * 3) {
+                break;
+            }
+            entries.push_back(e);
+            values.push_back(e->v_.load());
+            left -= values.back()->size();
+        }
+        size_t parity = enter_();
+        l_.unlock();
+        std::vector<Value*> spilled;
+        for (Value* v : values) {
+            spilled.push_back(new SpilledValue(spill_, v));
+        }
+        l_.lock();
+        for (size_t i = 0; i < entries.size(); i++) {
+            // the epoch keeps the value alive, so no other value can be at its address
+            if (entries[i]->v_.load() != values[i]) {
+                delete spilled[i];
+                continue;
+            }
+            entries[i]->v_.store(spilled[i]);
+            resident_ -= values[i]->size();
+            retire_(values[i]);
+        }
+        evicting_ = false;
+        l_.unlock();
+        exit_(parity);
+    }
+
+    /** Gets the entry of a key, adding it if needed. Under l_. */
+    KVEntry* entry_(Key& k, size_t code) {
+        KVTable* t = table_.load();
+        KVEntry* e = t->find(k, code);
+        if (e != nullptr) {
+            return e;
+        }
+        if (t->entries_ >= 2 * t->size_) {
+            t = rebuild_();
+        }
+        e = new KVEntry(k, code);
+        t->add(e);
+        return e;
+    }
+
+    /**
+     * Publishes a table sized for the keys with a value, dropping the
+     * idle entries of taken keys. Under l_.
+     */
+    KVTable* rebuild_() {
+        KVTable* old = table_.load();
+        KVTable* t = new KVTable(std::max(KVSTORE_BUCKETS, 2 * count_.load()));
+        for (size_t i = 0; i < old->size_; i++) {
+            for (KVNode* n = old->buckets_[i].load(); n != nullptr; n = n->next_) {
+                if (n->entry_->idle()) {
+                    retire_(n->entry_);
+                } else {
+                    t->add(n->entry_);
+                }
+            }
+        }
+        table_.store(t);
+        retire_(old);
+        return t;
+    }
+
+    /**
+     * Waits until a key has a value, woken only by puts and removes of that
+     * key, or until a deadline passes. The entry stays linked while it is
+     * waited on. Under l_.
+     * @arg deadline  when to give up, or nullptr to wait for good
+     * @return the entry, now with a value, or nullptr if the deadline passed
+     *   or the key was removed
+     */
+    KVEntry* wait_(Key& k, size_t code, std::chrono::steady_clock::time_point* deadline) {
+        KVEntry* e = entry_(k, code);
+        e->waiting_++;
+        bool timed_out = false;
+        while (e->v_.load() == nullptr && !e->removed_.load() && !timed_out) {
+            if (deadline == nullptr) {
+                e->cv_.wait(l_.mtx_);
+            } else {
+                timed_out = e->cv_.wait_until(l_.mtx_, *deadline) == std::cv_status::timeout;
+            }
+        }
+        e->waiting_--;
+        return e->v_.load() == nullptr ? nullptr : e;
+    }
+
+    /** Frees an object once no reader can reach it. Under l_. */
+    void retire_(Object* o) {
+        retired_[epoch_.load() & 1].push_back(o);
+    }
+
+    /**
+     * Frees what was retired in the previous epoch and moves to the next,
+     * unless a reader that entered in the previous epoch is still running.
+     * Under l_.
+     */
+    void reclaim_() {
+        size_t e = epoch_.load();
+        size_t previous = (e + 1) & 1;
+        if (readers_[previous].load() != 0) {
+            return;
+        }
+        for (Object* o : retired_[previous]) {
+            delete o;
+        }
+        retired_[previous].clear();
+        epoch_.store(e + 1);
+    }
+};
+
 /**
- * Key value store.
+ * Key value store. The local keys are split over KVSTORE_SHARDS shards by
+ * their hash. Gets of local keys never take a lock, since the values are
+ * immutable once put and are only freed when no reader can see them; puts
+ * and waiters lock just their shard, so that requests for different keys
+ * from the application and from the connections to other nodes rarely wait
+ * on each other. Waiters for a key sleep on its own entry, so a put only
+ * wakes the threads waiting for that key, and a callback can wait instead
+ * of a thread. A store can be given a memory budget, past which it spills
+ * the values used least recently to a file; values are immutable once put,
+ * so a spilled one never needs to be written back.
  * Author: gomes.chri, modi.an
  */
 class KVStore : public Object {
    public:
-    std::unordered_map<Key, Value*> items_;
+    KVShard shards_[KVSTORE_SHARDS];
     NetworkIfc* net_;
-    Lock l_;
+    SpillFile* spill_;            // owned, nullptr unless spilling
+    RemoteCache* cache_;          // owned, nullptr unless caching remote values
+    std::atomic<size_t> stamps_;  // puts so far, which stamp the values put
 
-    KVStore() : Object() {
-        items_ = std::unordered_map<Key, Value*>();
+    KVStore() : Object(), stamps_(0) {
         net_ = nullptr;
+        spill_ = nullptr;
+        cache_ = nullptr;
     }
 
-    KVStore(NetworkIfc* net) : Object() {
+    KVStore(NetworkIfc* net) : Object(), stamps_(0) {
         assert(net != nullptr);
-        items_ = std::unordered_map<Key, Value*>();
         net_ = net;
+        spill_ = nullptr;
+        cache_ = nullptr;
     }
 
     virtual ~KVStore() {
-        for (std::unordered_map<Key, Value*>::iterator it = items_.begin(); it != items_.end();
-             it++) {
-            delete it->second;
+        // the shards only hold SpilledValues pointing at the file, which never read it
+        delete spill_;
+        delete cache_;
+    }
+
+    /**
+     * Keeps about the given number of bytes of values in memory, and spills
+     * the values of this node used least recently past that to an
+     * append-only file. Must be called before the store is used.
+     * @arg path  where to create the file
+     * @arg budget  the bytes of values to keep in memory
+     */
+    void spill_to(const char* path, size_t budget) {
+        assert(spill_ == nullptr);
+        spill_ = new SpillFile(path);
+        for (KVShard& shard : shards_) {
+            shard.spill_ = spill_;
+            shard.budget_ = budget / KVSTORE_SHARDS;
+        }
+    }
+
+    /**
+     * Keeps copies of the values this node gets from other nodes, about the
+     * given number of bytes of them, so that reading them again does not
+     * send them over the network, see RemoteCache. Like the frames of a
+     * KDStore, every read of a copy first checks its stamp with the home
+     * node of the key, in the same request as the other keys of a
+     * multi_get, so puts on any node are seen right away. Must be called
+     * before the store is used.
+     * @arg budget  the bytes of values to keep
+     */
+    void cache_remote(size_t budget) {
+        assert(cache_ == nullptr);
+        cache_ = new RemoteCache(budget);
+    }
+
+    /**
+     * Drops the cached copy of the value at a remote key, if any, so that
+     * the next get fetches it again.
+     * @arg k  the key
+     */
+    void forget(Key& k) {
+        if (cache_ != nullptr) {
+            cache_->drop(k);
+        }
+    }
+
+    /**
+     * Gets how the gets of local keys were served and how much was spilled.
+     * Hits are only counted while spilling, and remote hits while caching.
+     * @return the counts
+     */
+    KVStats stats() {
+        KVStats result = {0, 0, 0, spill_ == nullptr ? 0 : spill_->end_.load(), 0, 0};
+        for (KVShard& shard : shards_) {
+            result.hits_ += shard.hits_.load();
+            result.misses_ += shard.misses_.load();
+            result.resident_ += shard.resident_.load();
+        }
+        if (cache_ != nullptr) {
+            cache_->l_.lock();
+            result.remote_hits_ = cache_->hits_;
+            result.remote_misses_ = cache_->misses_;
+            cache_->l_.unlock();
         }
+        return result;
+    }
+
+    /** Finds the shard holding a local key with the given hash. */
+    KVShard& shard_(size_t code) {
+        return shards_[code % KVSTORE_SHARDS];
     }
 
     /**
@@ -40,28 +566,314 @@ class KVStore : public Object {
      * @return if it exists in the store
      */
     virtual bool in_(Key& k) {
-        return items_.find(k) != items_.end();
+        size_t code = std::hash<Key>()(k);
+        KVShard& shard = shard_(code);
+        size_t parity = shard.enter_();
+        KVEntry* e = shard.table_.load()->find(k, code);
+        bool result = e != nullptr && e->v_.load() != nullptr;
+        shard.exit_(parity);
+        return result;
+    }
+
+    /**
+     * Gets the number of values held by this node.
+     * @return the number of values
+     */
+    virtual size_t size() {
+        size_t result = 0;
+        for (KVShard& shard : shards_) {
+            result += shard.count_.load();
+        }
+        return result;
+    }
+
+    /**
+     * Gets the keys of the values held by this node, in no particular order.
+     * @return the keys
+     */
+    virtual std::vector<Key> keys() {
+        std::vector<Key> result;
+        each([&result](Key& k, Value* v) { result.push_back(k); });
+        return result;
+    }
+
+    /**
+     * Calls a function with every key held by this node and its stored
+     * value, which must not be kept. The values of a shard are collected
+     * under its lock, and the function is called once the lock is released,
+     * inside an epoch that keeps them alive, so it may be slow without
+     * holding up puts.
+     * @arg f  the function
+     */
+    void each(std::function<void(Key&, Value*)> f) {
+        for (KVShard& shard : shards_) {
+            std::vector<KVEntry*> entries;
+            std::vector<Value*> values;
+            shard.l_.lock();
+            KVTable* t = shard.table_.load();
+            for (size_t i = 0; i < t->size_; i++) {
+                for (KVNode* n = t->buckets_[i].load(); n != nullptr; n = n->next_) {
+                    Value* v = n->entry_->v_.load();
+                    if (v != nullptr) {
+                        entries.push_back(n->entry_);
+                        values.push_back(v);
+                    }
+                }
+            }
+            size_t parity = shard.enter_();
+            shard.l_.unlock();
+            for (size_t i = 0; i < entries.size(); i++) {
+                f(entries[i]->k_, values[i]);
+            }
+            shard.exit_(parity);
+        }
     }
 
     /**
      * Gets the value at the given key.
-     * Returns a copy of the value.
+     * Returns a copy of the value. Local keys are read without locking.
      * @arg k  the key
      * @return the value
      */
     virtual Value* get(Key& k) {
         if (k.node_ == this_node()) {
-            l_.lock();
-            assert(items_.find(k) != items_.end());
-            Value* result = items_.at(k);
-            l_.unlock();
-            return result->clone();
+            size_t code = std::hash<Key>()(k);
+            Value* result = shard_(code).read_(k, code);
+            assert(result != nullptr);
+            return result;
+        } else {
+            Value* result = fetch_(k, false);
+            assert(result != nullptr);
+            return result;
+        }
+    }
+
+    /**
+     * Gets the value at a remote key from the cache, or else from its node,
+     * caching it.
+     * @arg k  the key
+     * @arg wait  whether to wait for the key to have a value
+     * @return a copy of the value
+     */
+    Value* fetch_(Key& k, bool wait) {
+        assert(net_ != nullptr);
+        while (cache_ != nullptr) {
+            size_t stamp = cache_->stamp(k);
+            Value* result = net_->refresh_from_node(k.node_, k, stamp);
+            if (result != nullptr) {
+                cache_->put(k, stamp, result);
+                return result;
+            }
+            if (stamp == 0) {
+                // nothing there yet, so the value is cached by the next read
+                break;
+            }
+            result = cache_->get(k, stamp);
+            if (result != nullptr) {
+                return result;
+            }
+            // evicted since, so the next round asks for the value itself
+        }
+        if (wait) {
+            return net_->wait_and_get_from_node(k.node_, k);
         } else {
-            assert(net_ != nullptr);
             return net_->get_from_node(k.node_, k);
         }
     }
 
+    /**
+     * Gets the value at the given key if it changed since the caller got
+     * it, which costs one small round trip for a remote key when it did not.
+     * Values are stamped with a counter of their home node that goes up with
+     * every put there and never starts over, so a stamp is never seen again
+     * for another value, even once the key is taken and put again.
+     * @arg k  the key
+     * @arg stamp  the stamp of the value the caller has, or 0 for none; set
+     *   to the stamp of the value at the key, or 0 if it has none
+     * @return a copy of the value, or nullptr if the caller has it or there
+     *   is none
+     */
+    virtual Value* refresh(Key& k, size_t& stamp) {
+        if (k.node_ == this_node()) {
+            size_t code = std::hash<Key>()(k);
+            return shard_(code).refresh_(k, code, stamp);
+        } else {
+            assert(net_ != nullptr);
+            return net_->refresh_from_node(k.node_, k, stamp);
+        }
+    }
+
+    /**
+     * Gets the values at several keys, which may live on any nodes. Each
+     * other node is asked once for all of its keys, and all of them at the
+     * same time, so a batch costs about one round trip instead of one per
+     * key. Cached copies that are still current are not sent again.
+     * @arg keys  the keys
+     * @return copies of the values, in the order of the keys, with nullptr
+     *   for a key that has no value
+     */
+    virtual std::vector<Value*> multi_get(std::vector<Key>& keys) {
+        std::vector<Value*> result(keys.size(), nullptr);
+        std::vector<std::vector<Key>> remote(num_nodes());
+        std::vector<std::vector<size_t>> stamps(num_nodes());
+        std::vector<std::vector<size_t>> positions(num_nodes());
+        bool any_remote = false;
+        for (size_t i = 0; i < keys.size(); i++) {
+            size_t node = keys[i].node_;
+            assert(node < num_nodes());
+            if (node == this_node()) {
+                size_t code = std::hash<Key>()(keys[i]);
+                result[i] = shard_(code).read_(keys[i], code);
+                continue;
+            }
+            remote[node].push_back(keys[i]);
+            stamps[node].push_back(cache_ == nullptr ? 0 : cache_->stamp(keys[i]));
+            positions[node].push_back(i);
+            any_remote = true;
+        }
+        if (!any_remote) {
+            return result;
+        }
+        assert(net_ != nullptr);
+        std::vector<std::vector<Value*>> values = net_->multi_get_from_nodes(remote, stamps);
+        for (size_t node = 0; node < values.size(); node++) {
+            for (size_t j = 0; j < values[node].size(); j++) {
+                Value* v = values[node][j];
+                if (v != nullptr) {
+                    if (cache_ != nullptr) {
+                        cache_->put(remote[node][j], stamps[node][j], v);
+                    }
+                } else if (stamps[node][j] == 0) {
+                    // the key has no value, so a cached copy is stale
+                    forget(remote[node][j]);
+                } else if (cache_ != nullptr) {
+                    v = cache_->get(remote[node][j], stamps[node][j]);
+                    if (v == nullptr) {
+                        // evicted since it was asked for
+                        v = fetch_(remote[node][j], false);
+                    }
+                }
+                result[positions[node][j]] = v;
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Puts values at several keys, which may live on any nodes, with one
+     * message to each other node. Copies the keys and consumes the values.
+     * @arg pairs  the keys and their values
+     */
+    virtual void multi_put(std::vector<std::pair<Key, Value*>>& pairs) {
+        std::vector<std::vector<Key>> keys(num_nodes());
+        std::vector<std::vector<Value*>> values(num_nodes());
+        for (std::pair<Key, Value*>& pair : pairs) {
+            size_t node = pair.first.node_;
+            assert(node < num_nodes());
+            if (node == this_node()) {
+                put(pair.first, pair.second);
+            } else {
+                keys[node].push_back(pair.first);
+                values[node].push_back(pair.second);
+            }
+        }
+        for (size_t node = 0; node < keys.size(); node++) {
+            if (!keys[node].empty()) {
+                assert(net_ != nullptr);
+                net_->multi_put_at_node(node, keys[node], values[node]);
+                for (Key& k : keys[node]) {
+                    forget(k);
+                }
+            }
+        }
+    }
+
+    /**
+     * Removes the value at the given key, if it has one, wherever it lives.
+     * @arg k  the key
+     */
+    virtual void remove(Key& k) {
+        std::vector<Key> keys(1, k);
+        remove(keys);
+    }
+
+    /**
+     * Removes the values at several keys, which may live on any nodes, with
+     * one message to each other node. Keys without a value are skipped.
+     * Readers may still hold a removed value, which is freed once they are
+     * done. Waits for a removed key, whether already waiting or started
+     * before the next put of it, get nullptr instead of blocking. The space
+     * of spilled values is not given back to the file.
+     * @arg keys  the keys
+     */
+    virtual void remove(std::vector<Key>& keys) {
+        std::vector<std::vector<Key>> remote(num_nodes());
+        for (Key& k : keys) {
+            assert(k.node_ < num_nodes());
+            if (k.node_ == this_node()) {
+                remove_local_(k);
+            } else {
+                remote[k.node_].push_back(k);
+            }
+        }
+        for (size_t node = 0; node < remote.size(); node++) {
+            if (!remote[node].empty()) {
+                assert(net_ != nullptr);
+                net_->remove_at_node(node, remote[node]);
+                for (Key& k : remote[node]) {
+                    forget(k);
+                }
+            }
+        }
+    }
+
+    /** Removes the value at a local key, if it has one, and fails the waits for it. */
+    void remove_local_(Key& k) {
+        size_t code = std::hash<Key>()(k);
+        KVShard& shard = shard_(code);
+        std::vector<KVCallback> callbacks;
+        shard.l_.lock();
+        KVEntry* e = shard.table_.load()->find(k, code);
+        if (e == nullptr) {
+            shard.l_.unlock();
+            return;
+        }
+        Value* removed = e->v_.exchange(nullptr);
+        if (removed != nullptr) {
+            shard.count_--;
+            shard.resident_ -= KVShard::resident_size_(removed);
+            shard.retire_(removed);
+            shard.reclaim_();
+        }
+        e->removed_.store(true);
+        if (e->waiting_ > 0) {
+            e->cv_.notify_all();
+        }
+        callbacks.swap(e->callbacks_);
+        shard.l_.unlock();
+        for (KVCallback& done : callbacks) {
+            done(nullptr);
+        }
+    }
+
+    /**
+     * Gets how many values were put at the given key. Starts at 0 and goes
+     * up with every put; may start over once the key is taken or removed.
+     * The key must live on this node.
+     * @arg k  the key
+     * @return the version
+     */
+    virtual size_t version(Key& k) {
+        assert(k.node_ == this_node());
+        size_t code = std::hash<Key>()(k);
+        KVShard& shard = shard_(code);
+        size_t parity = shard.enter_();
+        KVEntry* e = shard.table_.load()->find(k, code);
+        size_t result = e == nullptr ? 0 : e->version_.load();
+        shard.exit_(parity);
+        return result;
+    }
+
     /**
      * Gets the number of nodes that the store is operating over.
      * @return number of nodes
@@ -89,43 +901,248 @@ class KVStore : public Object {
     /**
      * Waits until there is a value at the given key and then gets it.
      * @arg k  the key
-     * @return the value
+     * @return the value, or nullptr if the key was removed
      */
     virtual Value* waitAndGet(Key& k) {
         if (k.node_ == this_node()) {
-            l_.lock();
-            while (items_.find(k) == items_.end()) {
-                l_.wait();
+            return wait_local_(k, nullptr);
+        } else {
+            return fetch_(k, true);
+        }
+    }
+
+    /**
+     * Waits at most the given time for a value at the given key and then
+     * gets it. A wait for a remote key that gives up stays registered on
+     * the node of the key until the key is put, and the value then sent
+     * here is dropped.
+     * @arg k  the key
+     * @arg millis  how long to wait
+     * @return the value, or nullptr if none was put in time or the key was
+     *   removed
+     */
+    virtual Value* waitAndGet(Key& k, size_t millis) {
+        if (k.node_ != this_node()) {
+            assert(net_ != nullptr);
+            std::shared_ptr<TimedReply> reply = std::make_shared<TimedReply>();
+            std::future<Value*> f = reply->p_.get_future();
+            net_->wait_and_get_from_node_async(k.node_, k,
+                                               [reply](Value* v) { reply->arrive(v); });
+            if (f.wait_for(std::chrono::milliseconds(millis)) == std::future_status::ready) {
+                return f.get();
             }
-            Value* result = items_.at(k);
-            l_.unlock();
-            return result->clone();
+            reply->l_.lock();
+            reply->gave_up_ = true;
+            reply->l_.unlock();
+            // the value may have arrived between the wait and giving up
+            if (f.wait_for(std::chrono::milliseconds(0)) == std::future_status::ready) {
+                return f.get();
+            }
+            return nullptr;
+        }
+        std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::now() + std::chrono::milliseconds(millis);
+        return wait_local_(k, &deadline);
+    }
+
+    /**
+     * Calls a function with the value at the given key once there is one,
+     * without holding up a thread meanwhile: right away if the key has a
+     * value, otherwise from the thread of the put that gives it one, after
+     * the put is done. The key must live on this node.
+     * @arg k  the key
+     * @arg done  called with a copy of the value, or nullptr once the key
+     *   is removed
+     */
+    virtual void waitAndCall(Key& k, KVCallback done) {
+        assert(k.node_ == this_node());
+        size_t code = std::hash<Key>()(k);
+        KVShard& shard = shard_(code);
+        shard.l_.lock();
+        KVEntry* e = shard.entry_(k, code);
+        Value* v = e->v_.load();
+        if (v == nullptr && !e->removed_.load()) {
+            e->callbacks_.push_back(done);
+            shard.l_.unlock();
+            return;
+        }
+        Value* copy = v == nullptr ? nullptr : v->clone();
+        shard.l_.unlock();
+        done(copy);
+    }
+
+    /**
+     * Gets the value at the given key without blocking, and calls a function
+     * with a copy of it: right away for a local key, and from a network
+     * thread once the reply arrives for a remote one, so the function must
+     * not wait on the store itself.
+     * @arg k  the key
+     * @arg done  called with the value
+     */
+    virtual void get_async(Key& k, KVCallback done) {
+        if (k.node_ == this_node()) {
+            done(get(k));
         } else {
             assert(net_ != nullptr);
-            return net_->wait_and_get_from_node(k.node_, k);
+            net_->get_from_node_async(k.node_, k, done);
+        }
+    }
+
+    /**
+     * Gets the value at the given key without blocking.
+     * @arg k  the key
+     * @return the future of a copy of the value
+     */
+    virtual std::future<Value*> get_async(Key& k) {
+        std::future<Value*> result;
+        get_async(k, NetworkIfc::promise_(result));
+        return result;
+    }
+
+    /**
+     * Gets the value at the given key once there is one without blocking,
+     * and calls a function with a copy of it, see waitAndCall for a local
+     * key and get_async for a remote one.
+     * @arg k  the key
+     * @arg done  called with the value
+     */
+    virtual void wait_and_get_async(Key& k, KVCallback done) {
+        if (k.node_ == this_node()) {
+            waitAndCall(k, done);
+        } else {
+            assert(net_ != nullptr);
+            net_->wait_and_get_from_node_async(k.node_, k, done);
+        }
+    }
+
+    /**
+     * Gets the value at the given key once there is one without blocking.
+     * @arg k  the key
+     * @return the future of a copy of the value
+     */
+    virtual std::future<Value*> wait_and_get_async(Key& k) {
+        std::future<Value*> result;
+        wait_and_get_async(k, NetworkIfc::promise_(result));
+        return result;
+    }
+
+    /**
+     * Puts the value at the given key without waiting for a remote node to
+     * store it. Copies the Key and consumes the Value.
+     * @arg k  the key to put the value at
+     * @arg v  the value to put in the store
+     * @return a future that is ready once the value is stored
+     */
+    virtual std::future<void> put_async(Key& k, Value* v) {
+        std::shared_ptr<std::promise<void>> stored = std::make_shared<std::promise<void>>();
+        if (k.node_ == this_node()) {
+            put(k, v);
+            stored->set_value();
+        } else {
+            assert(net_ != nullptr);
+            net_->put_at_node_async(k.node_, k, v, [stored](Value* ack) {
+                delete ack;
+                stored->set_value();
+            });
+            forget(k);
+        }
+        return stored->get_future();
+    }
+
+    /**
+     * Gets the value at a local key, first without locking and then by
+     * waiting on its entry.
+     * @arg deadline  when to give up, or nullptr to wait for good
+     * @return a copy of the value, or nullptr if the deadline passed
+     */
+    Value* wait_local_(Key& k, std::chrono::steady_clock::time_point* deadline) {
+        size_t code = std::hash<Key>()(k);
+        KVShard& shard = shard_(code);
+        Value* result = shard.read_(k, code);
+        if (result != nullptr) {
+            return result;
+        }
+        // puts notify under the lock, so none is missed between the reads
+        shard.l_.lock();
+        KVEntry* e = shard.wait_(k, code, deadline);
+        result = e == nullptr ? nullptr : e->v_.load()->clone();
+        shard.l_.unlock();
+        return result;
+    }
+
+    /**
+     * Waits until there is a value at the given key, then removes it from
+     * the store. The key must live on this node. Readers may still hold the
+     * stored value, so the caller gets a copy.
+     * @arg k  the key
+     * @return the value, owned by the caller, or nullptr if the key was
+     *   removed
+     */
+    virtual Value* waitAndTake(Key& k) {
+        assert(k.node_ == this_node());
+        size_t code = std::hash<Key>()(k);
+        KVShard& shard = shard_(code);
+        shard.l_.lock();
+        KVEntry* e = shard.wait_(k, code, nullptr);
+        if (e == nullptr) {
+            shard.l_.unlock();
+            return nullptr;
         }
+        Value* taken = e->v_.exchange(nullptr);
+        shard.count_--;
+        shard.resident_ -= KVShard::resident_size_(taken);
+        Value* result = taken->clone();
+        shard.retire_(taken);
+        shard.reclaim_();
+        shard.l_.unlock();
+        return result;
     }
 
     /**
      * Puts the value at the given key.
-     * Copies the Key and consumes the Value.
+     * Copies the Key and consumes the Value. Wakes the waiters for the key
+     * and then calls its callbacks from this thread.
      * @arg k  the key to put the value at
      * @arg v  the value to put in the store
      */
     virtual void put(Key& k, Value* v) {
         if (k.node_ == this_node()) {
-            l_.lock();
-            if (items_.find(k) != items_.end()) {
-                delete items_[k];
-                items_[k] = v;
+            size_t code = std::hash<Key>()(k);
+            KVShard& shard = shard_(code);
+            std::vector<KVCallback> callbacks;
+            std::vector<Value*> copies;
+            shard.l_.lock();
+            KVEntry* e = shard.entry_(k, code);
+            Value* old = e->v_.exchange(v);
+            shard.resident_ += KVShard::resident_size_(v);
+            if (old != nullptr) {
+                shard.resident_ -= KVShard::resident_size_(old);
+                shard.retire_(old);
             } else {
-                items_[Key(k)] = v;
+                shard.count_++;
             }
-            l_.notify_all();
-            l_.unlock();
+            e->version_++;
+            e->stamp_.store(++stamps_);
+            e->removed_.store(false);
+            e->used_.store(++shard.clock_);
+            if (e->waiting_ > 0) {
+                e->cv_.notify_all();
+            }
+            callbacks.swap(e->callbacks_);
+            for (size_t i = 0; i < callbacks.size(); i++) {
+                copies.push_back(v->clone());
+            }
+            shard.reclaim_();
+            shard.l_.unlock();
+            for (size_t i = 0; i < callbacks.size(); i++) {
+                callbacks[i](copies[i]);
+            }
+            shard.evict_();
         } else {
             assert(net_ != nullptr);
             net_->put_at_node(k.node_, k, v);
+            // once sent, as gets sent later to the node are answered after the put
+            forget(k);
         }
     }
 };
@@ -134,17 +1151,82 @@ class KVStore : public Object {
 
 inline void Connection::handle_get_message_(Deserializer& d) {
     Get g(&d);
-    Reply r(local_store_->get(g.k_));
+    // a key without a value is answered with nullptr, for the asking node to fail on
+    size_t stamp = 0;
+    Reply r(local_store_->refresh(g.k_, stamp));
+    r.id_ = g.id_;
     send_message(&r);
 }
 
 inline void Connection::handle_put_message_(Deserializer& d) {
     Put p(&d);
     local_store_->put(p.k_, p.v_->clone());
+    // a put with an id waits to hear that the value is stored
+    if (p.id_ != 0) {
+        Reply r(new Value());
+        r.id_ = p.id_;
+        send_message(&r);
+    }
+}
+
+inline void Connection::handle_multi_get_message_(Deserializer& d) {
+    MultiGet g(&d);
+    Serializer s;
+    for (size_t i = 0; i < g.keys_.size(); i++) {
+        size_t stamp = g.stamps_[i];
+        // a key without a value is answered with stamp 0 and no value
+        Value* v = local_store_->refresh(g.keys_[i], stamp);
+        s.add_size_t(stamp);
+        s.add_bool(v != nullptr);
+        if (v != nullptr) {
+            v->serialize(&s);
+            delete v;
+        }
+    }
+    Reply r(new Value(s.get_bytes(), s.size()));
+    r.id_ = g.id_;
+    send_message(&r);
+}
+
+inline void Connection::handle_multi_put_message_(Deserializer& d) {
+    MultiPut p(&d);
+    for (size_t i = 0; i < p.keys_.size(); i++) {
+        local_store_->put(p.keys_[i], p.values_[i]);
+    }
+    // the store took the values
+    p.values_.clear();
+}
+
+inline void Connection::handle_remove_message_(Deserializer& d) {
+    Remove r(&d);
+    local_store_->remove(r.keys_);
+}
+
+inline void Connection::handle_refresh_message_(Deserializer& d) {
+    Refresh f(&d);
+    size_t stamp = f.stamp_;
+    Value* v = local_store_->refresh(f.k_, stamp);
+    // the stamp, then the value if it changed
+    Serializer s;
+    s.add_size_t(stamp);
+    if (v != nullptr) {
+        v->serialize(&s);
+        delete v;
+    }
+    Reply r(new Value(s.get_bytes(), s.size()));
+    r.id_ = f.id_;
+    send_message(&r);
 }
 
 inline void Connection::handle_wait_and_get_message_(Deserializer& d) {
     WaitAndGet g(&d);
-    Reply r(local_store_->waitAndGet(g.k_));
-    send_message(&r);
+    // replies from the thread of the put, so this one goes on with other messages, and through
+    // the route, which drops the reply if this connection is gone by then
+    size_t id = g.id_;
+    std::shared_ptr<ReplyRoute> route = route_;
+    local_store_->waitAndCall(g.k_, [route, id](Value* v) {
+        Reply r(v);
+        r.id_ = id;
+        route->send_message(&r);
+    });
 }
@@ -0,0 +1,134 @@
+#pragma once
+#include <assert.h>
+
+#include <list>
+#include <unordered_map>
+
+#include "key.h"
+#include "util/lock.h"
+#include "util/object.h"
+#include "value.h"
+
+/**
+ * A value fetched from another node, the stamp it had there (see
+ * KVStore::refresh) and its place in the order of use.
+ * Author: gomes.chri, modi.an
+ */
+class RemoteValue : public Object {
+   public:
+    Value* v_;  // owned
+    size_t stamp_;
+    std::list<Key>::iterator used_;
+
+    RemoteValue(Value* v, size_t stamp, std::list<Key>::iterator used)
+        : Object(), v_(v), stamp_(stamp), used_(used) {}
+};
+
+/**
+ * Keeps copies of values fetched from other nodes, so that reading them
+ * again does not send them over the network. Holds about a budget of bytes
+ * and evicts the values used least recently past it. Every copy is kept
+ * with its stamp, which the home node of the key checks before the copy is
+ * used, so a value put again on any node is never read stale. Safe to use
+ * from any number of threads.
+ * Author: gomes.chri, modi.an
+ */
+class RemoteCache : public Object {
+   public:
+    Lock l_;
+    size_t budget_;        // bytes of values to keep
+    size_t size_;          // bytes of values kept, under l_
+    size_t hits_;          // gets served from the cache, under l_
+    size_t misses_;        // gets that had to be fetched, under l_
+    std::list<Key> used_;  // keys kept, most recently used first, under l_
+    std::unordered_map<Key, RemoteValue> values_;
+
+    RemoteCache(size_t budget) : Object(), budget_(budget), size_(0), hits_(0), misses_(0) {}
+
+    virtual ~RemoteCache() {
+        for (auto& item : values_) {
+            delete item.second.v_;
+        }
+    }
+
+    /**
+     * Gets the stamp of the copy kept at a key, to ask its home node
+     * whether it is still current.
+     * @arg k  the key
+     * @return the stamp, or 0 if no copy is kept
+     */
+    size_t stamp(Key& k) {
+        l_.lock();
+        std::unordered_map<Key, RemoteValue>::iterator it = values_.find(k);
+        size_t result = it == values_.end() ? 0 : it->second.stamp_;
+        l_.unlock();
+        return result;
+    }
+
+    /**
+     * Gets a copy of the value at a key if it is kept with the given stamp.
+     * @arg k  the key
+     * @arg stamp  the stamp the home node has
+     * @return the copy, or nullptr if it was evicted or replaced since
+     */
+    Value* get(Key& k, size_t stamp) {
+        l_.lock();
+        std::unordered_map<Key, RemoteValue>::iterator it = values_.find(k);
+        if (it == values_.end() || it->second.stamp_ != stamp) {
+            l_.unlock();
+            return nullptr;
+        }
+        hits_++;
+        used_.splice(used_.begin(), used_, it->second.used_);
+        Value* result = it->second.v_->clone();
+        l_.unlock();
+        return result;
+    }
+
+    /**
+     * Keeps a copy of a fetched value in place of the one kept at the key,
+     * unless it is larger than the whole budget.
+     * @arg k  the key
+     * @arg stamp  the stamp of the value on its home node
+     * @arg v  the value, external
+     */
+    void put(Key& k, size_t stamp, Value* v) {
+        l_.lock();
+        misses_++;
+        evict_(k);
+        if (v->size() > budget_) {
+            l_.unlock();
+            return;
+        }
+        used_.push_front(k);
+        values_.insert(std::make_pair(k, RemoteValue(v->clone(), stamp, used_.begin())));
+        size_ += v->size();
+        while (size_ > budget_) {
+            Key oldest = used_.back();
+            evict_(oldest);
+        }
+        l_.unlock();
+    }
+
+    /**
+     * Drops the value at a key, if it is kept.
+     * @arg k  the key
+     */
+    void drop(Key& k) {
+        l_.lock();
+        evict_(k);
+        l_.unlock();
+    }
+
+    /** Removes the value at a key, under l_. */
+    void evict_(Key& k) {
+        std::unordered_map<Key, RemoteValue>::iterator it = values_.find(k);
+        if (it == values_.end()) {
+            return;
+        }
+        size_ -= it->second.v_->size();
+        delete it->second.v_;
+        used_.erase(it->second.used_);
+        values_.erase(it);
+    }
+};
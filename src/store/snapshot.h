@@ -0,0 +1,253 @@
+#pragma once
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "key.h"
+#include "kvstore.h"
+#include "spill.h"
+#include "util/object.h"
+#include "util/string.h"
+#include "value.h"
+
+static const char SNAPSHOT_MAGIC[8] = {'e', 'a', 'u', '2', 's', 'n', 'p', '3'};
+
+/**
+ * A snapshot file mapped into memory. The file starts with SNAPSHOT_MAGIC,
+ * the node it was saved on and the fingerprint of the inputs its values were
+ * built from (see snapshot_inputs), followed by one record per key: the length
+ * of the key, the key, the length of the value and the value, with lengths
+ * as size_t and every field padded to 8 bytes, so values are aligned for
+ * the columns that read them in place.
+ * Author: gomes.chri, modi.an
+ */
+class Snapshot : public Object {
+   public:
+    char* map_;
+    size_t size_;
+
+    Snapshot(char* map, size_t size) : Object(), map_(map), size_(size) {}
+
+    virtual ~Snapshot() {
+        munmap(map_, size_);
+    }
+
+    /**
+     * Maps a snapshot file.
+     * @arg path  the file
+     * @return the snapshot, or nullptr if there is no snapshot at the path
+     */
+    static Snapshot* open_file(const char* path) {
+        int fd = open(path, O_RDONLY);
+        if (fd == -1) {
+            return nullptr;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return nullptr;
+        }
+        size_t size = st.st_size;
+        if (size < sizeof(SNAPSHOT_MAGIC) + 2 * sizeof(size_t)) {
+            close(fd);
+            return nullptr;
+        }
+        void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        assert(map != MAP_FAILED);
+        if (memcmp(map, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+            munmap(map, size);
+            return nullptr;
+        }
+        return new Snapshot((char*)map, size);
+    }
+
+    /** The node the snapshot was saved on. */
+    size_t node() {
+        return *(size_t*)(map_ + sizeof(SNAPSHOT_MAGIC));
+    }
+
+    /** The fingerprint of the inputs the snapshot was built from. */
+    size_t inputs() {
+        return *(size_t*)(map_ + sizeof(SNAPSHOT_MAGIC) + sizeof(size_t));
+    }
+
+    /** Where the records start. */
+    size_t begin() {
+        return sizeof(SNAPSHOT_MAGIC) + 2 * sizeof(size_t);
+    }
+
+    /**
+     * Reads the record at a position.
+     * @arg pos  the position, moved past the record
+     * @arg key  set to the key
+     * @arg size  set to the length of the value
+     * @return the bytes of the value, in the mapping
+     */
+    char* next(size_t& pos, std::string& key, size_t& size) {
+        size_t length = *(size_t*)(map_ + pos);
+        pos += sizeof(size_t);
+        key.assign(map_ + pos, length);
+        pos += padded(length);
+        size = *(size_t*)(map_ + pos);
+        pos += sizeof(size_t);
+        char* result = map_ + pos;
+        pos += padded(size);
+        assert(pos <= size_);
+        return result;
+    }
+
+    /** Rounds a length up to a multiple of 8. */
+    static size_t padded(size_t length) {
+        return (length + 7) & ~(size_t)7;
+    }
+};
+
+/**
+ * A value whose bytes are in a mapped snapshot. The mapping is shared by
+ * the values restored from it and goes away with the last of them.
+ * Author: gomes.chri, modi.an
+ */
+class MappedValue : public Value {
+   public:
+    std::shared_ptr<Snapshot> snapshot_;
+
+    MappedValue(std::shared_ptr<Snapshot> snapshot, char* bytes, size_t size) : Value() {
+        snapshot_ = snapshot;
+        blob_ = size == 0 ? nullptr : bytes;
+        size_ = blob_ == nullptr ? 0 : size;
+    }
+
+    virtual ~MappedValue() {
+        // the bytes belong to the mapping, keep Value from freeing them
+        blob_ = nullptr;
+        size_ = 0;
+    }
+};
+
+/**
+ * Fingerprints the files a snapshot is built from by their sizes and times
+ * of last change, so that a snapshot is not loaded once they change. A
+ * missing file counts as empty and never changed.
+ * @arg paths  the files
+ * @return the fingerprint
+ */
+inline size_t snapshot_inputs(std::vector<const char*> paths) {
+    size_t result = paths.size();
+    for (const char* path : paths) {
+        struct stat st;
+        size_t fields[3] = {0, 0, 0};
+        if (stat(path, &st) == 0) {
+            fields[0] = st.st_size;
+            fields[1] = st.st_mtim.tv_sec;
+            fields[2] = st.st_mtim.tv_nsec;
+        }
+        for (size_t field : fields) {
+            result = result * 31 + std::hash<size_t>()(field);
+        }
+    }
+    return result;
+}
+
+/**
+ * Writes bytes to a snapshot file.
+ * @arg f  the file
+ * @arg bytes  the bytes
+ * @arg size  how many
+ */
+inline void write_snapshot_(FILE* f, const void* bytes, size_t size) {
+    size_t written = size == 0 ? 0 : fwrite(bytes, 1, size, f);
+    assert(written == size);
+}
+
+/**
+ * Writes padding after a field of the given length.
+ * @arg f  the file
+ * @arg length  the length of the field
+ */
+inline void pad_snapshot_(FILE* f, size_t length) {
+    static const char zeros[8] = {0};
+    write_snapshot_(f, zeros, Snapshot::padded(length) - length);
+}
+
+/**
+ * Saves the values of this node to a snapshot file, see Snapshot, so that
+ * a restarted node can load them with load_snapshot instead of rebuilding
+ * them. The file is written next to the path and renamed over it once
+ * complete, so a crash never leaves half a snapshot. Puts made while it
+ * runs may or may not be saved.
+ * @arg kv  the store
+ * @arg path  the file
+ * @arg inputs  the fingerprint of what the values were built from, see
+ *   snapshot_inputs
+ */
+inline void save_snapshot(KVStore* kv, const char* path, size_t inputs = 0) {
+    String* tmp = StrBuff().c(path).c(".tmp").get();
+    FILE* f = fopen(tmp->c_str(), "wb");
+    assert(f != nullptr);
+    size_t node = kv->this_node();
+    write_snapshot_(f, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    write_snapshot_(f, &node, sizeof(size_t));
+    write_snapshot_(f, &inputs, sizeof(size_t));
+    kv->each([f](Key& k, Value* v) {
+        // a spilled value has to be read back first
+        Value* bytes = dynamic_cast<SpilledValue*>(v) == nullptr ? v : v->clone();
+        size_t length = k.k_.size();
+        size_t size = bytes->size();
+        write_snapshot_(f, &length, sizeof(size_t));
+        write_snapshot_(f, k.k_.data(), length);
+        pad_snapshot_(f, length);
+        write_snapshot_(f, &size, sizeof(size_t));
+        write_snapshot_(f, bytes->get_bytes(), size);
+        pad_snapshot_(f, size);
+        if (bytes != v) {
+            delete bytes;
+        }
+    });
+    int closed = fclose(f);
+    assert(closed == 0);
+    int renamed = rename(tmp->c_str(), path);
+    assert(renamed == 0);
+    delete tmp;
+}
+
+/**
+ * Puts the values of a snapshot file saved on this node into the store.
+ * Nothing is parsed or copied: the values are MappedValues that read their
+ * bytes from the mapped file, and pages are only loaded when touched.
+ * @arg kv  the store
+ * @arg path  the file
+ * @arg inputs  the fingerprint of what the values are built from now, see
+ *   snapshot_inputs
+ * @return false if there is no snapshot at the path, or it was built from
+ *   other inputs
+ */
+inline bool load_snapshot(KVStore* kv, const char* path, size_t inputs = 0) {
+    Snapshot* snapshot = Snapshot::open_file(path);
+    if (snapshot == nullptr) {
+        return false;
+    }
+    if (snapshot->inputs() != inputs) {
+        delete snapshot;
+        return false;
+    }
+    assert(snapshot->node() == kv->this_node());
+    std::shared_ptr<Snapshot> shared(snapshot);
+    std::string name;
+    for (size_t pos = snapshot->begin(); pos < snapshot->size_;) {
+        size_t size;
+        char* bytes = snapshot->next(pos, name, size);
+        Key k(name.c_str(), kv->this_node());
+        kv->put(k, new MappedValue(shared, bytes, size));
+    }
+    return true;
+}
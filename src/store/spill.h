@@ -0,0 +1,121 @@
+#pragma once
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "util/object.h"
+#include "value.h"
+
+/**
+ * An append-only scratch file that values are spilled to. Space is claimed
+ * with an atomic bump of the end, so any number of threads can write and
+ * read at once with pwrite and pread. The file is unlinked as soon as it is
+ * opened and goes away with the store.
+ * Author: gomes.chri, modi.an
+ */
+class SpillFile : public Object {
+   public:
+    int fd_;
+    std::atomic<size_t> end_;      // bytes claimed so far
+    std::atomic<size_t> reads_;    // values read back
+    std::atomic<size_t> written_;  // values written
+
+    /**
+     * Creates the file, replacing anything at the path.
+     * @arg path  where to create it
+     */
+    SpillFile(const char* path) : Object(), end_(0), reads_(0), written_(0) {
+        fd_ = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+        assert(fd_ != -1);
+        unlink(path);
+    }
+
+    virtual ~SpillFile() {
+        close(fd_);
+    }
+
+    /**
+     * Appends bytes to the file.
+     * @return the offset they were written at
+     */
+    size_t write(char* bytes, size_t size) {
+        size_t offset = end_.fetch_add(size);
+        for (size_t done = 0; done < size;) {
+            ssize_t n = pwrite(fd_, bytes + done, size - done, offset + done);
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            check_("pwrite", n);
+            done += n;
+        }
+        written_++;
+        return offset;
+    }
+
+    /** Reads bytes written earlier into a buffer. */
+    void read(size_t offset, size_t size, char* into) {
+        for (size_t done = 0; done < size;) {
+            ssize_t n = pread(fd_, into + done, size - done, offset + done);
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            check_("pread", n);
+            done += n;
+        }
+        reads_++;
+    }
+
+    /**
+     * Stops the process if a call moved no bytes. A spilled value that can't
+     * be written or read back is lost, so there is nothing to go on with.
+     * @arg call  the name of the call
+     * @arg n  what it returned
+     */
+    void check_(const char* call, ssize_t n) {
+        if (n > 0) {
+            return;
+        }
+        fprintf(stderr, "SpillFile: %s failed: %s\n", call,
+                n == 0 ? "no bytes moved" : strerror(errno));
+        abort();
+    }
+};
+
+/**
+ * Stands in the store for a value that was spilled to a file. It holds no
+ * bytes itself; cloning it reads the value back, so whoever gets a copy of
+ * a stored value gets the real one, wherever it lives.
+ * Author: gomes.chri, modi.an
+ */
+class SpilledValue : public Value {
+   public:
+    SpillFile* file_;  // external
+    size_t offset_;
+    size_t length_;
+
+    /**
+     * Writes a value out to a file.
+     * @arg file  the file
+     * @arg v  the value, external
+     */
+    SpilledValue(SpillFile* file, Value* v) : Value() {
+        file_ = file;
+        length_ = v->size();
+        offset_ = file->write(v->get_bytes(), length_);
+    }
+
+    /**
+     * Reads the value back.
+     * @return a copy of the spilled value
+     */
+    Value* clone() {
+        char* blob = new char[length_];
+        file_->read(offset_, length_, blob);
+        return new Value(true, blob, length_);
+    }
+};
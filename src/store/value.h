@@ -32,7 +32,7 @@ class Value : public Object {
 
     Value(Deserializer* d) : Object() {
         size_ = d->get_size_t();
-        blob_ = d->get_buffer(size_);
+        blob_ = size_ == 0 ? nullptr : d->get_buffer(size_);
     }
 
     virtual ~Value() {
@@ -60,7 +60,9 @@ class Value : public Object {
 
     void serialize(Serializer* s) {
         s->add_size_t(size_);
-        s->add_buffer(blob_, size_);
+        if (size_ > 0) {
+            s->add_buffer(blob_, size_);
+        }
     }
 
     /**
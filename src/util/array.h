@@ -4,6 +4,7 @@
 #include <math.h>
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
 #include "object.h"
 #include "serial.h"
 #include "string.h"
@@ -46,6 +47,32 @@ class Array : public Object {
         size_ += 1;
     }
 
+    /**
+     * Makes room for at least the given number of elements. The elements
+     * stay as they are.
+     * @arg capacity  the number of elements to make room for
+     */
+    void reserve(size_t capacity) {
+        if (capacity <= capacity_) {
+            return;
+        }
+        Data* items = new Data[capacity];
+        for (size_t i = 0; i < size_; i++) {
+            items[i] = items_[i];
+        }
+        delete[] items_;
+        items_ = items;
+        capacity_ = capacity;
+    }
+
+    /**
+     * Drops the elements from the given index on.
+     * @arg n  the number of elements to keep
+     */
+    virtual void truncate(size_t n) {
+        size_ = std::min(size_, n);
+    }
+
     /**
      * Gets the element at a given index.
      * @arg i  index of the element to get
@@ -261,6 +288,13 @@ class StringArray : public Array {
         }
     }
 
+    virtual void truncate(size_t n) {
+        for (size_t i = n; i < size(); i++) {
+            delete get_string(i);
+        }
+        Array::truncate(n);
+    }
+
     /**
      * Adds an element to the end the array.
      * @arg s  element to add
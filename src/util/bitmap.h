@@ -0,0 +1,324 @@
+#pragma once
+#include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "object.h"
+#include "serial.h"
+
+static const size_t BITMAP_ARRAY_MAX = 4096;  // past this, a dense container is smaller
+static const size_t BITMAP_WORDS = 1024;      // 65536 bits
+
+/**
+ * The values of a Bitmap that share their 16 high bits. Holds the 16 low
+ * bits either as a sorted array, while there are few of them, or as a
+ * dense 65536 bit set.
+ */
+struct BitmapContainer {
+    uint16_t key_;                // the high bits
+    std::vector<uint16_t> low_;   // sorted, if the container is sparse
+    std::vector<uint64_t> bits_;  // BITMAP_WORDS words, if it is dense
+    size_t count_;
+
+    bool dense() const {
+        return !bits_.empty();
+    }
+};
+
+/**
+ * A compressed set of 32 bit values, in the style of a roaring bitmap. The
+ * values are split by their 16 high bits into containers, each sparse or
+ * dense depending on how many values it holds, so a set costs at most a
+ * little over two bytes a value and far less when values cluster. Unions,
+ * intersections and differences work a container at a time, on whole words
+ * for dense ones.
+ * Author: gomes.chri, modi.an
+ */
+class Bitmap : public Object {
+   public:
+    std::vector<BitmapContainer> containers_;  // sorted by key, none empty
+
+    Bitmap() : Object() {}
+
+    Bitmap(Deserializer* d) : Object() {
+        size_t n = d->get_size_t();
+        containers_.resize(n);
+        for (BitmapContainer& c : containers_) {
+            c.key_ = d->get_uint16_t();
+            c.count_ = d->get_size_t();
+            if (d->get_bool()) {
+                c.bits_.resize(BITMAP_WORDS);
+                d->get_buffer(BITMAP_WORDS * sizeof(uint64_t), (char*)c.bits_.data());
+            } else {
+                c.low_.resize(c.count_);
+                d->get_buffer(c.count_ * sizeof(uint16_t), (char*)c.low_.data());
+            }
+        }
+    }
+
+    /** Adds a value. */
+    void add(uint32_t val) {
+        uint16_t key = val >> 16;
+        uint16_t low = val & 0xffff;
+        std::vector<BitmapContainer>::iterator it = find_(key);
+        if (it == containers_.end() || it->key_ != key) {
+            it = containers_.insert(it, BitmapContainer{key, {}, {}, 0});
+        }
+        BitmapContainer& c = *it;
+        if (c.dense()) {
+            uint64_t bit = (uint64_t)1 << (low & 63);
+            if ((c.bits_[low >> 6] & bit) == 0) {
+                c.bits_[low >> 6] |= bit;
+                c.count_++;
+            }
+            return;
+        }
+        std::vector<uint16_t>::iterator pos = std::lower_bound(c.low_.begin(), c.low_.end(), low);
+        if (pos != c.low_.end() && *pos == low) {
+            return;
+        }
+        c.low_.insert(pos, low);
+        c.count_++;
+        if (c.count_ > BITMAP_ARRAY_MAX) {
+            densify_(c);
+        }
+    }
+
+    /** Checks whether a value is in the set. */
+    bool contains(uint32_t val) {
+        uint16_t key = val >> 16;
+        uint16_t low = val & 0xffff;
+        std::vector<BitmapContainer>::iterator it = find_(key);
+        if (it == containers_.end() || it->key_ != key) {
+            return false;
+        }
+        if (it->dense()) {
+            return (it->bits_[low >> 6] >> (low & 63)) & 1;
+        }
+        return std::binary_search(it->low_.begin(), it->low_.end(), low);
+    }
+
+    /** The number of values in the set. */
+    size_t cardinality() {
+        size_t result = 0;
+        for (BitmapContainer& c : containers_) {
+            result += c.count_;
+        }
+        return result;
+    }
+
+    /** Adds the values of another set. */
+    void union_with(Bitmap& other) {
+        std::vector<BitmapContainer> result;
+        size_t i = 0;
+        size_t j = 0;
+        while (i < containers_.size() || j < other.containers_.size()) {
+            if (j == other.containers_.size() ||
+                (i < containers_.size() && containers_[i].key_ < other.containers_[j].key_)) {
+                result.push_back(std::move(containers_[i++]));
+            } else if (i == containers_.size() || other.containers_[j].key_ < containers_[i].key_) {
+                result.push_back(other.containers_[j++]);
+            } else {
+                result.push_back(std::move(containers_[i++]));
+                union_(result.back(), other.containers_[j++]);
+            }
+        }
+        containers_.swap(result);
+    }
+
+    /** Keeps only the values also in another set. */
+    void intersect_with(Bitmap& other) {
+        combine_(other, true);
+    }
+
+    /** Removes the values of another set. */
+    void andnot_with(Bitmap& other) {
+        combine_(other, false);
+    }
+
+    /** The values in the set, smallest first. */
+    std::vector<uint32_t> values() {
+        std::vector<uint32_t> result;
+        result.reserve(cardinality());
+        for (BitmapContainer& c : containers_) {
+            uint32_t high = (uint32_t)c.key_ << 16;
+            if (!c.dense()) {
+                for (uint16_t low : c.low_) {
+                    result.push_back(high | low);
+                }
+                continue;
+            }
+            for (size_t w = 0; w < BITMAP_WORDS; w++) {
+                for (uint64_t bits = c.bits_[w]; bits != 0; bits &= bits - 1) {
+                    result.push_back(high | (w << 6 | __builtin_ctzll(bits)));
+                }
+            }
+        }
+        return result;
+    }
+
+    bool equals(Object* other) override {
+        Bitmap* o = dynamic_cast<Bitmap*>(other);
+        if (o == nullptr || o->containers_.size() != containers_.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < containers_.size(); i++) {
+            BitmapContainer& a = containers_[i];
+            BitmapContainer& b = o->containers_[i];
+            if (a.key_ != b.key_ || a.count_ != b.count_ || a.dense() != b.dense() ||
+                a.low_ != b.low_ || a.bits_ != b.bits_) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void serialize(Serializer* s) {
+        s->add_size_t(containers_.size());
+        for (BitmapContainer& c : containers_) {
+            s->add_uint16_t(c.key_);
+            s->add_size_t(c.count_);
+            s->add_bool(c.dense());
+            if (c.dense()) {
+                s->add_buffer(c.bits_.data(), BITMAP_WORDS * sizeof(uint64_t));
+            } else if (c.count_ > 0) {
+                s->add_buffer(c.low_.data(), c.count_ * sizeof(uint16_t));
+            }
+        }
+    }
+
+    /** Finds the first container whose key is not less than the given one. */
+    std::vector<BitmapContainer>::iterator find_(uint16_t key) {
+        return std::lower_bound(
+            containers_.begin(), containers_.end(), key,
+            [](const BitmapContainer& c, uint16_t k) { return c.key_ < k; });
+    }
+
+    /** Turns a sparse container into a dense one. */
+    static void densify_(BitmapContainer& c) {
+        c.bits_.assign(BITMAP_WORDS, 0);
+        for (uint16_t low : c.low_) {
+            c.bits_[low >> 6] |= (uint64_t)1 << (low & 63);
+        }
+        std::vector<uint16_t>().swap(c.low_);
+    }
+
+    /**
+     * Recounts a dense container, turning it back into a sparse one if it
+     * became small.
+     */
+    static void recount_(BitmapContainer& c) {
+        c.count_ = 0;
+        for (uint64_t w : c.bits_) {
+            c.count_ += __builtin_popcountll(w);
+        }
+        if (c.count_ > BITMAP_ARRAY_MAX) {
+            return;
+        }
+        c.low_.reserve(c.count_);
+        for (size_t w = 0; w < BITMAP_WORDS; w++) {
+            for (uint64_t bits = c.bits_[w]; bits != 0; bits &= bits - 1) {
+                c.low_.push_back(w << 6 | __builtin_ctzll(bits));
+            }
+        }
+        std::vector<uint64_t>().swap(c.bits_);
+    }
+
+    /** Adds the values of another container with the same key. */
+    static void union_(BitmapContainer& c, BitmapContainer& other) {
+        if (!c.dense() && !other.dense()) {
+            std::vector<uint16_t> merged;
+            merged.reserve(c.low_.size() + other.low_.size());
+            std::set_union(c.low_.begin(), c.low_.end(), other.low_.begin(), other.low_.end(),
+                           std::back_inserter(merged));
+            c.low_.swap(merged);
+            c.count_ = c.low_.size();
+            if (c.count_ > BITMAP_ARRAY_MAX) {
+                densify_(c);
+            }
+            return;
+        }
+        if (!c.dense()) {
+            densify_(c);
+        }
+        if (other.dense()) {
+            for (size_t w = 0; w < BITMAP_WORDS; w++) {
+                c.bits_[w] |= other.bits_[w];
+            }
+        } else {
+            for (uint16_t low : other.low_) {
+                c.bits_[low >> 6] |= (uint64_t)1 << (low & 63);
+            }
+        }
+        recount_(c);
+    }
+
+    /**
+     * Keeps the values of a container that are in another container with
+     * the same key, or, if keep is false, those that are not.
+     */
+    static void filter_(BitmapContainer& c, BitmapContainer& other, bool keep) {
+        if (c.dense() && other.dense()) {
+            for (size_t w = 0; w < BITMAP_WORDS; w++) {
+                c.bits_[w] &= keep ? other.bits_[w] : ~other.bits_[w];
+            }
+            recount_(c);
+            return;
+        }
+        if (c.dense()) {
+            // the other container is sparse: test its values against ours
+            std::vector<uint64_t> mask(BITMAP_WORDS, 0);
+            for (uint16_t low : other.low_) {
+                mask[low >> 6] |= (uint64_t)1 << (low & 63);
+            }
+            for (size_t w = 0; w < BITMAP_WORDS; w++) {
+                c.bits_[w] &= keep ? mask[w] : ~mask[w];
+            }
+            recount_(c);
+            return;
+        }
+        std::vector<uint16_t> kept;
+        for (uint16_t low : c.low_) {
+            bool in;
+            if (other.dense()) {
+                in = (other.bits_[low >> 6] >> (low & 63)) & 1;
+            } else {
+                in = std::binary_search(other.low_.begin(), other.low_.end(), low);
+            }
+            if (in == keep) {
+                kept.push_back(low);
+            }
+        }
+        c.low_.swap(kept);
+        c.count_ = c.low_.size();
+    }
+
+    /**
+     * Keeps the values also in another set, or, if keep is false, those not
+     * in it. Containers left empty are dropped.
+     */
+    void combine_(Bitmap& other, bool keep) {
+        std::vector<BitmapContainer> result;
+        size_t j = 0;
+        for (BitmapContainer& c : containers_) {
+            while (j < other.containers_.size() && other.containers_[j].key_ < c.key_) {
+                j++;
+            }
+            if (j == other.containers_.size() || other.containers_[j].key_ != c.key_) {
+                if (!keep) {
+                    result.push_back(std::move(c));
+                }
+                continue;
+            }
+            filter_(c, other.containers_[j], keep);
+            if (c.count_ > 0) {
+                result.push_back(std::move(c));
+            }
+        }
+        containers_.swap(result);
+    }
+};
@@ -0,0 +1,163 @@
+#pragma once
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "object.h"
+
+static const size_t HASH_NOT_FOUND = SIZE_MAX;
+
+/**
+ * Open addressing hash table that maps byte string keys to dense indices.
+ * Entries are numbered 0..size()-1 in insertion order so callers can keep
+ * their per-entry state in plain vectors. Keys are copied into one arena and
+ * the slot array only holds a cached hash and an entry number, which keeps
+ * linear probing inside a single compact array.
+ * Author: gomes.chri, modi.an
+ */
+class HashTable : public Object {
+   public:
+    std::vector<size_t> slot_hashes_;   // cached hash of the entry in each slot
+    std::vector<size_t> slot_entries_;  // entry number + 1 in each slot, 0 if empty
+    std::vector<size_t> entry_hashes_;  // hash of each entry
+    std::vector<size_t> offsets_;       // start of each key in arena_, plus the end
+    std::vector<char> arena_;           // all keys back to back
+    size_t mask_;
+
+    /**
+     * Creates a table that can hold the given number of entries before it
+     * has to grow.
+     * @arg expected  the expected number of entries
+     */
+    HashTable(size_t expected) : Object() {
+        size_t capacity = 16;
+        while (capacity < expected * 2) {
+            capacity *= 2;
+        }
+        slot_hashes_ = std::vector<size_t>(capacity, 0);
+        slot_entries_ = std::vector<size_t>(capacity, 0);
+        offsets_.push_back(0);
+        mask_ = capacity - 1;
+    }
+
+    HashTable() : HashTable(16) {}
+
+    virtual ~HashTable() {}
+
+    /**
+     * Hashes a run of bytes (64 bit FNV-1a).
+     * @arg key  the bytes
+     * @arg len  the number of bytes
+     * @return the hash
+     */
+    static size_t hash_bytes(const char* key, size_t len) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < len; i++) {
+            hash ^= (unsigned char)key[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    /** The number of entries in the table. */
+    size_t size() {
+        return entry_hashes_.size();
+    }
+
+    /** Gets the key of the entry with the given number. Owned by the table. */
+    const char* key(size_t entry) {
+        assert(entry < size());
+        return arena_.data() + offsets_[entry];
+    }
+
+    /** Gets the length of the key of the entry with the given number. */
+    size_t key_size(size_t entry) {
+        assert(entry < size());
+        return offsets_[entry + 1] - offsets_[entry];
+    }
+
+    /** Gets the hash of the entry with the given number. */
+    size_t hash_of(size_t entry) {
+        assert(entry < size());
+        return entry_hashes_[entry];
+    }
+
+    /**
+     * Finds the entry for a key.
+     * @arg key  the key bytes
+     * @arg len  the number of bytes in the key
+     * @return the entry number, or HASH_NOT_FOUND
+     */
+    size_t find(const char* key, size_t len) {
+        return find(key, len, hash_bytes(key, len));
+    }
+
+    size_t find(const char* key, size_t len, size_t hash) {
+        size_t slot = probe_(key, len, hash);
+        return slot_entries_[slot] == 0 ? HASH_NOT_FOUND : slot_entries_[slot] - 1;
+    }
+
+    /**
+     * Finds the entry for a key, adding a new entry if it is not present.
+     * A new entry gets the number size() had before the call.
+     * @arg key  the key bytes, copied
+     * @arg len  the number of bytes in the key
+     * @return the entry number
+     */
+    size_t insert(const char* key, size_t len) {
+        return insert(key, len, hash_bytes(key, len));
+    }
+
+    size_t insert(const char* key, size_t len, size_t hash) {
+        size_t slot = probe_(key, len, hash);
+        if (slot_entries_[slot] != 0) {
+            return slot_entries_[slot] - 1;
+        }
+        size_t entry = size();
+        arena_.insert(arena_.end(), key, key + len);
+        offsets_.push_back(arena_.size());
+        entry_hashes_.push_back(hash);
+        slot_hashes_[slot] = hash;
+        slot_entries_[slot] = entry + 1;
+        // keep the load factor at or below one half
+        if (size() * 2 > mask_ + 1) {
+            grow_();
+        }
+        return entry;
+    }
+
+    /**
+     * Finds the slot holding the key, or the empty slot where it belongs.
+     */
+    size_t probe_(const char* key, size_t len, size_t hash) {
+        size_t slot = hash & mask_;
+        while (slot_entries_[slot] != 0) {
+            if (slot_hashes_[slot] == hash) {
+                size_t entry = slot_entries_[slot] - 1;
+                if (key_size(entry) == len && memcmp(this->key(entry), key, len) == 0) {
+                    return slot;
+                }
+            }
+            slot = (slot + 1) & mask_;
+        }
+        return slot;
+    }
+
+    /** Doubles the number of slots and reinserts every entry. */
+    void grow_() {
+        size_t capacity = (mask_ + 1) * 2;
+        mask_ = capacity - 1;
+        slot_hashes_.assign(capacity, 0);
+        slot_entries_.assign(capacity, 0);
+        for (size_t entry = 0; entry < size(); entry++) {
+            size_t slot = entry_hashes_[entry] & mask_;
+            while (slot_entries_[slot] != 0) {
+                slot = (slot + 1) & mask_;
+            }
+            slot_hashes_[slot] = entry_hashes_[entry];
+            slot_entries_[slot] = entry + 1;
+        }
+    }
+};
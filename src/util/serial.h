@@ -1,6 +1,8 @@
 #pragma once
 #include <stdio.h>
 
+#include <string>
+
 #include "object.h"
 #include "string.h"
 
@@ -152,6 +154,14 @@ class Serializer : public Object {
         add_size_t(s->size());
         add_buffer(s->c_str(), s->size());
     }
+
+    /** Adds a std::string in the same format as add_string. */
+    void add_string(const std::string& s) {
+        add_size_t(s.size());
+        if (s.size() > 0) {
+            add_buffer(s.data(), s.size());
+        }
+    }
 };
 
 /**
@@ -265,4 +275,16 @@ class Deserializer : public Object {
         c_str[len] = '\0';
         return new String(true, c_str, len);
     }
+
+    /**
+     * Reads a string written by add_string straight into a std::string.
+     * @arg into  set to the string
+     */
+    void get_string(std::string& into) {
+        size_t len = get_size_t();
+        assert(bytes_remaining_ >= len);
+        into.assign(current_, len);
+        current_ += len;
+        bytes_remaining_ -= len;
+    }
 };
@@ -0,0 +1,317 @@
+#pragma once
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "object.h"
+#include "serial.h"
+
+/**
+ * Finishes a 64 bit hash so that every bit depends on every input bit
+ * (the MurmurHash3 finalizer).
+ * @arg h  the value to mix
+ * @return the mixed value
+ */
+inline uint64_t mix_hash(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/**
+ * Hashes a run of bytes for a sketch. Runs of up to 8 bytes, which is any
+ * int, double or bool, are mixed in one step; longer ones go through
+ * FNV-1a first.
+ * @arg bytes  the bytes
+ * @arg len  the number of bytes
+ * @return the hash
+ */
+inline uint64_t sketch_hash(const char* bytes, size_t len) {
+    uint64_t h = 0;
+    if (len <= sizeof(uint64_t)) {
+        memcpy(&h, bytes, len);
+    } else {
+        h = 14695981039346656037ULL;
+        for (size_t i = 0; i < len; i++) {
+            h ^= (unsigned char)bytes[i];
+            h *= 1099511628211ULL;
+        }
+    }
+    return mix_hash(h ^ (len * 0x9e3779b97f4a7c15ULL));
+}
+
+/**
+ * HyperLogLog estimate of the number of distinct hashes added. Uses 2^p
+ * one byte registers; the standard error is about 1.04 / sqrt(2^p).
+ * Author: gomes.chri, modi.an
+ */
+class HyperLogLog : public Object {
+   public:
+    size_t p_;
+    std::vector<uint8_t> registers_;
+
+    HyperLogLog(size_t p) : Object(), p_(p), registers_((size_t)1 << p, 0) {
+        assert(p >= 4 && p <= 16);
+    }
+
+    HyperLogLog(Deserializer* d) : Object() {
+        p_ = d->get_size_t();
+        registers_ = std::vector<uint8_t>((size_t)1 << p_);
+        d->get_buffer(registers_.size(), (char*)registers_.data());
+    }
+
+    /** Adds a hash. */
+    void add(uint64_t h) {
+        size_t idx = h >> (64 - p_);
+        uint64_t rest = (h << p_) | ((uint64_t)1 << (p_ - 1));
+        uint8_t rank = __builtin_clzll(rest) + 1;
+        if (rank > registers_[idx]) {
+            registers_[idx] = rank;
+        }
+    }
+
+    /** Adds the hashes of another sketch with the same precision. */
+    void merge(HyperLogLog& other) {
+        assert(other.p_ == p_);
+        for (size_t i = 0; i < registers_.size(); i++) {
+            registers_[i] = std::max(registers_[i], other.registers_[i]);
+        }
+    }
+
+    /** Estimates the number of distinct hashes added. */
+    double estimate() {
+        double m = registers_.size();
+        double sum = 0;
+        size_t zeros = 0;
+        for (uint8_t r : registers_) {
+            sum += ldexp(1.0, -(int)r);
+            zeros += r == 0;
+        }
+        double e = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+        if (e <= 2.5 * m && zeros > 0) {
+            // few hashes: linear counting of the empty registers is better
+            e = m * log(m / zeros);
+        }
+        return e;
+    }
+
+    void serialize(Serializer* s) {
+        s->add_size_t(p_);
+        s->add_buffer(registers_.data(), registers_.size());
+    }
+};
+
+/**
+ * Count-Min estimate of how often each hash was added. Never under
+ * estimates; over estimates by at most 2n / width with probability
+ * 1 - 2^-depth, where n is the total count added.
+ * Author: gomes.chri, modi.an
+ */
+class CountMin : public Object {
+   public:
+    size_t width_;  // a power of two
+    size_t depth_;
+    std::vector<size_t> counts_;  // depth_ rows of width_ counters
+
+    CountMin(size_t width, size_t depth)
+        : Object(), width_(width), depth_(depth), counts_(width * depth, 0) {
+        assert(width > 0 && (width & (width - 1)) == 0 && depth > 0);
+    }
+
+    CountMin(Deserializer* d) : Object() {
+        width_ = d->get_size_t();
+        depth_ = d->get_size_t();
+        for (size_t i = 0; i < width_ * depth_; i++) {
+            counts_.push_back(d->get_size_t());
+        }
+    }
+
+    /** Gets the counter of a hash in a row. Rows hash with h1 + row * h2. */
+    size_t& counter_(uint64_t h, size_t row) {
+        uint64_t h1 = h & 0xffffffff;
+        uint64_t h2 = (h >> 32) | 1;
+        return counts_[row * width_ + ((h1 + row * h2) & (width_ - 1))];
+    }
+
+    /** Adds a count to a hash. */
+    void add(uint64_t h, size_t count) {
+        for (size_t row = 0; row < depth_; row++) {
+            counter_(h, row) += count;
+        }
+    }
+
+    /** Adds the counts of another sketch with the same dimensions. */
+    void merge(CountMin& other) {
+        assert(other.width_ == width_ && other.depth_ == depth_);
+        for (size_t i = 0; i < counts_.size(); i++) {
+            counts_[i] += other.counts_[i];
+        }
+    }
+
+    /** Estimates how often a hash was added. */
+    size_t estimate(uint64_t h) {
+        size_t result = SIZE_MAX;
+        for (size_t row = 0; row < depth_; row++) {
+            result = std::min(result, counter_(h, row));
+        }
+        return result;
+    }
+
+    void serialize(Serializer* s) {
+        s->add_size_t(width_);
+        s->add_size_t(depth_);
+        for (size_t c : counts_) {
+            s->add_size_t(c);
+        }
+    }
+};
+
+/**
+ * An item monitored by a SpaceSaving sketch. Its true count is between
+ * count_ - error_ and count_.
+ */
+struct SpaceSavingItem {
+    std::string key_;
+    size_t count_;
+    size_t error_;
+};
+
+/**
+ * Space-Saving summary of the most frequent keys. Monitors at most k keys;
+ * any key added more than n / k times, where n is the total count added, is
+ * among them.
+ * Author: gomes.chri, modi.an
+ */
+class SpaceSaving : public Object {
+   public:
+    size_t k_;
+    std::vector<SpaceSavingItem> items_;
+    std::unordered_map<std::string, size_t> index_;  // key to position in items_
+
+    SpaceSaving(size_t k) : Object(), k_(k) {
+        assert(k > 0);
+    }
+
+    SpaceSaving(Deserializer* d) : Object() {
+        k_ = d->get_size_t();
+        size_t n = d->get_size_t();
+        for (size_t i = 0; i < n; i++) {
+            SpaceSavingItem item;
+            size_t len = d->get_size_t();
+            item.key_ = std::string(len, '\0');
+            if (len > 0) d->get_buffer(len, &item.key_[0]);
+            item.count_ = d->get_size_t();
+            item.error_ = d->get_size_t();
+            index_[item.key_] = items_.size();
+            items_.push_back(item);
+        }
+    }
+
+    /** The smallest count monitored, or 0 while fewer than k keys are. */
+    size_t min_count() {
+        if (items_.size() < k_) {
+            return 0;
+        }
+        size_t result = SIZE_MAX;
+        for (SpaceSavingItem& item : items_) {
+            result = std::min(result, item.count_);
+        }
+        return result;
+    }
+
+    /**
+     * Adds a count to a key. A new key replaces the key with the smallest
+     * count once k keys are monitored, and inherits that count as its error.
+     */
+    void add(const char* key, size_t len, size_t count) {
+        std::string k(key, len);
+        std::unordered_map<std::string, size_t>::iterator it = index_.find(k);
+        if (it != index_.end()) {
+            items_[it->second].count_ += count;
+            return;
+        }
+        if (items_.size() < k_) {
+            index_[k] = items_.size();
+            items_.push_back(SpaceSavingItem{k, count, 0});
+            return;
+        }
+        size_t min = 0;
+        for (size_t i = 1; i < items_.size(); i++) {
+            if (items_[i].count_ < items_[min].count_) min = i;
+        }
+        index_.erase(items_[min].key_);
+        index_[k] = min;
+        items_[min] = SpaceSavingItem{k, items_[min].count_ + count, items_[min].count_};
+    }
+
+    /**
+     * Merges another summary into this one. A key missing from a full
+     * summary may have been counted up to its smallest count, which is added
+     * to the key's count and error. The k largest keys are kept.
+     */
+    void merge(SpaceSaving& other) {
+        size_t mine = min_count();
+        size_t theirs = other.min_count();
+        std::vector<SpaceSavingItem> all;
+        for (SpaceSavingItem& item : items_) {
+            std::unordered_map<std::string, size_t>::iterator it = other.index_.find(item.key_);
+            if (it == other.index_.end()) {
+                all.push_back(
+                    SpaceSavingItem{item.key_, item.count_ + theirs, item.error_ + theirs});
+            } else {
+                SpaceSavingItem& o = other.items_[it->second];
+                all.push_back(
+                    SpaceSavingItem{item.key_, item.count_ + o.count_, item.error_ + o.error_});
+            }
+        }
+        for (SpaceSavingItem& o : other.items_) {
+            if (index_.find(o.key_) == index_.end()) {
+                all.push_back(SpaceSavingItem{o.key_, o.count_ + mine, o.error_ + mine});
+            }
+        }
+        k_ = std::max(k_, other.k_);
+        items_.clear();
+        index_.clear();
+        for (SpaceSavingItem& item : top_(all)) {
+            index_[item.key_] = items_.size();
+            items_.push_back(item);
+        }
+    }
+
+    /** The monitored keys, most frequent first. */
+    std::vector<SpaceSavingItem> top() {
+        return top_(items_);
+    }
+
+    /** The k items with the largest counts, largest first. */
+    std::vector<SpaceSavingItem> top_(std::vector<SpaceSavingItem> items) {
+        std::sort(items.begin(), items.end(),
+                  [](const SpaceSavingItem& a, const SpaceSavingItem& b) {
+                      return a.count_ > b.count_ || (a.count_ == b.count_ && a.key_ < b.key_);
+                  });
+        if (items.size() > k_) {
+            items.resize(k_);
+        }
+        return items;
+    }
+
+    void serialize(Serializer* s) {
+        s->add_size_t(k_);
+        s->add_size_t(items_.size());
+        for (SpaceSavingItem& item : items_) {
+            s->add_size_t(item.key_.size());
+            if (!item.key_.empty()) s->add_buffer(item.key_.data(), item.key_.size());
+            s->add_size_t(item.count_);
+            s->add_size_t(item.error_);
+        }
+    }
+};
@@ -0,0 +1,163 @@
+#include "util/bitmap.h"
+
+#include <set>
+
+#include "application/application.h"
+#include "catch.hpp"
+#include "store/bitmaps.h"
+
+// adds the same values to a bitmap and a std::set
+static void add_both(Bitmap& b, std::set<uint32_t>& s, uint32_t val) {
+    b.add(val);
+    s.insert(val);
+}
+
+// checks that a bitmap holds exactly the values of a std::set
+static void check_same(Bitmap& b, std::set<uint32_t>& s) {
+    REQUIRE(b.cardinality() == s.size());
+    std::vector<uint32_t> vals = b.values();
+    REQUIRE(std::vector<uint32_t>(s.begin(), s.end()) == vals);
+}
+
+// fills a sparse container, a dense one and a run across both, from a seed
+static void fill(Bitmap& b, std::set<uint32_t>& s, uint32_t seed) {
+    for (uint32_t i = 0; i < 1000; i++) {
+        add_both(b, s, (i * 37 + seed) % 65536);
+    }
+    for (uint32_t i = 0; i < 20000; i++) {
+        add_both(b, s, (1 << 16) + (i * 7 + seed) % 65536);
+    }
+    for (uint32_t i = 0; i < 3000; i++) {
+        add_both(b, s, (5 << 16) + i * (seed + 1));
+    }
+}
+
+TEST_CASE("bitmaps add and test values", "[bitmap]") {
+    Bitmap b;
+    REQUIRE(b.cardinality() == 0);
+    REQUIRE_FALSE(b.contains(7));
+    b.add(7);
+    b.add(7);
+    b.add(1 << 20);
+    b.add(0xffffffff);
+    REQUIRE(b.cardinality() == 3);
+    REQUIRE(b.contains(7));
+    REQUIRE(b.contains(1 << 20));
+    REQUIRE(b.contains(0xffffffff));
+    REQUIRE_FALSE(b.contains(8));
+    REQUIRE_FALSE(b.contains(7 + (1 << 16)));
+
+    // a container turns dense past BITMAP_ARRAY_MAX values and stays exact
+    std::set<uint32_t> s;
+    Bitmap dense;
+    for (uint32_t i = 0; i < 10000; i += 2) {
+        add_both(dense, s, i);
+    }
+    REQUIRE(dense.containers_.size() == 1);
+    REQUIRE(dense.containers_[0].dense());
+    check_same(dense, s);
+    REQUIRE(dense.contains(9998));
+    REQUIRE_FALSE(dense.contains(9999));
+}
+
+TEST_CASE("bitmaps union, intersect and subtract", "[bitmap]") {
+    Bitmap a;
+    Bitmap b;
+    std::set<uint32_t> sa;
+    std::set<uint32_t> sb;
+    fill(a, sa, 1);
+    fill(b, sb, 2);
+    add_both(b, sb, 9 << 16);
+
+    Bitmap u = a;
+    u.union_with(b);
+    std::set<uint32_t> su = sa;
+    su.insert(sb.begin(), sb.end());
+    check_same(u, su);
+
+    Bitmap i = a;
+    i.intersect_with(b);
+    std::set<uint32_t> si;
+    for (uint32_t v : sa) {
+        if (sb.count(v)) si.insert(v);
+    }
+    check_same(i, si);
+
+    Bitmap d = a;
+    d.andnot_with(b);
+    std::set<uint32_t> sd;
+    for (uint32_t v : sa) {
+        if (!sb.count(v)) sd.insert(v);
+    }
+    check_same(d, sd);
+
+    // subtracting a set from itself leaves no containers
+    Bitmap none = a;
+    none.andnot_with(a);
+    REQUIRE(none.cardinality() == 0);
+    REQUIRE(none.containers_.empty());
+}
+
+TEST_CASE("bitmaps serialize compactly", "[bitmap]") {
+    Bitmap a;
+    std::set<uint32_t> sa;
+    fill(a, sa, 3);
+    Serializer s;
+    a.serialize(&s);
+    // two bytes a sparse value, 8 KiB for the dense container
+    REQUIRE(s.size() < 1000 * 2 + 3000 * 2 + 8192 + 200);
+    Deserializer d(s.get_bytes(), s.size());
+    Bitmap copy(&d);
+    REQUIRE(copy.equals(&a));
+    check_same(copy, sa);
+
+    KVStore kv;
+    Key k("bits");
+    put_bitmap(&kv, k, a);
+    Bitmap* stored = get_bitmap(&kv, k);
+    REQUIRE(stored->equals(&a));
+    delete stored;
+}
+
+/**
+ * Sets the bits node, node + 3, ... below 1000 and merges them with every
+ * other node.
+ */
+class BitmapUnion : public Application {
+   public:
+    Bitmap bits_;
+
+    BitmapUnion(NetworkIfc& net) : Application(net) {}
+
+    void run() override {
+        for (size_t i = this_node(); i < 1000; i += num_nodes()) {
+            bits_.add(i);
+        }
+        union_all("bits", bits_);
+    }
+};
+
+TEST_CASE("union bitmaps across nodes", "[bitmap][application]") {
+    Address a0("127.0.0.1", 10000);
+    Address a1("127.0.0.1", 10001);
+    Address a2("127.0.0.1", 10002);
+    NetworkIfc net0(&a0, 3);
+    NetworkIfc net1(&a1, &a0, 1, 3);
+    NetworkIfc net2(&a2, &a0, 2, 3);
+
+    BitmapUnion u0(net0);
+    BitmapUnion u1(net1);
+    BitmapUnion u2(net2);
+
+    u0.start();
+    u1.start();
+    u2.start();
+
+    u0.join();
+    u1.join();
+    u2.join();
+
+    REQUIRE(u0.bits_.cardinality() == 1000);
+    REQUIRE(u1.bits_.equals(&u0.bits_));
+    REQUIRE(u2.bits_.equals(&u0.bits_));
+}
@@ -152,3 +152,53 @@ TEST_CASE("get indices on node 0 for column", "[column]") {
     net0.join();
     net1.join();
 }
+
+// test concat method
+TEST_CASE("concat columns of uneven segments", "[column]") {
+    KVStore kv;
+    IntColumn a(&kv, 4);
+    IntColumn b(&kv, 4);
+    for (int i = 0; i < 10; i++) {
+        a.push_back(i);
+        b.push_back(100 + i);
+    }
+    a.finalize();
+    b.finalize();
+
+    // rows 2 to 8 of a, then rows 3 to 6 of b, then all of b
+    IntColumn c(a);
+    c.narrow(2, 9);
+    IntColumn mid(b);
+    mid.narrow(3, 7);
+    c.concat(mid);
+    c.concat(b);
+    REQUIRE(c.size() == 7 + 4 + 10);
+    for (size_t i = 0; i < 7; i++) {
+        REQUIRE(c.get(i) == (int)i + 2);
+    }
+    for (size_t i = 0; i < 4; i++) {
+        REQUIRE(c.get(7 + i) == 103 + (int)i);
+    }
+    for (size_t i = 0; i < 10; i++) {
+        REQUIRE(c.get(11 + i) == 100 + (int)i);
+    }
+
+    // the offsets survive serialization
+    Serializer s;
+    c.serialize(&s);
+    Deserializer d(s.get_bytes(), s.size());
+    IntColumn copy(&kv, &d);
+    for (size_t i = 0; i < copy.size(); i++) {
+        REQUIRE(copy.get(i) == c.get(i));
+    }
+
+    // pushing again copies the partial tail rather than changing it
+    c.reopen();
+    c.push_back(7);
+    c.finalize();
+    REQUIRE(c.size() == 22);
+    REQUIRE(c.get(20) == 109);
+    REQUIRE(c.get(21) == 7);
+    REQUIRE(b.get(9) == 109);
+    REQUIRE(b.size() == 10);
+}
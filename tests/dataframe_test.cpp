@@ -3,7 +3,9 @@
 #include <map>
 #include <string>
 
+#include "application/application.h"
 #include "catch.hpp"
+#include "dataframe/typed.h"
 #include "dataframe/visitor.h"
 #include "store/kdstore.h"
 
@@ -453,3 +455,333 @@ TEST_CASE("adder with map on data frame", "[dataframe][kdstore]") {
     delete world;
     delete potato;
 }
+
+/**
+ * Writes the rows (i, "r" + i) for i from a start up to an end.
+ */
+class RangeWriter : public Writer {
+   public:
+    size_t i_;
+    size_t end_;
+
+    RangeWriter(size_t start, size_t end) : Writer(), i_(start), end_(end) {}
+
+    void visit(Row& r) override {
+        r.set(0, (int)i_);
+        r.set(1, StrBuff().c("r").c(i_).get());
+        i_++;
+    }
+
+    bool done() override {
+        return i_ == end_;
+    }
+};
+
+// checks that the rows of a frame are the ones RangeWriter(0, n) writes
+static void check_range(DataFrame* df, size_t n) {
+    REQUIRE(df->nrows() == n);
+    for (size_t i = 0; i < n; i++) {
+        REQUIRE(df->get_int(0, i) == (int)i);
+        String* s = df->get_string(1, i);
+        String* expected = StrBuff().c("r").c(i).get();
+        REQUIRE(s->equals(expected));
+        delete expected;
+        delete s;
+    }
+}
+
+// test append method
+TEST_CASE("append rows to a stored frame", "[dataframe][kdstore]") {
+    KVStore kv;
+    KDStore kd(&kv);
+    Key k("range");
+    std::vector<Column*> cols;
+    cols.push_back(new IntColumn(&kv, 4));
+    cols.push_back(new StringColumn(&kv, 4));
+    Schema s("IS");
+    Row r(s);
+    RangeWriter first(0, 6);
+    while (!first.done()) {
+        first.visit(r);
+        r.add_to_columns(cols);
+    }
+    DataFrame* df = new DataFrame(cols, &kv);
+    kd.put(k, df);
+    DataFrame* before = kd.get(k);
+    check_range(before, 6);
+
+    // the partly filled tail segment is copied, not changed
+    RangeWriter second(6, 11);
+    DataFrame* after = kd.append(k, second);
+    check_range(after, 11);
+    REQUIRE(after->columns_[0]->table_->keys_.size() == 3);
+    check_range(before, 6);
+    DataFrame* stored = kd.get(k);
+    check_range(stored, 11);
+    delete stored;
+
+    // appending to a full tail and appending nothing
+    RangeWriter third(11, 12);
+    delete kd.append(k, third);
+    RangeWriter fourth(12, 14);
+    delete kd.append(k, fourth);
+    RangeWriter none(14, 14);
+    stored = kd.append(k, none);
+    check_range(stored, 14);
+    REQUIRE(stored->columns_[1]->table_->keys_.size() == 4);
+    REQUIRE(stored->columns_[1]->local_indices().size() == 14);
+    check_range(after, 11);
+
+    // removing the frame leaves the segments it kept to the copies read before
+    kd.remove(k);
+    check_range(before, 6);
+    check_range(after, 11);
+
+    delete stored;
+    delete after;
+    delete before;
+    delete df;
+}
+
+// test local_map on a frame without rows
+TEST_CASE("local_map on an empty frame", "[dataframe][kdstore]") {
+    KVStore kv;
+    KDStore kd(&kv);
+    Key k("empty");
+    RangeWriter none(0, 0);
+    DataFrame* df = DataFrame::fromVisitor(&k, &kd, "IS", none);
+    REQUIRE(df->columns_[0]->local_indices().size() == 0);
+    RangeWriter some(0, 3);
+    DataFrame* grown = kd.append(k, some);
+    check_range(grown, 3);
+    delete grown;
+    delete df;
+}
+
+/** Adds up the int column and counts the rows of a (int, string) frame. */
+class RangeSummer : public Reader {
+   public:
+    int sum_ = 0;
+    size_t rows_ = 0;
+
+    void visit(Row& r) override {
+        sum_ += r.get_int(0);
+        rows_++;
+    }
+};
+
+// test slice and select methods
+TEST_CASE("slice and select make views without copying", "[dataframe][kdstore]") {
+    KVStore kv;
+    KDStore kd(&kv);
+    Key k("range");
+    std::vector<Column*> cols;
+    cols.push_back(new IntColumn(&kv, 4));
+    cols.push_back(new StringColumn(&kv, 4));
+    Schema s("IS");
+    Row r(s);
+    RangeWriter w(0, 14);
+    while (!w.done()) {
+        w.visit(r);
+        r.add_to_columns(cols);
+    }
+    DataFrame* df = new DataFrame(cols, &kv);
+    size_t items = kv.size();
+
+    // rows 5 to 10 start one row into the second segment and end in the third
+    DataFrame* mid = df->slice(5, 11);
+    REQUIRE(mid->nrows() == 6);
+    REQUIRE(mid->columns_[0]->table_->keys_.size() == 2);
+    REQUIRE(mid->get_int(0, 0) == 5);
+    REQUIRE(mid->get_int(0, 5) == 10);
+    String* str = mid->get_string(1, 3);
+    REQUIRE(std::string(str->c_str()) == "r8");
+    delete str;
+    RangeSummer sum;
+    mid->map(sum);
+    REQUIRE(sum.sum_ == 5 + 6 + 7 + 8 + 9 + 10);
+    RangeSummer local;
+    mid->local_map(local);
+    REQUIRE(local.rows_ == 6);
+    REQUIRE(local.sum_ == sum.sum_);
+
+    // a view of a view, and a view of columns
+    DataFrame* inner = mid->slice(2, 4);
+    REQUIRE(inner->get_int(0, 0) == 7);
+    REQUIRE(inner->get_int(0, 1) == 8);
+    DataFrame* names = mid->select({1, 1});
+    REQUIRE(names->ncols() == 2);
+    REQUIRE(names->nrows() == 6);
+    REQUIRE(names->col_type(0) == 'S');
+    str = names->get_string(1, 0);
+    REQUIRE(std::string(str->c_str()) == "r5");
+    delete str;
+    DataFrame* empty = df->slice(8, 8);
+    REQUIRE(empty->nrows() == 0);
+    RangeSummer none;
+    empty->local_map(none);
+    REQUIRE(none.rows_ == 0);
+    REQUIRE(kv.size() == items);
+
+    // storing a view only stores its metadata
+    Key vk("view");
+    kd.put(vk, mid);
+    REQUIRE(kv.size() == items + 1);
+    DataFrame* stored = kd.get(vk);
+    RangeSummer stored_sum;
+    stored->map(stored_sum);
+    REQUIRE(stored_sum.sum_ == sum.sum_);
+
+    // appending to a view leaves the rows after it alone
+    RangeWriter more(100, 103);
+    DataFrame* grown = kd.append(vk, more);
+    REQUIRE(grown->nrows() == 9);
+    REQUIRE(grown->get_int(0, 5) == 10);
+    REQUIRE(grown->get_int(0, 6) == 100);
+    REQUIRE(grown->get_int(0, 8) == 102);
+    REQUIRE(df->get_int(0, 11) == 11);
+    REQUIRE(df->get_int(0, 13) == 13);
+    REQUIRE(mid->get_int(0, 5) == 10);
+
+    // views open as typed frames
+    TypedDataFrame<int, String> typed(*inner);
+    REQUIRE(typed.get<0>(1) == 8);
+
+    delete grown;
+    delete stored;
+    delete empty;
+    delete names;
+    delete inner;
+    delete mid;
+    delete df;
+}
+
+/**
+ * Builds a frame with a writer on every node: node n writes the rows from
+ * 30 * n up to 30 * n + 30, or 20 on the last node.
+ */
+class PartWriter : public Application {
+   public:
+    DataFrame* result_ = nullptr;
+    std::vector<size_t> local_;
+
+    PartWriter(NetworkIfc& net) : Application(net) {}
+
+    ~PartWriter() {
+        delete result_;
+    }
+
+    void run() override {
+        Key k("parts", 1);
+        size_t start = this_node() * 30;
+        RangeWriter w(start, start + (this_node() + 1 == num_nodes() ? 20 : 30));
+        result_ = DataFrame::fromDistributedVisitor(&k, &kd_, "IS", w);
+        local_ = result_->columns_[0]->local_indices();
+    }
+};
+
+TEST_CASE("build a frame with a writer on every node", "[dataframe][kdstore]") {
+    Address a0("127.0.0.1", 10000);
+    Address a1("127.0.0.1", 10001);
+    NetworkIfc net0(&a0, 2);
+    NetworkIfc net1(&a1, &a0, 1, 2);
+
+    PartWriter p0(net0);
+    PartWriter p1(net1);
+
+    p0.start();
+    p1.start();
+
+    p0.join();
+    p1.join();
+
+    check_range(p0.result_, 50);
+    check_range(p1.result_, 50);
+
+    // each node holds the rows it wrote
+    REQUIRE(p0.local_.size() == 30);
+    REQUIRE(p0.local_.front() == 0);
+    REQUIRE(p1.local_.size() == 20);
+    REQUIRE(p1.local_.front() == 30);
+    REQUIRE(p1.local_.back() == 49);
+}
+
+// test concat method
+TEST_CASE("concat frames without copying", "[dataframe][kdstore]") {
+    KVStore kv;
+    KDStore kd(&kv);
+    Key k("range");
+    RangeWriter w(0, 10);
+    DataFrame* df = DataFrame::fromVisitor(&k, &kd, "IS", w);
+    size_t items = kv.size();
+
+    DataFrame* head = df->slice(0, 3);
+    DataFrame* tail = df->slice(3, 10);
+    DataFrame* whole = head->concat(*tail);
+    check_range(whole, 10);
+    DataFrame* twice = tail->concat(*head);
+    REQUIRE(twice->nrows() == 10);
+    REQUIRE(twice->get_int(0, 0) == 3);
+    REQUIRE(twice->get_int(0, 7) == 0);
+    REQUIRE(twice->get_int(0, 9) == 2);
+    REQUIRE(kv.size() == items);
+
+    // the result can be stored and read as a typed frame
+    Key ck("twice");
+    kd.put(ck, twice);
+    DataFrame* stored = kd.get(ck);
+    TypedDataFrame<int, String> typed(*stored);
+    RangeSummer sum;
+    stored->map(sum);
+    REQUIRE(sum.sum_ == 45);
+    REQUIRE(typed.get<0>(8) == 1);
+    REQUIRE(std::string(typed.get<1>(6)->c_str()) == "r9");
+
+    delete stored;
+    delete twice;
+    delete whole;
+    delete tail;
+    delete head;
+    delete df;
+}
+
+/**
+ * Records the order in which it and other readers see the rows.
+ */
+class OrderLogger : public Reader {
+   public:
+    std::vector<std::string>& log_;
+    std::string name_;
+
+    OrderLogger(std::vector<std::string>& log, const char* name)
+        : Reader(), log_(log), name_(name) {}
+
+    void visit(Row& r) override {
+        log_.push_back(name_ + std::to_string(r.get_int(0)));
+    }
+};
+
+// test local_map_all and map_all methods
+TEST_CASE("map several readers in one pass", "[dataframe][kdstore]") {
+    KVStore kv;
+    KDStore kd(&kv);
+    Key k("range");
+    RangeWriter w(0, 3);
+    DataFrame* df = DataFrame::fromVisitor(&k, &kd, "IS", w);
+
+    std::vector<std::string> log;
+    OrderLogger a(log, "a");
+    OrderLogger b(log, "b");
+    RangeSummer sum;
+    df->map_all({&a, &sum, &b});
+    REQUIRE(log == std::vector<std::string>({"a0", "b0", "a1", "b1", "a2", "b2"}));
+    REQUIRE(sum.sum_ == 3);
+    REQUIRE(sum.rows_ == 3);
+
+    log.clear();
+    RangeSummer local;
+    df->local_map_all({&b, &local, &a});
+    REQUIRE(log == std::vector<std::string>({"b0", "a0", "b1", "a1", "b2", "a2"}));
+    REQUIRE(local.sum_ == 3);
+    delete df;
+}
@@ -0,0 +1,158 @@
+#include "dataframe/graph.h"
+
+#include "application/application.h"
+#include "catch.hpp"
+#include "store/kdstore.h"
+
+/**
+ * Writes the edges of two components: the path 0 -> 1 -> 2 -> 3 with the
+ * shortcut 0 -> 2, and the cycle 4 -> 5 -> 6 -> 4. Vertex 7 has no edges.
+ * Edges past start are skipped and those from end on are not written, so
+ * that nodes can write a share each.
+ */
+class EdgeWriter : public Writer {
+   public:
+    size_t i_;
+    size_t end_;
+    int edges_[7][2] = {{0, 1}, {1, 2}, {2, 3}, {0, 2}, {4, 5}, {5, 6}, {6, 4}};
+
+    EdgeWriter(size_t start, size_t end) : Writer(), i_(start), end_(end) {}
+
+    void visit(Row& r) override {
+        r.set(0, edges_[i_][0]);
+        r.set(1, edges_[i_][1]);
+        i_++;
+    }
+
+    bool done() override {
+        return i_ == end_;
+    }
+};
+
+static const EdgeEnd FROM = {0, 0, 8};
+static const EdgeEnd TO = {1, 0, 8};
+
+/**
+ * The results of every algorithm on a graph.
+ */
+struct GraphResults {
+    size_t nvertices_;
+    std::vector<int> from0_;          // directed, from 0
+    std::vector<int> from3_;          // undirected, from 3
+    std::vector<int> from3directed_;  // directed, from 3
+    std::vector<uint32_t> labels_;
+    std::vector<double> rank_;
+};
+
+// runs every algorithm on a graph
+static GraphResults run_graph(Graph& g) {
+    GraphResults r;
+    r.nvertices_ = g.nvertices();
+    r.from0_ = g.bfs(0, true);
+    r.from3_ = g.bfs(3);
+    r.from3directed_ = g.bfs(3, true);
+    r.labels_ = g.components();
+    r.rank_ = g.pagerank(50);
+    return r;
+}
+
+// checks the results of every algorithm on the graph EdgeWriter writes
+static void check_graph(GraphResults& r) {
+    REQUIRE(r.nvertices_ == 8);
+    REQUIRE(r.from0_ == std::vector<int>({0, 1, 1, 2, -1, -1, -1, -1}));
+    REQUIRE(r.from3_ == std::vector<int>({2, 2, 1, 0, -1, -1, -1, -1}));
+    REQUIRE(r.from3directed_[3] == 0);
+    REQUIRE(r.from3directed_[0] == -1);
+    REQUIRE(r.labels_ == std::vector<uint32_t>({0, 0, 0, 0, 4, 4, 4, 7}));
+
+    std::vector<double>& rank = r.rank_;
+    double total = 0;
+    for (double r : rank) {
+        total += r;
+    }
+    REQUIRE(total == Approx(1.0));
+    // the cycle passes its rank around evenly, and the end of the path
+    // gathers more than its start
+    REQUIRE(rank[4] == Approx(rank[5]));
+    REQUIRE(rank[5] == Approx(rank[6]));
+    REQUIRE(rank[3] > rank[0]);
+    REQUIRE(rank[2] > rank[1]);
+}
+
+TEST_CASE("graph algorithms on one node", "[graph]") {
+    KVStore kv;
+    KDStore kd(&kv);
+    Key k("edges");
+    EdgeWriter w(0, 7);
+    DataFrame* edges = DataFrame::fromVisitor(&k, &kd, "II", w);
+    Graph g(&kv, "graph", edges, FROM, TO);
+    REQUIRE(g.local_edges() == 7);
+    GraphResults results = run_graph(g);
+    check_graph(results);
+
+    // a single worker finds the same
+    Graph one(&kv, "one", edges, FROM, TO, 1);
+    GraphResults single = run_graph(one);
+    check_graph(single);
+    delete edges;
+}
+
+TEST_CASE("bfs steps push and pull the same frontier", "[graph]") {
+    KVStore kv;
+    KDStore kd(&kv);
+    Key k("edges");
+    EdgeWriter w(0, 7);
+    DataFrame* edges = DataFrame::fromVisitor(&k, &kd, "II", w);
+    Graph g(&kv, "graph", edges, FROM, TO);
+    Bitmap frontier;
+    frontier.add(1);
+    Bitmap visited = frontier;
+    Bitmap pushed = g.push_(frontier, visited, false);
+    Bitmap pulled = g.pull_(frontier, visited, false);
+    REQUIRE(pushed.values() == std::vector<uint32_t>({0, 2}));
+    REQUIRE(pulled.equals(&pushed));
+    delete edges;
+}
+
+/**
+ * Runs the graph algorithms on edges every node writes a share of.
+ */
+class GraphApp : public Application {
+   public:
+    size_t local_edges_ = 0;
+    GraphResults results_;
+
+    GraphApp(NetworkIfc& net) : Application(net) {}
+
+    void run() override {
+        Key k("edges", 0);
+        EdgeWriter w(this_node() * 4, this_node() == 0 ? 4 : 7);
+        DataFrame* edges = DataFrame::fromDistributedVisitor(&k, &kd_, "II", w);
+        Graph g(&kv_, "graph", edges, FROM, TO);
+        local_edges_ = g.local_edges();
+        results_ = run_graph(g);
+        delete edges;
+    }
+};
+
+TEST_CASE("graph algorithms across nodes", "[graph][application]") {
+    Address a0("127.0.0.1", 10000);
+    Address a1("127.0.0.1", 10001);
+    NetworkIfc net0(&a0, 2);
+    NetworkIfc net1(&a1, &a0, 1, 2);
+
+    GraphApp g0(net0);
+    GraphApp g1(net1);
+
+    g0.start();
+    g1.start();
+
+    g0.join();
+    g1.join();
+
+    REQUIRE(g0.local_edges_ == 4);
+    REQUIRE(g1.local_edges_ == 3);
+    check_graph(g0.results_);
+    check_graph(g1.results_);
+    REQUIRE(g0.results_.rank_ == g1.results_.rank_);
+}
@@ -0,0 +1,195 @@
+#include "dataframe/groupby.h"
+
+#include <map>
+#include <string>
+
+#include "application/application.h"
+#include "catch.hpp"
+
+/**
+ * Writes rows (word, n) where word cycles through a few words and n counts up.
+ */
+class WordNumWriter : public Writer {
+   public:
+    size_t i_ = 0;
+    size_t n_;
+
+    WordNumWriter(size_t n) : Writer(), n_(n) {}
+
+    void visit(Row& r) override {
+        const char* words[] = {"apple", "pear", "fig"};
+        r.set(0, new String(words[i_ % 3]));
+        r.set(1, (int)i_);
+        r.set(2, i_ * 0.5);
+        i_++;
+    }
+
+    bool done() override {
+        return i_ == n_;
+    }
+};
+
+/**
+ * Copies every row of a (S, I, I, I, I, D, D) group by result into maps.
+ */
+class GroupCollector : public Reader {
+   public:
+    std::map<std::string, std::vector<double>> groups_;
+
+    void visit(Row& r) override {
+        std::vector<double> vals;
+        vals.push_back(r.get_int(1));
+        vals.push_back(r.get_int(2));
+        vals.push_back(r.get_int(3));
+        vals.push_back(r.get_int(4));
+        vals.push_back(r.get_double(5));
+        vals.push_back(r.get_double(6));
+        groups_[std::string(r.get_string(0)->c_str())] = vals;
+    }
+};
+
+static std::vector<Aggregate> test_aggs() {
+    std::vector<Aggregate> aggs;
+    aggs.push_back(Aggregate(AggType::COUNT));
+    aggs.push_back(Aggregate(AggType::SUM, 1));
+    aggs.push_back(Aggregate(AggType::MIN, 1));
+    aggs.push_back(Aggregate(AggType::MAX, 1));
+    aggs.push_back(Aggregate(AggType::MEAN, 1));
+    aggs.push_back(Aggregate(AggType::SUM, 2));
+    return aggs;
+}
+
+// checks the result of grouping 30 rows written by WordNumWriter
+static void check_groups(DataFrame* df) {
+    REQUIRE(df->nrows() == 3);
+    REQUIRE(df->ncols() == 7);
+    GroupCollector c;
+    df->map(c);
+    // apple: 0, 3, ..., 27
+    std::vector<double>& apple = c.groups_["apple"];
+    REQUIRE(apple[0] == 10);
+    REQUIRE(apple[1] == 135);
+    REQUIRE(apple[2] == 0);
+    REQUIRE(apple[3] == 27);
+    REQUIRE(apple[4] == 13.5);
+    REQUIRE(apple[5] == 67.5);
+    // fig: 2, 5, ..., 29
+    std::vector<double>& fig = c.groups_["fig"];
+    REQUIRE(fig[0] == 10);
+    REQUIRE(fig[1] == 155);
+    REQUIRE(fig[2] == 2);
+    REQUIRE(fig[3] == 29);
+    REQUIRE(fig[4] == 15.5);
+}
+
+TEST_CASE("hash table insert and find", "[hashtable]") {
+    HashTable t(2);
+    char buf[16];
+    for (size_t i = 0; i < 1000; i++) {
+        snprintf(buf, 16, "k%zu", i);
+        REQUIRE(t.insert(buf, strlen(buf)) == i);
+    }
+    REQUIRE(t.size() == 1000);
+    for (size_t i = 0; i < 1000; i++) {
+        snprintf(buf, 16, "k%zu", i);
+        REQUIRE(t.find(buf, strlen(buf)) == i);
+        REQUIRE(t.insert(buf, strlen(buf)) == i);
+        REQUIRE(t.key_size(i) == strlen(buf));
+        REQUIRE(memcmp(t.key(i), buf, strlen(buf)) == 0);
+    }
+    REQUIRE(t.size() == 1000);
+    REQUIRE(t.find("missing", 7) == HASH_NOT_FOUND);
+}
+
+TEST_CASE("group by and aggregate on one node", "[groupby]") {
+    KVStore kv;
+    KDStore kd(&kv);
+    Key in("in");
+    Key out("out");
+    WordNumWriter w(30);
+    DataFrame* df = DataFrame::fromVisitor(&in, &kd, "SID", w);
+    std::vector<size_t> keys;
+    keys.push_back(0);
+    DataFrame* result = df->group_by(keys).agg(&out, &kd, test_aggs());
+    check_groups(result);
+
+    DataFrame* stored = kd.get(out);
+    REQUIRE(stored->nrows() == 3);
+
+    delete stored;
+    delete result;
+    delete df;
+}
+
+TEST_CASE("group by on several key columns", "[groupby]") {
+    KVStore kv;
+    KDStore kd(&kv);
+    Key in("in");
+    Key out("out");
+    WordNumWriter w(30);
+    DataFrame* df = DataFrame::fromVisitor(&in, &kd, "SID", w);
+    std::vector<size_t> keys;
+    keys.push_back(0);
+    keys.push_back(1);
+    std::vector<Aggregate> aggs;
+    aggs.push_back(Aggregate(AggType::COUNT));
+    DataFrame* result = df->group_by(keys).agg(&out, &kd, aggs);
+    REQUIRE(result->nrows() == 30);
+    REQUIRE(result->get_schema().col_type(0) == 'S');
+    REQUIRE(result->get_schema().col_type(1) == 'I');
+    REQUIRE(result->get_schema().col_type(2) == 'I');
+    for (size_t i = 0; i < 30; i++) {
+        REQUIRE(result->get_int(2, i) == 1);
+    }
+    delete result;
+    delete df;
+}
+
+/**
+ * Runs the same group by on every node of a cluster.
+ */
+class Grouper : public Application {
+   public:
+    DataFrame* result_ = nullptr;
+
+    Grouper(NetworkIfc& net) : Application(net) {}
+
+    ~Grouper() {
+        delete result_;
+    }
+
+    void run() override {
+        Key in("in");
+        Key out("grouped", 1);
+        DataFrame* df;
+        if (this_node() == 0) {
+            WordNumWriter w(30);
+            df = DataFrame::fromVisitor(&in, &kd_, "SID", w);
+        } else {
+            df = kd_.waitAndGet(in);
+        }
+        std::vector<size_t> keys;
+        keys.push_back(0);
+        result_ = df->group_by(keys).agg(&out, &kd_, test_aggs());
+        delete df;
+    }
+};
+
+TEST_CASE("group by shuffles groups across nodes", "[groupby]") {
+    Address a0("127.0.0.1", 10000);
+    Address a1("127.0.0.1", 10001);
+    NetworkIfc net0(&a0, 2);
+    NetworkIfc net1(&a1, &a0, 1, 2);
+
+    Grouper g0(net0);
+    Grouper g1(net1);
+
+    g0.start();
+    g1.start();
+
+    g0.join();
+    g1.join();
+
+    check_groups(g0.result_);
+    check_groups(g1.result_);
+}
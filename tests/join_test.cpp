@@ -0,0 +1,228 @@
+#include "dataframe/join.h"
+
+#include <map>
+#include <string>
+
+#include "application/application.h"
+#include "catch.hpp"
+
+/**
+ * Writes users (uid, name) for uids 0..n-1.
+ */
+class UserWriter : public Writer {
+   public:
+    size_t i_ = 0;
+    size_t n_;
+
+    UserWriter(size_t n) : Writer(), n_(n) {}
+
+    void visit(Row& r) override {
+        String* name = StrBuff().c("user").c(i_).get();
+        r.set(0, (int)i_);
+        r.set(1, name);
+        i_++;
+    }
+
+    bool done() override {
+        return i_ == n_;
+    }
+};
+
+/**
+ * Writes commits (pid, uid) where commit i is by user i % 7 to project i.
+ */
+class CommitWriter : public Writer {
+   public:
+    size_t i_ = 0;
+    size_t n_;
+
+    CommitWriter(size_t n) : Writer(), n_(n) {}
+
+    void visit(Row& r) override {
+        r.set(0, (int)i_);
+        r.set(1, (int)(i_ % 7));
+        i_++;
+    }
+
+    bool done() override {
+        return i_ == n_;
+    }
+};
+
+/**
+ * Checks every row of a (pid, uid, uid, name) join result.
+ */
+class JoinChecker : public Reader {
+   public:
+    std::map<int, int> commits_per_user_;
+    bool ok_ = true;
+
+    void visit(Row& r) override {
+        int uid = r.get_int(1);
+        String* expected = StrBuff().c("user").c(uid).get();
+        ok_ = ok_ && r.get_int(0) % 7 == uid && r.get_int(2) == uid &&
+              r.get_string(3)->equals(expected);
+        delete expected;
+        commits_per_user_[uid] += 1;
+    }
+};
+
+// checks the result of joining 30 commits with 5 users
+static void check_join(DataFrame* df) {
+    REQUIRE(df->ncols() == 4);
+    // users 5 and 6 do not exist: commits 5, 6, 12, 13, 19, 20, 26, 27 drop
+    REQUIRE(df->nrows() == 22);
+    JoinChecker c;
+    df->map(c);
+    REQUIRE(c.ok_);
+    REQUIRE(c.commits_per_user_.size() == 5);
+    REQUIRE(c.commits_per_user_[0] == 5);
+    REQUIRE(c.commits_per_user_[1] == 5);
+    REQUIRE(c.commits_per_user_[4] == 4);
+}
+
+TEST_CASE("row batches round trip records", "[rowbatch]") {
+    RowBatch b;
+    b.add("abc", 3);
+    b.add("de", 2, "f", 1);
+    Serializer s;
+    b.serialize(&s);
+    BatchCursor cur(s.get_bytes(), s.size());
+    size_t len;
+    const char* rec = cur.next(&len);
+    REQUIRE((len == 3 && memcmp(rec, "abc", 3) == 0));
+    rec = cur.next(&len);
+    REQUIRE((len == 3 && memcmp(rec, "def", 3) == 0));
+    REQUIRE(cur.done());
+}
+
+TEST_CASE("join table chains rows of a key", "[join]") {
+    JoinTable t;
+    t.add("a", 1, "1", 1);
+    t.add("b", 1, "2", 1);
+    t.add("a", 1, "3", 1);
+    REQUIRE(t.size() == 3);
+    size_t matches = 0;
+    for (size_t r = t.first("a", 1); r != 0; r = t.next(r)) {
+        size_t len;
+        const char* row = t.row(r, &len);
+        REQUIRE((len == 1 && (row[0] == '1' || row[0] == '3')));
+        matches++;
+    }
+    REQUIRE(matches == 2);
+    REQUIRE(t.first("c", 1) == 0);
+}
+
+TEST_CASE("join two frames on one node", "[join]") {
+    KVStore kv;
+    KDStore kd(&kv);
+    Key uk("users");
+    Key ck("commits");
+    Key out("out");
+    UserWriter uw(5);
+    CommitWriter cw(30);
+    DataFrame* users = DataFrame::fromVisitor(&uk, &kd, "IS", uw);
+    DataFrame* commits = DataFrame::fromVisitor(&ck, &kd, "II", cw);
+
+    DataFrame* result = commits->join(&out, &kd, users, 1, 0);
+    check_join(result);
+
+    delete result;
+    delete users;
+    delete commits;
+}
+
+/**
+ * Runs the same join on every node of a cluster.
+ */
+class Joiner : public Application {
+   public:
+    DataFrame* result_ = nullptr;
+    JoinStrategy strategy_;
+
+    Joiner(NetworkIfc& net, JoinStrategy strategy) : Application(net), strategy_(strategy) {}
+
+    ~Joiner() {
+        delete result_;
+    }
+
+    void run() override {
+        Key uk("users");
+        Key ck("commits");
+        Key out("joined", 1);
+        DataFrame* users;
+        DataFrame* commits;
+        if (this_node() == 0) {
+            UserWriter uw(5);
+            CommitWriter cw(30);
+            users = DataFrame::fromVisitor(&uk, &kd_, "IS", uw);
+            commits = DataFrame::fromVisitor(&ck, &kd_, "II", cw);
+        } else {
+            users = kd_.waitAndGet(uk);
+            commits = kd_.waitAndGet(ck);
+        }
+        Join j(commits, users, 1, 0, num_nodes());
+        j.strategy_ = strategy_;
+        result_ = j.run(&out, &kd_);
+        delete users;
+        delete commits;
+    }
+};
+
+TEST_CASE("broadcast join across nodes", "[join]") {
+    Address a0("127.0.0.1", 10000);
+    Address a1("127.0.0.1", 10001);
+    NetworkIfc net0(&a0, 2);
+    NetworkIfc net1(&a1, &a0, 1, 2);
+
+    Joiner j0(net0, JoinStrategy::BROADCAST);
+    Joiner j1(net1, JoinStrategy::BROADCAST);
+
+    j0.start();
+    j1.start();
+
+    j0.join();
+    j1.join();
+
+    check_join(j0.result_);
+    check_join(j1.result_);
+}
+
+TEST_CASE("partitioned join across nodes", "[join]") {
+    Address a0("127.0.0.1", 10000);
+    Address a1("127.0.0.1", 10001);
+    NetworkIfc net0(&a0, 2);
+    NetworkIfc net1(&a1, &a0, 1, 2);
+
+    Joiner j0(net0, JoinStrategy::PARTITIONED);
+    Joiner j1(net1, JoinStrategy::PARTITIONED);
+
+    j0.start();
+    j1.start();
+
+    j0.join();
+    j1.join();
+
+    check_join(j0.result_);
+    check_join(j1.result_);
+}
+
+TEST_CASE("join picks a strategy by size", "[join]") {
+    KVStore kv;
+    KDStore kd(&kv);
+    Key uk("users");
+    Key ck("commits");
+    UserWriter uw(5);
+    CommitWriter cw(30);
+    DataFrame* users = DataFrame::fromVisitor(&uk, &kd, "IS", uw);
+    DataFrame* commits = DataFrame::fromVisitor(&ck, &kd, "II", cw);
+
+    Join small(commits, users, 1, 0, 4);
+    REQUIRE(small.strategy_ == JoinStrategy::BROADCAST);
+    REQUIRE(!small.build_left_);
+    Join big(commits, users, 1, 0, 8);
+    REQUIRE(big.strategy_ == JoinStrategy::PARTITIONED);
+
+    delete users;
+    delete commits;
+}
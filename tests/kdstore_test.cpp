@@ -97,3 +97,178 @@ TEST_CASE("getAndWait a df in kdstore remote node", "[kdstore]") {
 
     delete copy_df;
 }
+
+// test the cache of frames read
+TEST_CASE("frames read from a kdstore are cached until put", "[kdstore]") {
+    Key k("cached");
+    KVStore kv;
+    KDStore kd(&kv);
+    int vals[] = {1, 2, 3};
+    delete DataFrame::fromArray(&k, &kd, 3, vals);
+    REQUIRE(kv.version(k) == 1);
+    REQUIRE(kd.frames_.size() == 0);
+
+    DataFrame* first = kd.get(k);
+    DataFrame* cached = kd.frames_.at(k).df_;
+    DataFrame* second = kd.waitAndGet(k);
+    REQUIRE(kd.frames_.at(k).df_ == cached);
+    REQUIRE(second != cached);
+    REQUIRE(second->nrows() == 3);
+    REQUIRE(second->get_int(0, 2) == 3);
+    delete second;
+    // the copies handed out do not depend on each other
+    REQUIRE(first->get_int(0, 1) == 2);
+
+    // a value put at the key behind the store's back is noticed
+    int more[] = {4, 5};
+    KDStore other(&kv);
+    delete DataFrame::fromArray(&k, &other, 2, more);
+    REQUIRE(kv.version(k) == 2);
+    DataFrame* third = kd.get(k);
+    REQUIRE(third->nrows() == 2);
+    REQUIRE(third->get_int(0, 1) == 5);
+
+    // a put through the store drops the cached frame
+    kd.put(k, first);
+    REQUIRE(kd.frames_.size() == 0);
+    DataFrame* fourth = kd.get(k);
+    REQUIRE(fourth->nrows() == 3);
+
+    delete fourth;
+    delete third;
+    delete first;
+}
+
+// test that frames cached from another node are read again once put there
+TEST_CASE("frames cached from a remote node are refreshed when put", "[kdstore]") {
+    Key k("shared", 0);
+    Address a0("127.0.0.1", 10000);
+    Address a1("127.0.0.1", 10001);
+    Address a2("127.0.0.1", 10002);
+    NetworkIfc net0(&a0, 3);
+    KVStore kv0(&net0);
+    net0.set_kv(&kv0);
+    NetworkIfc net1(&a1, &a0, 1, 3);
+    KVStore kv1(&net1);
+    net1.set_kv(&kv1);
+    NetworkIfc net2(&a2, &a0, 2, 3);
+    KVStore kv2(&net2);
+    net2.set_kv(&kv2);
+
+    net0.start();
+    net1.start();
+    net2.start();
+
+    // puts go through the home node, so they are stored before the reads that follow
+    KDStore kd0(&kv0);
+    KDStore kd2(&kv2);
+    int vals[] = {1, 2, 3};
+    delete DataFrame::fromArray(&k, &kd0, 3, vals);
+    DataFrame* first = kd2.get(k);
+    REQUIRE(first->nrows() == 3);
+    REQUIRE(kd2.frames_.size() == 1);
+
+    int more[] = {4, 5};
+    delete DataFrame::fromArray(&k, &kd0, 2, more);
+    DataFrame* second = kd2.get(k);
+    REQUIRE(second->nrows() == 2);
+    REQUIRE(second->get_int(0, 1) == 5);
+    // the frame read before keeps its rows
+    REQUIRE(first->get_int(0, 2) == 3);
+
+    net0.stop();
+    net1.stop();
+    net2.stop();
+    net0.join();
+    net1.join();
+    net2.join();
+
+    delete second;
+    delete first;
+}
+
+// test that removing a frame removes its segments, and that frames expire
+TEST_CASE("remove frames from a kdstore and let them expire", "[kdstore]") {
+    KVStore kv;
+    KDStore kd(&kv);
+    size_t SZ = 100;
+    int* ints = new int[SZ];
+    for (size_t i = 0; i < SZ; i++) {
+        ints[i] = i;
+    }
+    Key first("first");
+    delete DataFrame::fromArray(&first, &kd, SZ, ints);
+    Key second("second");
+    delete DataFrame::fromArray(&second, &kd, SZ, ints);
+    REQUIRE(kv.size() == 4);
+
+    kd.remove(first);
+    REQUIRE(kv.size() == 2);
+    REQUIRE_FALSE(kv.in_(first));
+    DataFrame* df = kd.get(second);
+    REQUIRE(df->get_int(0, SZ - 1) == (int)SZ - 1);
+    delete df;
+
+    // the next put removes the frames whose time is up
+    kd.expire_after(second, 0);
+    Key third("third");
+    kd.expire_after(third, 60000);
+    delete DataFrame::fromArray(&third, &kd, SZ, ints);
+    REQUIRE_FALSE(kv.in_(second));
+    REQUIRE(kv.size() == 2);
+    kd.expire_after(third, 60000);
+    REQUIRE(kd.expire() == 0);
+    kd.expire_after(third, 0);
+    REQUIRE(kd.expire() == 1);
+    REQUIRE(kv.size() == 0);
+    // removing a frame that is gone already does nothing
+    kd.remove(third);
+
+    // so do gets, and the frame is gone for readers that wait for it too
+    delete DataFrame::fromArray(&first, &kd, SZ, ints);
+    delete DataFrame::fromArray(&second, &kd, SZ, ints);
+    kd.expire_after(second, 0);
+    df = kd.get(first);
+    REQUIRE_FALSE(kv.in_(second));
+    REQUIRE(kv.waitAndGet(second) == nullptr);
+    REQUIRE(df->get_int(0, 1) == 1);
+    delete df;
+    delete[] ints;
+}
+
+// test that removing views of a frame leaves the segments of the frame
+TEST_CASE("remove views of a frame from a kdstore", "[kdstore]") {
+    KVStore kv;
+    KDStore kd(&kv);
+    size_t SZ = 100;
+    int* ints = new int[SZ];
+    for (size_t i = 0; i < SZ; i++) {
+        ints[i] = i;
+    }
+    Key base("base");
+    DataFrame* df = DataFrame::fromArray(&base, &kd, SZ, ints);
+    Key part("part");
+    DataFrame* slice = df->slice(10, 20);
+    kd.put(part, slice);
+    Key both("both");
+    DataFrame* joined = df->concat(*slice);
+    kd.put(both, joined);
+    REQUIRE(kv.size() == 4);
+
+    kd.remove(part);
+    kd.remove(both);
+    REQUIRE(kv.size() == 2);
+    DataFrame* read = kd.get(base);
+    REQUIRE(read->nrows() == SZ);
+    REQUIRE(read->get_int(0, 0) == 0);
+    REQUIRE(read->get_int(0, SZ - 1) == (int)SZ - 1);
+
+    // removing the frame takes the segments the views read
+    kd.remove(base);
+    REQUIRE(kv.size() == 0);
+    delete read;
+    delete joined;
+    delete slice;
+    delete df;
+    delete[] ints;
+}
@@ -58,3 +58,45 @@ TEST_CASE("serialize deserialize key", "[key][serialize][deserialize]") {
     REQUIRE(k2.k_ == k.k_);
     REQUIRE(k2.node_ == k.node_);
 }
+
+// test that the hash is computed once and travels with every copy
+TEST_CASE("cache the hash of a key", "[key]") {
+    Key k("first", 2);
+    REQUIRE(k.hash_ == std::hash<std::string>()("first"));
+    REQUIRE(std::hash<Key>()(k) == k.hash_);
+
+    Key copy(k);
+    REQUIRE(copy.hash_ == k.hash_);
+    Key assigned;
+    assigned = k;
+    REQUIRE(assigned.hash_ == k.hash_);
+    REQUIRE(assigned == k);
+
+    Serializer s;
+    k.serialize(&s);
+    Deserializer d(s.get_bytes(), s.size());
+    Key k2(&d);
+    REQUIRE(k2.hash_ == k.hash_);
+    REQUIRE(k2 == k);
+    REQUIRE(k2 != Key("firs"));
+
+    // equals looks at the hashes before the strings
+    Key forged("second", 2);
+    forged.hash_ = k.hash_;
+    REQUIRE_FALSE(k.equals(&forged));
+    Key rehashed("first", 2);
+    rehashed.hash_ = k.hash_ + 1;
+    REQUIRE_FALSE(k.equals(&rehashed));
+    REQUIRE(k.equals(&k2));
+    Object other;
+    REQUIRE_FALSE(k.equals(&other));
+
+    // an empty key goes over the wire too
+    Key empty;
+    Serializer s2;
+    empty.serialize(&s2);
+    Deserializer d2(s2.get_bytes(), s2.size());
+    Key empty2(&d2);
+    REQUIRE(empty2 == empty);
+    REQUIRE(empty2.hash_ == empty.hash_);
+}
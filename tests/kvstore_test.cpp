@@ -1,5 +1,14 @@
 #include "store/kvstore.h"
 
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
 #include "catch.hpp"
 
 // test put and get methods
@@ -123,4 +132,557 @@ TEST_CASE("check number of nodes in kvstore", "[kvstore]") {
     net1.stop();
     net0.join();
     net1.join();
-}
\ No newline at end of file
+}
+// test that keys spread over the shards and can be used from many threads
+TEST_CASE("use a kvstore from many threads", "[kvstore]") {
+    KVStore kv;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; t++) {
+        threads.push_back(std::thread([&kv, t] {
+            for (size_t i = 0; i < 200; i++) {
+                String* name = StrBuff().c("k").c(t).c("-").c(i).get();
+                Key k(name->c_str());
+                kv.put(k, new Value(name->c_str(), name->size()));
+                Value* v = kv.get(k);
+                delete v;
+                delete name;
+            }
+        }));
+    }
+    // a waiter is woken by a put to its key while other keys are busy
+    Key last("last");
+    std::thread waiter([&kv, &last] { delete kv.waitAndGet(last); });
+    String x("x");
+    kv.put(last, new Value(x.c_str(), x.size()));
+    waiter.join();
+    for (std::thread& t : threads) {
+        t.join();
+    }
+
+    REQUIRE(kv.size() == 4 * 200 + 1);
+    REQUIRE(kv.keys().size() == kv.size());
+    size_t used = 0;
+    for (KVShard& shard : kv.shards_) {
+        used += shard.count_ > 0;
+    }
+    REQUIRE(used == KVSTORE_SHARDS);
+    Key k("k3-199");
+    Value* v = kv.get(k);
+    REQUIRE(std::string(v->get_bytes(), v->size()) == "k3-199");
+    REQUIRE(kv.version(k) == 1);
+    delete v;
+}
+
+// test that lock-free reads racing puts, takes and table rebuilds only see whole values
+TEST_CASE("read a kvstore while it is written", "[kvstore]") {
+    KVStore kv;
+    Key hot("hot");
+    String first("hot-0");
+    kv.put(hot, new Value(first.c_str(), first.size()));
+    std::atomic<bool> done(false);
+    std::atomic<size_t> bad(0);
+    std::vector<std::thread> readers;
+    for (size_t t = 0; t < 4; t++) {
+        readers.push_back(std::thread([&kv, &hot, &done, &bad] {
+            while (!done) {
+                Value* v = kv.get(hot);
+                bad += std::string(v->get_bytes(), 4) != "hot-";
+                delete v;
+            }
+        }));
+    }
+    // overwrites the hot key while adding and taking others, which rebuilds the tables
+    for (size_t i = 1; i < 5000; i++) {
+        String* name = StrBuff().c("hot-").c(i).get();
+        kv.put(hot, new Value(name->c_str(), name->size()));
+        Key k(name->c_str());
+        kv.put(k, new Value(name->c_str(), name->size()));
+        if (i % 2 == 0) {
+            delete kv.waitAndTake(k);
+        }
+        delete name;
+    }
+    done = true;
+    for (std::thread& t : readers) {
+        t.join();
+    }
+
+    REQUIRE(bad == 0);
+    REQUIRE(kv.size() == 1 + 2500);
+    REQUIRE(kv.version(hot) == 5000);
+    Value* v = kv.get(hot);
+    REQUIRE(std::string(v->get_bytes(), v->size()) == "hot-4999");
+    delete v;
+}
+
+// test that waiters give up after a timeout and that callbacks run on the put
+TEST_CASE("wait for a key with a timeout or a callback", "[kvstore]") {
+    KVStore kv;
+    Key k("later");
+    String s("value");
+    REQUIRE(kv.waitAndGet(k, 10) == nullptr);
+    REQUIRE_FALSE(kv.in_(k));
+    REQUIRE(kv.size() == 0);
+
+    std::vector<std::string> called;
+    KVCallback record = [&called](Value* v) {
+        called.push_back(std::string(v->get_bytes(), v->size()));
+        delete v;
+    };
+    kv.waitAndCall(k, record);
+    kv.waitAndCall(k, record);
+    REQUIRE(called.empty());
+
+    std::thread putter([&kv, &k, &s] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        kv.put(k, new Value(s.c_str(), s.size()));
+    });
+    Value* v = kv.waitAndGet(k, 10000);
+    putter.join();
+    REQUIRE(v != nullptr);
+    REQUIRE(std::string(v->get_bytes(), v->size()) == "value");
+    delete v;
+    REQUIRE(called == std::vector<std::string>{"value", "value"});
+
+    // a key that has a value calls back right away, and only once
+    kv.waitAndCall(k, record);
+    REQUIRE(called.size() == 3);
+    kv.put(k, new Value(s.c_str(), s.size()));
+    REQUIRE(called.size() == 3);
+}
+
+// test that a store over its memory budget spills the values read least recently
+TEST_CASE("spill cold values to disk under a memory budget", "[kvstore]") {
+    KVStore kv;
+    size_t budget = KVSTORE_SHARDS * 4096;
+    kv.spill_to("/tmp/kvstore_test.spill", budget);
+    Key hot("hot");
+    std::string hot_bytes(1024, 'h');
+    kv.put(hot, new Value(&hot_bytes[0], hot_bytes.size()));
+    Key small("small");
+    String tiny("tiny");
+    kv.put(small, new Value(tiny.c_str(), tiny.size()));
+    for (size_t i = 0; i < 400; i++) {
+        String* name = StrBuff().c("cold-").c(i).get();
+        Key k(name->c_str());
+        std::string bytes(1024, 'a' + i % 26);
+        kv.put(k, new Value(&bytes[0], bytes.size()));
+        // reading the hot key keeps it in memory
+        delete kv.get(hot);
+        delete name;
+    }
+
+    KVStats stats = kv.stats();
+    REQUIRE(stats.resident_ <= budget);
+    REQUIRE(stats.spilled_ >= 402 * 1024 - budget);
+    REQUIRE(stats.spilled_ % 1024 == 0);
+    REQUIRE(stats.hits_ == 400);
+    REQUIRE(stats.misses_ == 0);
+
+    for (size_t i = 0; i < 400; i++) {
+        String* name = StrBuff().c("cold-").c(i).get();
+        Key k(name->c_str());
+        Value* v = kv.get(k);
+        REQUIRE(std::string(v->get_bytes(), v->size()) == std::string(1024, 'a' + i % 26));
+        delete v;
+        delete name;
+    }
+    stats = kv.stats();
+    REQUIRE(stats.misses_ > 0);
+    size_t misses = stats.misses_;
+    Value* v = kv.get(hot);
+    REQUIRE(std::string(v->get_bytes(), v->size()) == hot_bytes);
+    delete v;
+    v = kv.get(small);
+    REQUIRE(v->size() == 4);
+    delete v;
+    REQUIRE(kv.stats().misses_ == misses);
+
+    // taking a spilled value reads it back
+    Key first("cold-0");
+    v = kv.waitAndTake(first);
+    REQUIRE(v->size() == 1024);
+    delete v;
+    REQUIRE(kv.size() == 401);
+}
+
+// test that values spilled while other threads put over them are not lost
+TEST_CASE("spill values while they are put", "[kvstore]") {
+    KVStore kv;
+    size_t budget = KVSTORE_SHARDS * 4096;
+    kv.spill_to("/tmp/kvstore_test.spill", budget);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; t++) {
+        threads.push_back(std::thread([&kv, t] {
+            for (size_t round = 0; round < 5; round++) {
+                for (size_t i = 0; i < 50; i++) {
+                    String* name = StrBuff().c("put-").c(t).c("-").c(i).get();
+                    Key k(name->c_str());
+                    std::string bytes(1024, 'a' + round);
+                    kv.put(k, new Value(&bytes[0], bytes.size()));
+                    delete name;
+                }
+            }
+        }));
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    REQUIRE(kv.stats().spilled_ > 0);
+    for (size_t t = 0; t < 4; t++) {
+        for (size_t i = 0; i < 50; i++) {
+            String* name = StrBuff().c("put-").c(t).c("-").c(i).get();
+            Key k(name->c_str());
+            Value* v = kv.get(k);
+            REQUIRE(std::string(v->get_bytes(), v->size()) == std::string(1024, 'e'));
+            delete v;
+            delete name;
+        }
+    }
+}
+
+// test that batches of keys spread over three nodes come back in the order asked
+TEST_CASE("multi get and put values across nodes", "[kvstore]") {
+    Address a0("127.0.0.1", 10000);
+    Address a1("127.0.0.1", 10001);
+    Address a2("127.0.0.1", 10002);
+    NetworkIfc net0(&a0, 3);
+    KVStore kv0(&net0);
+    net0.set_kv(&kv0);
+    NetworkIfc net1(&a1, &a0, 1, 3);
+    KVStore kv1(&net1);
+    net1.set_kv(&kv1);
+    NetworkIfc net2(&a2, &a0, 2, 3);
+    KVStore kv2(&net2);
+    net2.set_kv(&kv2);
+
+    net0.start();
+    net1.start();
+    net2.start();
+
+    std::vector<std::pair<Key, Value*>> pairs;
+    std::vector<Key> keys;
+    for (size_t i = 0; i < 30; i++) {
+        String* name = StrBuff().c("multi-").c(i).get();
+        Key k(name->c_str(), i % 3);
+        pairs.push_back(std::make_pair(k, new Value(name->c_str(), name->size())));
+        keys.push_back(k);
+        delete name;
+    }
+    kv0.multi_put(pairs);
+    std::reverse(keys.begin(), keys.end());
+    // the puts and the gets to a node share its connection, so the puts land first
+    std::vector<Value*> values = kv0.multi_get(keys);
+
+    REQUIRE(values.size() == 30);
+    for (size_t i = 0; i < 30; i++) {
+        REQUIRE(std::string(values[i]->get_bytes(), values[i]->size()) == keys[i].k_);
+        delete values[i];
+    }
+    REQUIRE(kv0.size() == 10);
+    REQUIRE(kv1.size() == 10);
+    REQUIRE(kv2.size() == 10);
+
+    // keys without values, local, remote or removed, give nullptr
+    Key gone("multi-4", 1);
+    kv0.remove(gone);
+    std::vector<Key> missing = {Key("none", 0), Key("none", 1), gone, Key("multi-5", 2)};
+    values = kv0.multi_get(missing);
+    REQUIRE(values[0] == nullptr);
+    REQUIRE(values[1] == nullptr);
+    REQUIRE(values[2] == nullptr);
+    REQUIRE(std::string(values[3]->get_bytes(), values[3]->size()) == "multi-5");
+    delete values[3];
+
+    net0.stop();
+    net1.stop();
+    net2.stop();
+    net0.join();
+    net1.join();
+    net2.join();
+}
+
+// test that many requests can be outstanding at once and are answered in any order
+TEST_CASE("get and put values asynchronously", "[kvstore]") {
+    Address a0("127.0.0.1", 10000);
+    Address a1("127.0.0.1", 10001);
+    NetworkIfc net0(&a0, 2);
+    KVStore kv0(&net0);
+    net0.set_kv(&kv0);
+    NetworkIfc net1(&a1, &a0, 1, 2);
+    KVStore kv1(&net1);
+    net1.set_kv(&kv1);
+
+    net0.start();
+    net1.start();
+
+    std::vector<Key> keys;
+    std::vector<std::future<void>> stored;
+    for (size_t i = 0; i < 20; i++) {
+        String* name = StrBuff().c("async-").c(i).get();
+        keys.push_back(Key(name->c_str(), 1));
+        stored.push_back(kv0.put_async(keys.back(), new Value(name->c_str(), name->size())));
+        delete name;
+    }
+    for (std::future<void>& f : stored) {
+        f.get();
+    }
+    REQUIRE(kv1.size() == 20);
+
+    // waits for keys that are not there yet, then gets all the others meanwhile
+    Key later0("later-0", 1);
+    Key later1("later-1", 1);
+    std::future<Value*> waiting0 = kv0.wait_and_get_async(later0);
+    std::future<Value*> waiting1 = kv0.wait_and_get_async(later1);
+    std::vector<std::future<Value*>> gets;
+    for (Key& k : keys) {
+        gets.push_back(kv0.get_async(k));
+    }
+    std::promise<size_t> called;
+    kv0.get_async(keys[0], [&called](Value* v) {
+        called.set_value(v->size());
+        delete v;
+    });
+    for (size_t i = 0; i < keys.size(); i++) {
+        Value* v = gets[i].get();
+        REQUIRE(std::string(v->get_bytes(), v->size()) == keys[i].k_);
+        delete v;
+    }
+    String x("x");
+    kv1.put(later1, new Value(x.c_str(), x.size()));
+    Value* v = waiting1.get();
+    REQUIRE(v->size() == 1);
+    delete v;
+    kv1.put(later0, new Value(x.c_str(), x.size()));
+    v = waiting0.get();
+    REQUIRE(v->size() == 1);
+    delete v;
+    REQUIRE(called.get_future().get() == keys[0].k_.size());
+
+    // a wait for a remote key gives up in time, and the value sent later is dropped
+    Key timed("timed", 1);
+    REQUIRE(kv0.waitAndGet(timed, 10) == nullptr);
+    kv1.put(timed, new Value(x.c_str(), x.size()));
+    v = kv0.waitAndGet(timed, 10000);
+    REQUIRE(v->size() == 1);
+    delete v;
+
+    net0.stop();
+    net1.stop();
+    net0.join();
+    net1.join();
+}
+
+// test that a node answers a wait after the connection it came through is gone
+TEST_CASE("answer a wait once its connection is gone", "[kvstore]") {
+    Address a0("127.0.0.1", 10000);
+    Address a1("127.0.0.1", 10001);
+    NetworkIfc* net0 = new NetworkIfc(&a0, 2);
+    KVStore kv0(net0);
+    net0->set_kv(&kv0);
+    NetworkIfc net1(&a1, &a0, 1, 2);
+    KVStore kv1(&net1);
+    net1.set_kv(&kv1);
+
+    net0->start();
+    net1.start();
+
+    Key k("orphan", 0);
+    REQUIRE(kv1.waitAndGet(k, 10) == nullptr);
+    net0->stop();
+    net1.stop();
+    net0->join();
+    net1.join();
+    delete net0;
+    kv0.net_ = nullptr;  // this node carries on alone
+
+    String x("x");
+    kv0.put(k, new Value(x.c_str(), x.size()));
+    Value* v = kv0.get(k);
+    REQUIRE(v->size() == 1);
+    delete v;
+}
+
+// test that values of remote keys are read from the cache until dropped or evicted
+TEST_CASE("cache values of remote keys", "[kvstore]") {
+    Address a0("127.0.0.1", 10000);
+    Address a1("127.0.0.1", 10001);
+    NetworkIfc net0(&a0, 2);
+    KVStore kv0(&net0);
+    net0.set_kv(&kv0);
+    NetworkIfc net1(&a1, &a0, 1, 2);
+    KVStore kv1(&net1);
+    net1.set_kv(&kv1);
+    kv0.cache_remote(100);
+
+    net0.start();
+    net1.start();
+
+    std::string as(40, 'a');
+    std::string bs(40, 'b');
+    std::string cs(40, 'c');
+    Key a("a", 1);
+    Key b("b", 1);
+    Key c("c", 1);
+    kv1.put(a, new Value(&as[0], as.size()));
+    kv1.put(b, new Value(&bs[0], bs.size()));
+    kv1.put(c, new Value(&cs[0], cs.size()));
+
+    Value* v = kv0.waitAndGet(a);
+    REQUIRE(std::string(v->get_bytes(), v->size()) == as);
+    delete v;
+    v = kv0.get(a);
+    REQUIRE(std::string(v->get_bytes(), v->size()) == as);
+    delete v;
+    REQUIRE(kv0.stats().remote_hits_ == 1);
+    REQUIRE(kv0.stats().remote_misses_ == 1);
+
+    // a put on the home node is seen right away
+    kv1.put(a, new Value(&bs[0], bs.size()));
+    v = kv0.get(a);
+    REQUIRE(std::string(v->get_bytes(), v->size()) == bs);
+    delete v;
+    REQUIRE(kv0.stats().remote_misses_ == 2);
+
+    // a put through this node drops the copy right away
+    kv0.put(a, new Value(&cs[0], cs.size()));
+    v = kv0.get(a);
+    REQUIRE(std::string(v->get_bytes(), v->size()) == cs);
+    delete v;
+
+    // three values do not fit, so the one used least recently goes
+    delete kv0.get(b);
+    delete kv0.get(a);
+    delete kv0.get(c);
+    REQUIRE(kv0.cache_->size_ == 80);
+    size_t misses = kv0.stats().remote_misses_;
+    std::vector<Key> keys = {a, c, b};
+    std::vector<Value*> values = kv0.multi_get(keys);
+    REQUIRE(std::string(values[2]->get_bytes(), values[2]->size()) == bs);
+    for (Value* got : values) {
+        delete got;
+    }
+    REQUIRE(kv0.stats().remote_misses_ == misses + 1);
+
+    // a copy kept with another stamp than the home node has is not used
+    size_t stamp = kv0.cache_->stamp(b);
+    REQUIRE(stamp != 0);
+    Value stale(&as[0], as.size());
+    kv0.cache_->put(b, stamp - 1, &stale);
+    REQUIRE(kv0.cache_->get(b, stamp) == nullptr);
+    v = kv0.get(b);
+    REQUIRE(std::string(v->get_bytes(), v->size()) == bs);
+    delete v;
+    keys = {b};
+    kv0.cache_->put(b, stamp - 1, &stale);
+    values = kv0.multi_get(keys);
+    REQUIRE(std::string(values[0]->get_bytes(), values[0]->size()) == bs);
+    delete values[0];
+
+    // a copy of a value removed on its home node is not used either
+    kv1.remove(b);
+    values = kv0.multi_get(keys);
+    REQUIRE(values[0] == nullptr);
+    REQUIRE(kv0.cache_->stamp(b) == 0);
+
+    net0.stop();
+    net1.stop();
+    net0.join();
+    net1.join();
+}
+
+// test that values are removed wherever they live
+TEST_CASE("remove values from kvstores", "[kvstore]") {
+    Address a0("127.0.0.1", 10000);
+    Address a1("127.0.0.1", 10001);
+    NetworkIfc net0(&a0, 2);
+    KVStore kv0(&net0);
+    net0.set_kv(&kv0);
+    NetworkIfc net1(&a1, &a0, 1, 2);
+    KVStore kv1(&net1);
+    net1.set_kv(&kv1);
+    kv0.cache_remote(1000);
+
+    net0.start();
+    net1.start();
+
+    String x("x");
+    Key mine("mine", 0);
+    Key theirs("theirs", 1);
+    Key missing("missing", 1);
+    kv0.put(mine, new Value(x.c_str(), x.size()));
+    kv0.put(theirs, new Value(x.c_str(), x.size()));
+    delete kv0.get(theirs);
+    REQUIRE(kv0.size() == 1);
+
+    std::vector<Key> keys = {mine, theirs, missing};
+    kv0.remove(keys);
+    REQUIRE(kv0.size() == 0);
+    REQUIRE_FALSE(kv0.in_(mine));
+    REQUIRE(kv0.cache_->size_ == 0);
+    // messages to a node share its connection, so once the last put lands so has the rest
+    kv0.put(theirs, new Value(x.c_str(), x.size()));
+    kv0.remove(theirs);
+    Key last("last", 1);
+    kv0.put(last, new Value(x.c_str(), x.size()));
+    delete kv0.waitAndGet(last);
+    REQUIRE_FALSE(kv1.in_(theirs));
+    REQUIRE(kv1.size() == 1);
+
+    // waits for a removed key fail instead of blocking, until it is put again
+    REQUIRE(kv0.waitAndGet(mine) == nullptr);
+    REQUIRE(kv0.waitAndGet(theirs) == nullptr);
+    bool failed = false;
+    kv0.waitAndCall(mine, [&failed](Value* v) { failed = v == nullptr; });
+    REQUIRE(failed);
+    Key later("later", 0);
+    bool woken = false;
+    std::thread waiter([&kv0, &later, &woken] { woken = kv0.waitAndGet(later) == nullptr; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    kv0.remove(later);
+    waiter.join();
+    REQUIRE(woken);
+    kv0.put(mine, new Value(x.c_str(), x.size()));
+    Value* v = kv0.waitAndGet(mine);
+    REQUIRE(v->size() == 1);
+    delete v;
+
+    net0.stop();
+    net1.stop();
+    net0.join();
+    net1.join();
+}
+
+// prints get throughput against the number of reader threads; run with [benchmark]
+TEST_CASE("benchmark kvstore gets", "[.][benchmark]") {
+    KVStore kv;
+    std::vector<Key> keys;
+    for (size_t i = 0; i < 1024; i++) {
+        String* name = StrBuff().c("segment-").c(i).get();
+        keys.push_back(Key(name->c_str()));
+        // about the size of a small column segment
+        std::string blob(4096, 'x');
+        kv.put(keys.back(), new Value(&blob[0], blob.size()));
+        delete name;
+    }
+    for (size_t threads = 1; threads <= 16; threads *= 2) {
+        std::atomic<size_t> gets(0);
+        std::vector<std::thread> readers;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t t = 0; t < threads; t++) {
+            readers.push_back(std::thread([&kv, &keys, &gets, t] {
+                size_t done = 0;
+                for (size_t i = 0; i < 200000; i++) {
+                    delete kv.get(keys[(i * 7 + t) % keys.size()]);
+                    done++;
+                }
+                gets += done;
+            }));
+        }
+        for (std::thread& t : readers) {
+            t.join();
+        }
+        std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+        printf("%2zu readers: %.2f M gets/s\n", threads, gets / secs.count() / 1e6);
+    }
+}
@@ -91,24 +91,6 @@ class FileReader : public Writer {
     }
 };
 
-class Adder : public Reader {
-   public:
-    std::unordered_map<std::string, int> map_;
-
-    Adder(std::unordered_map<std::string, int>& map) : Reader() {
-        map_ = map;
-    }
-
-    void visit(Row& r) override {
-        std::string w = std::string(r.get_string(0)->c_str());
-        if (map_.find(w) == map_.end()) {
-            map_[w] = 1;
-        } else {
-            map_[w] += 1;
-        }
-    }
-};
-
 class Merger : public Reader {
    public:
     std::unordered_map<std::string, int> map_;
@@ -127,43 +109,11 @@ class Merger : public Reader {
     }
 };
 
-class Summer : public Writer {
-   public:
-    std::unordered_map<std::string, int>::iterator it_;
-    std::unordered_map<std::string, int> map_;
-
-    Summer(std::unordered_map<std::string, int>& map) : Writer() {
-        map_ = map;
-        it_ = map_.begin();
-    }
-
-    virtual ~Summer() {}
-
-    /**
-     * Visits the given row.
-     * @arg r  the row
-     */
-    virtual void visit(Row& r) {
-        String* key = new String(it_->first.c_str());
-        r.set(0, key);
-        r.set(1, it_->second);
-        it_++;
-    }
-
-    /**
-     * Marks when the writer is done visiting the data frame.
-     * @return true if done
-     */
-    virtual bool done() {
-        return it_ == map_.end();
-    }
-};
-
 /****************************************************************************
  * Calculate a word count for given file:
  *   1) read the data (single node)
  *   2) produce word counts per homed chunks, in parallel
- *   3) combine the results
+ *   3) merge the counts of each word on the node owning it
  **********************************************************author: pmaj ****/
 class WordCount : public Application {
    public:
@@ -180,51 +130,26 @@ class WordCount : public Application {
         if (node_num_ == 0) {
             delete DataFrame::fromVisitor(&in, &kd_, "S", fr_);
         }
-        local_count();
-        if (node_num_ == 0) {
-            reduce();
-        }
-    }
-
-    /** Returns a key for given node.  These keys are homed on master node
-     *  which then joins them one by one. */
-    Key* mk_key(size_t idx) {
-        StrBuff sb = StrBuff();
-        sb.c(idx);
-        String* s = sb.get();
-        Key* k = new Key(s->c_str());
-        delete s;
-        return k;
+        count();
     }
 
-    /** Compute word counts on the local node and build a data frame. */
-    void local_count() {
+    /** Counts the words homed on each node, merges the counts of every word
+     *  on the node owning it and collects the result on the master node. */
+    void count() {
         DataFrame* words = kd_.waitAndGet(in);
-        p("Node ").p(node_num_).pln(": starting local count...");
-        std::unordered_map<std::string, int> map = std::unordered_map<std::string, int>();
-        Adder add(map);
-        words->local_map(add);
+        p("Node ").p(node_num_).pln(": counting...");
+        Key k("counts");
+        std::vector<size_t> keys(1, 0);
+        std::vector<Aggregate> aggs(1, Aggregate(AggType::COUNT));
+        DataFrame* counts = words->group_by(keys).agg(&k, &kd_, aggs);
         delete words;
-        Summer cnt(add.map_);
-        Key* k = mk_key(node_num_);
-        delete DataFrame::fromVisitor(k, &kd_, "SI", cnt);
-        delete k;
-    }
-
-    /** Merge the data frames of all nodes */
-    void reduce() {
-        pln("Node 0: reducing counts...");
-        std::unordered_map<std::string, int> map = std::unordered_map<std::string, int>();
-        Key* own = mk_key(0);
-        map = merge(kd_.get(*own), map);
-        for (size_t i = 1; i < kv_.num_nodes(); ++i) {  // merge other nodes
-            Key* ok = mk_key(i);
-            map = merge(kd_.waitAndGet(*ok), map);
-            delete ok;
+        if (node_num_ == 0) {
+            std::unordered_map<std::string, int> map = std::unordered_map<std::string, int>();
+            result = merge(counts, map);
+            p("Different words: ").pln(result.size());
+        } else {
+            delete counts;
         }
-        delete own;
-        p("Different words: ").pln(map.size());
-        result = map;
     }
 
     std::unordered_map<std::string, int> merge(DataFrame* df,
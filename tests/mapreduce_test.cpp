@@ -0,0 +1,165 @@
+#include "application/mapreduce.h"
+
+#include <map>
+#include <string>
+
+#include "application/application.h"
+#include "catch.hpp"
+
+/**
+ * Writes n lines of space separated words. Line i holds the words
+ * "w0" .. "w(i % 5)".
+ */
+class LineWriter : public Writer {
+   public:
+    size_t i_ = 0;
+    size_t n_;
+
+    LineWriter(size_t n) : Writer(), n_(n) {}
+
+    void visit(Row& r) override {
+        StrBuff line;
+        for (size_t w = 0; w <= i_ % 5; w++) {
+            line.c(w == 0 ? "w" : " w").c(w);
+        }
+        r.set(0, line.get());
+        i_++;
+    }
+
+    bool done() override {
+        return i_ == n_;
+    }
+};
+
+/** Emits (word, 1) for every word of a line. */
+class WordSplitter : public MapFunction {
+   public:
+    void map(Row& in, Emitter& out) override {
+        std::string line(in.get_string(0)->c_str());
+        size_t start = 0;
+        while (start < line.size()) {
+            size_t end = line.find(' ', start);
+            if (end == std::string::npos) end = line.size();
+            out.row().set(0, new String(line.substr(start, end - start).c_str()));
+            out.row().set(1, 1);
+            out.emit();
+            start = end + 1;
+        }
+    }
+};
+
+/** Adds up the counts of a word. */
+class CountAdder : public ReduceFunction {
+   public:
+    size_t calls_ = 0;
+
+    void reduce(Row& acc, Row& in) override {
+        acc.set(1, acc.get_int(1) + in.get_int(1));
+        calls_++;
+    }
+};
+
+/** Copies (word, count) rows into a map. */
+class CountCollector : public Reader {
+   public:
+    std::map<std::string, int> counts_;
+
+    void visit(Row& r) override {
+        counts_[r.get_string(0)->c_str()] += r.get_int(1);
+    }
+};
+
+// checks the word counts of 50 lines written by LineWriter
+static void check_counts(DataFrame* df) {
+    REQUIRE(df->nrows() == 5);
+    CountCollector c;
+    df->map(c);
+    REQUIRE(c.counts_["w0"] == 50);
+    REQUIRE(c.counts_["w1"] == 40);
+    REQUIRE(c.counts_["w4"] == 10);
+}
+
+TEST_CASE("map reduce on one node", "[mapreduce]") {
+    KVStore kv;
+    KDStore kd(&kv);
+    Key in("lines");
+    Key plain("plain");
+    Key combined("combined");
+    LineWriter w(50);
+    DataFrame* lines = DataFrame::fromVisitor(&in, &kd, "S", w);
+
+    WordSplitter splitter;
+    CountAdder reducer;
+    MapReduce job(&kd, "SI", 1, &splitter, &reducer, nullptr);
+    DataFrame* counts = job.run(&plain, lines);
+    check_counts(counts);
+    // every emitted row after the first of its word is reduced
+    REQUIRE(reducer.calls_ == 150 - 5);
+
+    CountAdder reducer2;
+    CountAdder combiner;
+    MapReduce job2(&kd, "SI", 1, &splitter, &reducer2, &combiner);
+    DataFrame* counts2 = job2.run(&combined, lines);
+    check_counts(counts2);
+    // the combiner leaves one row per word for the reducer
+    REQUIRE(combiner.calls_ == 150 - 5);
+    REQUIRE(reducer2.calls_ == 0);
+
+    // nothing but the frames is left in the store
+    for (Key& k : kv.keys()) {
+        REQUIRE(k.k_.find('~') == std::string::npos);
+    }
+
+    delete counts2;
+    delete counts;
+    delete lines;
+}
+
+/**
+ * Counts words with a map reduce job on every node of a cluster.
+ */
+class Counter : public Application {
+   public:
+    DataFrame* result_ = nullptr;
+
+    Counter(NetworkIfc& net) : Application(net) {}
+
+    ~Counter() {
+        delete result_;
+    }
+
+    void run() override {
+        Key in("lines");
+        Key out("counts", 1);
+        DataFrame* lines;
+        if (this_node() == 0) {
+            LineWriter w(50);
+            lines = DataFrame::fromVisitor(&in, &kd_, "S", w);
+        } else {
+            lines = kd_.waitAndGet(in);
+        }
+        WordSplitter splitter;
+        CountAdder adder;
+        result_ = map_reduce(&out, lines, "SI", 1, &splitter, &adder, &adder);
+        delete lines;
+    }
+};
+
+TEST_CASE("map reduce across nodes", "[mapreduce]") {
+    Address a0("127.0.0.1", 10000);
+    Address a1("127.0.0.1", 10001);
+    NetworkIfc net0(&a0, 2);
+    NetworkIfc net1(&a1, &a0, 1, 2);
+
+    Counter c0(net0);
+    Counter c1(net1);
+
+    c0.start();
+    c1.start();
+
+    c0.join();
+    c1.join();
+
+    check_counts(c0.result_);
+    check_counts(c1.result_);
+}
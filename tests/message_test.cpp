@@ -183,3 +183,46 @@ TEST_CASE("test_serialize_deserialize_status_message", "[message][serialize][des
 
     REQUIRE(m2.message_->equals(m2.message_));
 }
+
+TEST_CASE("test_serialize_deserialize_multi_messages", "[message][serialize][deserialize]") {
+    std::vector<Key> keys = {Key("a", 1), Key("bb", 2)};
+    MultiGet g(keys);
+    Serializer s;
+    g.serialize(&s);
+    Deserializer d(s.get_bytes(), s.size());
+    REQUIRE(d.get_msg_type() == MsgType::MULTIGET);
+    MultiGet g2(&d);
+    REQUIRE(g2.keys_ == keys);
+    REQUIRE(g2.keys_[1].node_ == 2);
+    REQUIRE(g2.stamps_ == std::vector<size_t>{0, 0});
+    std::vector<size_t> stamps = {7, 0};
+    MultiGet g3(keys, stamps);
+    Serializer s4;
+    g3.serialize(&s4);
+    Deserializer d4(s4.get_bytes(), s4.size());
+    REQUIRE(d4.get_msg_type() == MsgType::MULTIGET);
+    MultiGet g4(&d4);
+    REQUIRE(g4.keys_ == keys);
+    REQUIRE(g4.stamps_ == stamps);
+
+    String st("serialized data");
+    std::vector<Value*> values = {new Value(st.c_str(), st.size()), new Value(st.c_str(), 3)};
+    MultiPut p(keys, values);
+    Serializer s2;
+    p.serialize(&s2);
+    Deserializer d2(s2.get_bytes(), s2.size());
+    REQUIRE(d2.get_msg_type() == MsgType::MULTIPUT);
+    MultiPut p2(&d2);
+    REQUIRE(p2.keys_ == keys);
+    REQUIRE(p2.values_.size() == 2);
+    REQUIRE(p2.values_[0]->equals(values[0]));
+    REQUIRE(p2.values_[1]->size() == 3);
+
+    Remove r(keys);
+    Serializer s3;
+    r.serialize(&s3);
+    Deserializer d3(s3.get_bytes(), s3.size());
+    REQUIRE(d3.get_msg_type() == MsgType::REMOVE);
+    Remove r2(&d3);
+    REQUIRE(r2.keys_ == keys);
+}
@@ -0,0 +1,282 @@
+#include "dataframe/query.h"
+
+#include <map>
+#include <string>
+
+#include "application/application.h"
+#include "catch.hpp"
+
+/**
+ * Writes n rows (id, team, score) where row i is on team "t" + i % 4 and
+ * scores i / 2.
+ */
+class ScoreWriter : public Writer {
+   public:
+    size_t i_ = 0;
+    size_t n_;
+
+    ScoreWriter(size_t n) : Writer(), n_(n) {}
+
+    void visit(Row& r) override {
+        r.set(0, (int)i_);
+        r.set(1, StrBuff().c("t").c(i_ % 4).get());
+        r.set(2, i_ / 2.0);
+        i_++;
+    }
+
+    bool done() override {
+        return i_ == n_;
+    }
+};
+
+/**
+ * Writes the teams (team, city) t0..t3, where t3 has no city.
+ */
+class TeamWriter : public Writer {
+   public:
+    size_t i_ = 0;
+
+    void visit(Row& r) override {
+        const char* cities[] = {"boston", "paris", "boston"};
+        r.set(0, StrBuff().c("t").c(i_).get());
+        r.set(1, new String(cities[i_]));
+        i_++;
+    }
+
+    bool done() override {
+        return i_ == 3;
+    }
+};
+
+/**
+ * Maps (id, team, score) to (id, twice the score).
+ */
+class Doubler : public Mapper {
+   public:
+    void map(Row& in, Row& out) override {
+        out.set(0, in.get_int(0));
+        out.set(1, in.get_double(2) * 2);
+    }
+};
+
+/**
+ * Keeps the rows whose two int columns add up to an even number.
+ */
+class EvenSum : public Filter {
+   public:
+    bool accept(Row& r, std::vector<size_t>& cols) override {
+        return (r.get_int(cols[0]) + r.get_int(cols[1])) % 2 == 0;
+    }
+};
+
+/**
+ * Copies a (city, count, sum) result into a map.
+ */
+class CityCollector : public Reader {
+   public:
+    std::map<std::string, std::pair<int, double>> cities_;
+
+    void visit(Row& r) override {
+        cities_[r.get_string(0)->c_str()] = std::make_pair(r.get_int(1), r.get_double(2));
+    }
+};
+
+static std::vector<Aggregate> city_aggs() {
+    std::vector<Aggregate> aggs;
+    aggs.push_back(Aggregate(AggType::COUNT));
+    aggs.push_back(Aggregate(AggType::SUM, 1));
+    return aggs;
+}
+
+// scores with id < 20 and a known team, joined to their city and projected to
+// (city, score), then counted and summed per city
+static Query* city_query(KDStore* kd, Key& scores, Key& teams) {
+    Query* q = new Query(kd, scores);
+    q->join(new Query(kd, teams), 1, 0)
+        .project({4, 2, 0})
+        .filter(2, CmpOp::LT, 20)
+        .filter(0, CmpOp::NE, "paris")
+        .agg({0}, city_aggs());
+    return q;
+}
+
+// checks the result of city_query over 40 scores
+static void check_cities(DataFrame* df) {
+    REQUIRE(df->nrows() == 1);
+    CityCollector c;
+    df->map(c);
+    // ids 0, 2, 4, ..., 18 are on t0 or t2, both in boston
+    REQUIRE(c.cities_["boston"].first == 10);
+    REQUIRE(c.cities_["boston"].second == 45.0);
+}
+
+TEST_CASE("query filters move before shuffles", "[query]") {
+    KVStore kv;
+    KDStore kd(&kv);
+    Key scores("scores");
+    Key teams("teams");
+    ScoreWriter sw(40);
+    TeamWriter tw;
+    delete DataFrame::fromVisitor(&scores, &kd, "ISD", sw);
+    delete DataFrame::fromVisitor(&teams, &kd, "SS", tw);
+
+    Query* q = city_query(&kd, scores, teams);
+    q->optimize();
+    // the id filter goes through the project and the join to the scan, the
+    // city filter through the project into the right side of the join
+    REQUIRE(q->steps_.size() == 4);
+    REQUIRE(q->steps_[0]->op_ == QueryOp::FILTER);
+    REQUIRE(q->steps_[0]->cols_ == std::vector<size_t>({0}));
+    REQUIRE(q->steps_[1]->op_ == QueryOp::JOIN);
+    REQUIRE(q->steps_[2]->op_ == QueryOp::PROJECT);
+    REQUIRE(q->steps_[3]->op_ == QueryOp::AGGREGATE);
+    Query* right = q->steps_[1]->right_;
+    REQUIRE(right->steps_.size() == 1);
+    REQUIRE(right->steps_[0]->cols_ == std::vector<size_t>({1}));
+    // a second pass leaves the steps as they are
+    q->optimize();
+    REQUIRE(q->steps_.size() == 4);
+    REQUIRE(q->steps_[0]->cols_ == std::vector<size_t>({0}));
+    REQUIRE(right->steps_.size() == 1);
+
+    // a filter on an aggregate stays after it, one on a group key does not
+    Query groups(&kd, scores);
+    groups.agg({1}, {Aggregate(AggType::COUNT)})
+        .filter(0, CmpOp::EQ, "t1")
+        .filter(1, CmpOp::GT, 3);
+    groups.optimize();
+    REQUIRE(groups.steps_[0]->op_ == QueryOp::FILTER);
+    REQUIRE(groups.steps_[0]->cols_ == std::vector<size_t>({1}));
+    REQUIRE(groups.steps_[1]->op_ == QueryOp::AGGREGATE);
+    REQUIRE(groups.steps_[2]->cols_ == std::vector<size_t>({1}));
+    delete q;
+}
+
+TEST_CASE("query runs fused steps on one node", "[query]") {
+    KVStore kv;
+    KDStore kd(&kv);
+    Key scores("scores");
+    Key teams("teams");
+    Key out("cities");
+    ScoreWriter sw(40);
+    TeamWriter tw;
+    delete DataFrame::fromVisitor(&scores, &kd, "ISD", sw);
+    delete DataFrame::fromVisitor(&teams, &kd, "SS", tw);
+
+    Query* q = city_query(&kd, scores, teams);
+    DataFrame* cities = q->store(&out);
+    check_cities(cities);
+    DataFrame* stored = kd.get(out);
+    check_cities(stored);
+
+    // map and a multi column filter, collected without a key
+    Doubler doubler;
+    EvenSum even;
+    Query doubled(&kd, scores);
+    doubled.filter(2, CmpOp::GE, 5.0).filter({0, 0}, &even).map("ID", &doubler);
+    DataFrame* df = doubled.collect();
+    REQUIRE(df->nrows() == 30);
+    REQUIRE(df->ncols() == 2);
+    REQUIRE(df->get_int(0, 0) == 10);
+    REQUIRE(df->get_double(1, 29) == 39.0);
+    // running the same query again gives the same rows
+    DataFrame* again = doubled.collect();
+    REQUIRE(again->nrows() == 30);
+    REQUIRE(again->get_int(0, 0) == 10);
+    REQUIRE(again->get_double(1, 29) == 39.0);
+
+    delete again;
+    delete df;
+    delete stored;
+    delete cities;
+    delete q;
+}
+
+// test that the row bound of a join covers every pair of matching rows
+TEST_CASE("bound the rows of a join", "[query]") {
+    KVStore kv;
+    KDStore kd(&kv);
+    Key scores("scores");
+    Key teams("teams");
+    ScoreWriter sw(40);
+    TeamWriter tw;
+    DataFrame* left = DataFrame::fromVisitor(&scores, &kd, "ISD", sw);
+    DataFrame* right = DataFrame::fromVisitor(&teams, &kd, "SS", tw);
+    QueryStep step(QueryOp::JOIN, {});
+    step.left_key_ = 1;
+    JoinSource join(left, right, &step, &kv, "bound");
+    REQUIRE(join.nrows() == 120);
+
+    // a join of joins saturates rather than wrapping around
+    QueryStep on_team(QueryOp::JOIN, {});
+    on_team.left_key_ = 1;
+    on_team.right_key_ = 1;
+    JoinSource twice(&join, &join, &on_team, &kv, "twice");
+    JoinSource again(&twice, &twice, &on_team, &kv, "again");
+    JoinSource more(&again, &again, &on_team, &kv, "more");
+    JoinSource most(&more, &more, &on_team, &kv, "most");
+    REQUIRE(most.nrows() == SIZE_MAX);
+    delete left;
+    delete right;
+}
+
+/**
+ * Runs the same query on every node of a cluster.
+ */
+class Querier : public Application {
+   public:
+    DataFrame* stored_ = nullptr;
+    DataFrame* collected_ = nullptr;
+
+    Querier(NetworkIfc& net) : Application(net) {}
+
+    ~Querier() {
+        delete stored_;
+        delete collected_;
+    }
+
+    void run() override {
+        Key scores("scores");
+        Key teams("teams");
+        Key out("cities", 1);
+        if (this_node() == 0) {
+            ScoreWriter sw(40);
+            TeamWriter tw;
+            delete DataFrame::fromVisitor(&scores, &kd_, "ISD", sw);
+            delete DataFrame::fromVisitor(&teams, &kd_, "SS", tw);
+        }
+        Query* q = city_query(&kd_, scores, teams);
+        stored_ = q->store(&out);
+        delete q;
+        q = city_query(&kd_, scores, teams);
+        collected_ = q->collect();
+        delete q;
+    }
+};
+
+TEST_CASE("query runs across nodes", "[query]") {
+    Address a0("127.0.0.1", 10000);
+    Address a1("127.0.0.1", 10001);
+    NetworkIfc net0(&a0, 2);
+    NetworkIfc net1(&a1, &a0, 1, 2);
+
+    Querier q0(net0);
+    Querier q1(net1);
+
+    q0.start();
+    q1.start();
+
+    q0.join();
+    q1.join();
+
+    check_cities(q0.stored_);
+    check_cities(q1.stored_);
+    check_cities(q0.collected_);
+    check_cities(q1.collected_);
+    // each node keeps the segments of its collected copy
+    for (size_t i = 0; i < q1.collected_->ncols(); i++) {
+        for (Key& k : q1.collected_->columns_[i]->table_->keys_) {
+            REQUIRE(k.get_node() == 1);
+        }
+    }
+}
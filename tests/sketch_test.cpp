@@ -0,0 +1,244 @@
+#include "dataframe/sketches.h"
+
+#include <map>
+#include <string>
+
+#include "application/application.h"
+#include "catch.hpp"
+
+// hashes an int the way ColumnSketch hashes an int column
+static uint64_t int_hash(int i) {
+    return sketch_hash((const char*)&i, sizeof(int));
+}
+
+TEST_CASE("hyperloglog estimates distinct counts", "[sketch]") {
+    HyperLogLog a(SKETCH_HLL_PRECISION);
+    HyperLogLog b(SKETCH_HLL_PRECISION);
+    for (int i = 0; i < 100000; i++) {
+        a.add(int_hash(i));
+        a.add(int_hash(i));
+        b.add(int_hash(i + 50000));
+    }
+    REQUIRE(a.estimate() > 95000);
+    REQUIRE(a.estimate() < 105000);
+
+    // merging takes the union, and survives serializing
+    Serializer s;
+    b.serialize(&s);
+    Deserializer d(s.get_bytes(), s.size());
+    HyperLogLog copy(&d);
+    a.merge(copy);
+    REQUIRE(a.estimate() > 142500);
+    REQUIRE(a.estimate() < 157500);
+
+    // small counts are exact enough to rely on
+    HyperLogLog small(SKETCH_HLL_PRECISION);
+    for (int i = 0; i < 10; i++) {
+        small.add(int_hash(i % 5));
+    }
+    REQUIRE(small.estimate() > 4.5);
+    REQUIRE(small.estimate() < 5.5);
+}
+
+TEST_CASE("count-min never under estimates", "[sketch]") {
+    CountMin a(SKETCH_CM_WIDTH, SKETCH_CM_DEPTH);
+    CountMin b(SKETCH_CM_WIDTH, SKETCH_CM_DEPTH);
+    for (int i = 0; i < 10000; i++) {
+        a.add(int_hash(i % 100), 1);
+        b.add(int_hash(i % 7), 2);
+    }
+    for (int i = 0; i < 100; i++) {
+        REQUIRE(a.estimate(int_hash(i)) >= 100);
+        REQUIRE(a.estimate(int_hash(i)) <= 110);
+    }
+    a.merge(b);
+    REQUIRE(a.estimate(int_hash(3)) >= 100 + 2 * 1428);
+    REQUIRE(a.estimate(int_hash(1000)) < 20);
+}
+
+TEST_CASE("space-saving keeps the most frequent keys", "[sketch]") {
+    // key i occurs 1000 / (i + 1) times on each side, spread over many rare
+    // keys
+    SpaceSaving a(10);
+    SpaceSaving b(10);
+    for (int i = 0; i < 50; i++) {
+        for (int j = 0; j < 1000 / (i + 1); j++) {
+            a.add((const char*)&i, sizeof(int), 1);
+        }
+        int rare = 1000 + i;
+        a.add((const char*)&rare, sizeof(int), 1);
+        b.add((const char*)&i, sizeof(int), 1000 / (i + 1));
+    }
+    // only keys added more than n / k ~ 455 times are sure to be kept
+    std::vector<SpaceSavingItem> top = a.top();
+    REQUIRE(top.size() == 10);
+    for (size_t i = 0; i < 2; i++) {
+        int key;
+        memcpy(&key, top[i].key_.data(), sizeof(int));
+        REQUIRE(key == (int)i);
+        REQUIRE(top[i].count_ - top[i].error_ <= 1000 / (i + 1));
+        REQUIRE(top[i].count_ >= 1000 / (i + 1));
+    }
+
+    Serializer s;
+    b.serialize(&s);
+    Deserializer d(s.get_bytes(), s.size());
+    SpaceSaving copy(&d);
+    a.merge(copy);
+    top = a.top();
+    REQUIRE(top.size() == 10);
+    for (size_t i = 0; i < 2; i++) {
+        int key;
+        memcpy(&key, top[i].key_.data(), sizeof(int));
+        REQUIRE(key == (int)i);
+        REQUIRE(top[i].count_ >= 2 * (1000 / (i + 1)));
+    }
+}
+
+/**
+ * Writes n rows (word, i % 1000). Half of the words are "w0", a quarter "w1"
+ * and an eighth "w2"; the rest is spread over "w3" to "w200".
+ */
+class ZipfWriter : public Writer {
+   public:
+    size_t i_ = 0;
+    size_t n_;
+
+    ZipfWriter(size_t n) : Writer(), n_(n) {}
+
+    void visit(Row& r) override {
+        size_t w = 3 + (i_ / 8) % 198;
+        if (i_ % 2 == 0) {
+            w = 0;
+        } else if (i_ % 4 == 1) {
+            w = 1;
+        } else if (i_ % 8 == 3) {
+            w = 2;
+        }
+        r.set(0, StrBuff().c("w").c(w).get());
+        r.set(1, (int)(i_ % 1000));
+        i_++;
+    }
+
+    bool done() override {
+        return i_ == n_;
+    }
+};
+
+/** Copies (word, count) rows into a map, keeping their order. */
+class TopCollector : public Reader {
+   public:
+    std::vector<std::string> words_;
+    std::map<std::string, int> counts_;
+
+    void visit(Row& r) override {
+        words_.push_back(r.get_string(0)->c_str());
+        counts_[r.get_string(0)->c_str()] = r.get_int(1);
+    }
+};
+
+TEST_CASE("sketch a column on one node", "[sketch]") {
+    KVStore kv;
+    KDStore kd(&kv);
+    Key k("words");
+    ZipfWriter w(6000);
+    DataFrame* df = DataFrame::fromVisitor(&k, &kd, "SI", w);
+
+    ColumnSketch nums(1, 'I', 5);
+    nums.run(&kv, "nums", df);
+    REQUIRE(nums.distinct() > 980);
+    REQUIRE(nums.distinct() < 1020);
+
+    ColumnSketch words(0, 'S', 3);
+    words.run(&kv, "words", df);
+    TopCollector top;
+    words.top(top);
+    REQUIRE(top.words_ == std::vector<std::string>({"w0", "w1", "w2"}));
+    // w0 is every other word
+    REQUIRE(top.counts_["w0"] >= 3000);
+
+    Schema s("S");
+    Row r(s);
+    r.set(0, new String("w0"));
+    REQUIRE(words.frequency(r, 0) >= 3000);
+    REQUIRE(words.frequency(r, 0) < 3100);
+    delete df;
+}
+
+/**
+ * Sketches the words of a frame written by node 0 on every node.
+ */
+class Sketcher : public Application {
+   public:
+    ColumnSketch* words_ = nullptr;
+    std::vector<ColumnSketch*> both_;
+
+    Sketcher(NetworkIfc& net) : Application(net) {}
+
+    ~Sketcher() {
+        delete words_;
+        for (ColumnSketch* s : both_) {
+            delete s;
+        }
+    }
+
+    void run() override {
+        Key k("words");
+        DataFrame* df;
+        if (this_node() == 0) {
+            std::vector<Column*> cols;
+            cols.push_back(new StringColumn(&kv_, 1000));
+            cols.push_back(new IntColumn(&kv_, 1000));
+            Schema s("SI");
+            Row r(s);
+            ZipfWriter w(6000);
+            while (!w.done()) {
+                w.visit(r);
+                r.add_to_columns(cols);
+            }
+            df = new DataFrame(cols, &kv_);
+            kd_.put(k, df);
+        } else {
+            df = kd_.waitAndGet(k);
+        }
+        words_ = sketch("words~sk", df, 0, 3);
+        both_ = sketch_all("both~sk", df, {1, 0}, 3);
+        delete df;
+    }
+};
+
+TEST_CASE("sketch a column across nodes", "[sketch]") {
+    Address a0("127.0.0.1", 10000);
+    Address a1("127.0.0.1", 10001);
+    NetworkIfc net0(&a0, 2);
+    NetworkIfc net1(&a1, &a0, 1, 2);
+
+    Sketcher s0(net0);
+    Sketcher s1(net1);
+
+    s0.start();
+    s1.start();
+
+    s0.join();
+    s1.join();
+
+    for (Sketcher* s : {&s0, &s1}) {
+        // every node holds 3000 words, and together they hold all 201
+        REQUIRE(s->words_->distinct() >= 195);
+        REQUIRE(s->words_->distinct() <= 207);
+        TopCollector top;
+        s->words_->top(top);
+        REQUIRE(top.words_ == std::vector<std::string>({"w0", "w1", "w2"}));
+        REQUIRE(top.counts_["w0"] >= 3000);
+
+        // sketching both columns in one pass finds the same
+        REQUIRE(s->both_.size() == 2);
+        REQUIRE(s->both_[0]->distinct() > 980);
+        REQUIRE(s->both_[0]->distinct() < 1020);
+        REQUIRE(s->both_[1]->distinct() == s->words_->distinct());
+        TopCollector both;
+        s->both_[1]->top(both);
+        REQUIRE(both.words_ == top.words_);
+        REQUIRE(both.counts_ == top.counts_);
+    }
+}
@@ -0,0 +1,107 @@
+#include "store/snapshot.h"
+
+#include <typeinfo>
+
+#include "catch.hpp"
+#include "dataframe/dataframe.h"
+#include "store/kdstore.h"
+
+// test that every value comes back from a snapshot, spilled or not
+TEST_CASE("save and load a snapshot of a kvstore", "[snapshot][kvstore]") {
+    const char* path = "/tmp/snapshot_test.snap";
+    KVStore kv;
+    kv.spill_to("/tmp/snapshot_test.spill", 0);
+    String small("abc");
+    Key a("a");
+    kv.put(a, new Value(small.c_str(), small.size()));
+    Key empty("empty");
+    kv.put(empty, new Value());
+    Key big("big");
+    std::string bytes(1000, 'b');
+    kv.put(big, new Value(&bytes[0], bytes.size()));
+    REQUIRE(kv.stats().spilled_ == 1000);
+    save_snapshot(&kv, path);
+
+    KVStore restored;
+    REQUIRE_FALSE(load_snapshot(&restored, "/tmp/snapshot_test.missing"));
+    REQUIRE(load_snapshot(&restored, path));
+    REQUIRE(restored.size() == 3);
+    Value* v = restored.get(a);
+    REQUIRE(std::string(v->get_bytes(), v->size()) == "abc");
+    delete v;
+    v = restored.get(empty);
+    REQUIRE(v->size() == 0);
+    delete v;
+    v = restored.get(big);
+    REQUIRE(std::string(v->get_bytes(), v->size()) == bytes);
+    delete v;
+
+    // the values stay in the mapped file and a put replaces them as usual
+    restored.each([](Key& k, Value* v) { REQUIRE(typeid(*v) == typeid(MappedValue)); });
+    restored.put(a, new Value(small.c_str(), 1));
+    v = restored.get(a);
+    REQUIRE(v->size() == 1);
+    delete v;
+    unlink(path);
+}
+
+// test that a snapshot is only loaded while its inputs are unchanged
+TEST_CASE("skip a snapshot whose inputs changed", "[snapshot][kvstore]") {
+    const char* path = "/tmp/snapshot_test_inputs.snap";
+    const char* input = "/tmp/snapshot_test_inputs.txt";
+    FILE* f = fopen(input, "w");
+    fputs("first", f);
+    fclose(f);
+    size_t inputs = snapshot_inputs({input});
+    REQUIRE(snapshot_inputs({input}) == inputs);
+    REQUIRE(snapshot_inputs({input, "/tmp/snapshot_test_inputs.missing"}) != inputs);
+
+    KVStore kv;
+    String s("abc");
+    Key a("a");
+    kv.put(a, new Value(s.c_str(), s.size()));
+    save_snapshot(&kv, path, inputs);
+    KVStore restored;
+    REQUIRE_FALSE(load_snapshot(&restored, path));
+    REQUIRE(load_snapshot(&restored, path, inputs));
+    REQUIRE(restored.size() == 1);
+
+    f = fopen(input, "w");
+    fputs("second, longer", f);
+    fclose(f);
+    KVStore changed;
+    REQUIRE_FALSE(load_snapshot(&changed, path, snapshot_inputs({input})));
+    REQUIRE(changed.size() == 0);
+    unlink(input);
+    unlink(path);
+}
+
+// test that a restarted store gets its frames back from a snapshot
+TEST_CASE("restore frames from a snapshot", "[snapshot][kdstore]") {
+    const char* path = "/tmp/snapshot_test_frames.snap";
+    size_t SZ = 5000;
+    int* ints = new int[SZ];
+    for (size_t i = 0; i < SZ; i++) {
+        ints[i] = i * 3;
+    }
+    {
+        KVStore kv;
+        KDStore kd(&kv);
+        Key k("ints");
+        delete DataFrame::fromArray(&k, &kd, SZ, ints);
+        save_snapshot(&kv, path);
+    }
+
+    KVStore kv;
+    KDStore kd(&kv);
+    REQUIRE(load_snapshot(&kv, path));
+    Key k("ints");
+    DataFrame* df = kd.get(k);
+    REQUIRE(df->nrows() == SZ);
+    for (size_t i = 0; i < SZ; i++) {
+        REQUIRE(df->get_int(0, i) == ints[i]);
+    }
+    delete df;
+    delete[] ints;
+    unlink(path);
+}
@@ -0,0 +1,187 @@
+#include "dataframe/sort.h"
+
+#include <string>
+
+#include "application/application.h"
+#include "catch.hpp"
+
+/**
+ * Writes n rows (word, num, x) in no particular order. For n = 101 every num
+ * in -50..50 appears once.
+ */
+class ShuffledWriter : public Writer {
+   public:
+    size_t i_ = 0;
+    size_t n_;
+
+    ShuffledWriter(size_t n) : Writer(), n_(n) {}
+
+    void visit(Row& r) override {
+        const char* words[] = {"pear", "apple", "fig", "apples"};
+        r.set(0, new String(words[i_ % 4]));
+        r.set(1, (int)((i_ * 37) % 101) - 50);
+        r.set(2, (double)(i_ % 5) - 2.5);
+        i_++;
+    }
+
+    bool done() override {
+        return i_ == n_;
+    }
+};
+
+/**
+ * Checks that the rows of a (word, num, x) frame are in order by word, then
+ * x, then num.
+ */
+class OrderChecker : public Reader {
+   public:
+    std::string word_;
+    double x_ = 0;
+    int num_ = 0;
+    size_t rows_ = 0;
+    bool ok_ = true;
+
+    void visit(Row& r) override {
+        std::string word(r.get_string(0)->c_str());
+        double x = r.get_double(2);
+        int num = r.get_int(1);
+        if (rows_ > 0) {
+            bool after = word > word_ || (word == word_ && x > x_) ||
+                         (word == word_ && x == x_ && num >= num_);
+            ok_ = ok_ && after;
+        }
+        word_ = word;
+        x_ = x;
+        num_ = num;
+        rows_++;
+    }
+};
+
+/**
+ * Checks that the num column of a (word, num, x) frame counts up from -50.
+ */
+class NumChecker : public Reader {
+   public:
+    int expected_ = -50;
+    bool ok_ = true;
+
+    void visit(Row& r) override {
+        ok_ = ok_ && r.get_int(1) == expected_;
+        expected_++;
+    }
+};
+
+TEST_CASE("radix keys keep the order of values", "[sort]") {
+    int ints[] = {-2147483647 - 1, -7, -1, 0, 1, 42, 2147483647};
+    for (size_t i = 1; i < 7; i++) {
+        REQUIRE(radix_key('I', (char*)&ints[i - 1]) < radix_key('I', (char*)&ints[i]));
+    }
+    double doubles[] = {-1e300, -2.5, -1e-300, 0.0, 1e-300, 2.5, 1e300};
+    for (size_t i = 1; i < 7; i++) {
+        REQUIRE(radix_key('D', (char*)&doubles[i - 1]) < radix_key('D', (char*)&doubles[i]));
+    }
+
+    std::vector<uint64_t> keys = {5, 1ULL << 40, 3, 5, 0};
+    std::vector<size_t> items = {0, 1, 2, 3, 4};
+    radix_sort(keys, items);
+    std::vector<size_t> expected = {4, 2, 0, 3, 1};
+    REQUIRE(items == expected);
+}
+
+TEST_CASE("sort a frame on one node", "[sort]") {
+    KVStore kv;
+    KDStore kd(&kv);
+    Key in("in");
+    Key by_num("by_num");
+    Key by_all("by_all");
+    ShuffledWriter w(101);
+    DataFrame* df = DataFrame::fromVisitor(&in, &kd, "SID", w);
+
+    DataFrame* sorted = df->sort_by(&by_num, &kd, {1});
+    REQUIRE(sorted->nrows() == 101);
+    NumChecker nc;
+    sorted->map(nc);
+    REQUIRE(nc.ok_);
+    REQUIRE(sorted->partitions()->size() == 1);
+
+    DataFrame* multi = df->sort_by(&by_all, &kd, {0, 2, 1});
+    REQUIRE(multi->nrows() == 101);
+    OrderChecker oc;
+    multi->map(oc);
+    REQUIRE(oc.ok_);
+    REQUIRE(oc.rows_ == 101);
+
+    delete multi;
+    delete sorted;
+    delete df;
+}
+
+/**
+ * Sorts the same frame on every node of a cluster.
+ */
+class Sorter : public Application {
+   public:
+    DataFrame* result_ = nullptr;
+
+    Sorter(NetworkIfc& net) : Application(net) {}
+
+    ~Sorter() {
+        delete result_;
+    }
+
+    void run() override {
+        Key in("in");
+        Key out("sorted", 1);
+        DataFrame* df;
+        if (this_node() == 0) {
+            ShuffledWriter w(101);
+            df = DataFrame::fromVisitor(&in, &kd_, "SID", w);
+        } else {
+            df = kd_.waitAndGet(in);
+        }
+        result_ = df->sort_by(&out, &kd_, {1});
+        delete df;
+    }
+};
+
+TEST_CASE("sort a frame across nodes", "[sort]") {
+    Address a0("127.0.0.1", 10000);
+    Address a1("127.0.0.1", 10001);
+    NetworkIfc net0(&a0, 2);
+    NetworkIfc net1(&a1, &a0, 1, 2);
+
+    Sorter s0(net0);
+    Sorter s1(net1);
+
+    s0.start();
+    s1.start();
+
+    s0.join();
+    s1.join();
+
+    for (Sorter* s : {&s0, &s1}) {
+        DataFrame* df = s->result_;
+        REQUIRE(df->nrows() == 101);
+        NumChecker nc;
+        df->map(nc);
+        REQUIRE(nc.ok_);
+
+        // the partitions survive storing and split the rows at the splitter
+        RangePartitions* parts = df->partitions();
+        REQUIRE(parts->size() == 2);
+        REQUIRE(parts->start(0) == 0);
+        REQUIRE(parts->start(2) == 101);
+        int split;
+        memcpy(&split, parts->splits_[0].data(), sizeof(int));
+        REQUIRE(parts->start(1) == (size_t)(split + 50));
+
+        int lo = -50;
+        int hi = split - 1;
+        size_t begin, end;
+        parts->rows_for((char*)&lo, (char*)&hi, &begin, &end);
+        REQUIRE((begin == 0 && end == parts->start(1)));
+        lo = split;
+        parts->rows_for((char*)&lo, (char*)&lo, &begin, &end);
+        REQUIRE((begin == parts->start(1) && end == 101));
+    }
+}
@@ -0,0 +1,117 @@
+#include "dataframe/typed.h"
+
+#include <string>
+
+#include "catch.hpp"
+#include "store/kdstore.h"
+
+/**
+ * Writes n rows (i, i * 2, "s" + i % 3, i / 4.0, i odd).
+ */
+class MixedWriter : public Writer {
+   public:
+    size_t i_ = 0;
+    size_t n_;
+
+    MixedWriter(size_t n) : Writer(), n_(n) {}
+
+    void visit(Row& r) override {
+        r.set(0, (int)i_);
+        r.set(1, (int)i_ * 2);
+        r.set(2, StrBuff().c("s").c(i_ % 3).get());
+        r.set(3, i_ / 4.0);
+        r.set(4, i_ % 2 == 1);
+        i_++;
+    }
+
+    bool done() override {
+        return i_ == n_;
+    }
+};
+
+/**
+ * Adds up the int columns of the rows on string "s1", and the double column
+ * of the odd rows.
+ */
+class TypedSummer {
+   public:
+    int ints_ = 0;
+    double doubles_ = 0;
+    size_t rows_ = 0;
+
+    void visit(TypedRow<int, int, String, double, bool>& r) {
+        if (strcmp(r.get<2>()->c_str(), "s1") == 0) {
+            ints_ += r.get<0>() + r.get<1>();
+        }
+        if (r.get<4>()) {
+            doubles_ += r.get<3>();
+        }
+        rows_++;
+    }
+};
+
+// builds the frame MixedWriter writes for n rows, with small segments
+static DataFrame* mixed_frame(KVStore* kv, size_t n) {
+    std::vector<Column*> cols;
+    cols.push_back(new IntColumn(kv, 7));
+    cols.push_back(new IntColumn(kv, 7));
+    cols.push_back(new StringColumn(kv, 7));
+    cols.push_back(new DoubleColumn(kv, 7));
+    cols.push_back(new BoolColumn(kv, 7));
+    Schema s("IISDB");
+    Row r(s);
+    MixedWriter w(n);
+    while (!w.done()) {
+        w.visit(r);
+        r.add_to_columns(cols);
+    }
+    return new DataFrame(cols, kv);
+}
+
+TEST_CASE("typed frames read cells without run time checks", "[typed][dataframe]") {
+    KVStore kv;
+    DataFrame* df = mixed_frame(&kv, 30);
+    TypedDataFrame<int, int, String, double, bool> typed(*df);
+    REQUIRE(typed.nrows() == 30);
+
+    // random access, moving between segments
+    REQUIRE(typed.get<1>(29) == 58);
+    REQUIRE(typed.get<0>(3) == 3);
+    REQUIRE(typed.get<3>(22) == 5.5);
+    REQUIRE(typed.get<4>(21));
+    REQUIRE(std::string(typed.get<2>(8)->c_str()) == "s2");
+
+    // rows 1, 4, ..., 28 are on "s1"; the odd rows 1, 3, ..., 29
+    TypedSummer sum;
+    typed.map(sum);
+    REQUIRE(sum.rows_ == 30);
+    REQUIRE(sum.ints_ == 145 * 3);
+    REQUIRE(sum.doubles_ == 225 / 4.0);
+
+    // on a single node every row is local
+    TypedSummer local;
+    typed.local_map(local);
+    REQUIRE(local.rows_ == 30);
+    REQUIRE(local.ints_ == sum.ints_);
+
+    // the typed frame does not disturb the frame it was opened on
+    REQUIRE(df->get_int(0, 29) == 29);
+    delete df;
+}
+
+TEST_CASE("typed frames open stored frames", "[typed][kdstore]") {
+    KVStore kv;
+    KDStore kd(&kv);
+    Key k("mixed");
+    MixedWriter w(10);
+    delete DataFrame::fromVisitor(&k, &kd, "IISDB", w);
+    DataFrame* df = kd.get(k);
+    TypedDataFrame<int, int, String, double, bool> typed(*df);
+    delete df;
+
+    TypedSummer sum;
+    typed.map(sum);
+    REQUIRE(sum.rows_ == 10);
+    // rows 1, 4 and 7 are on "s1"
+    REQUIRE(sum.ints_ == 12 * 3);
+}